@@ -0,0 +1,171 @@
+#include "autotune.h"
+#include "scan.h"
+#include "segscan.h"
+
+#include <cstdio>
+#include <vector>
+
+/*
+ * Workgroup sizes we try (those the device allows).
+ */
+static const size_t workgroup_sizes[] = { 32, 64, 128, 256, 512, 1024 };
+static const int nworkgroup_sizes = sizeof(workgroup_sizes) / sizeof(workgroup_sizes[0]);
+
+static const int items_per_workitem[] = { 2, 4, 8 };
+static const int nitems_per_workitem = sizeof(items_per_workitem) / sizeof(items_per_workitem[0]);
+
+static size_t max_workgroup_size(CLWrapper &clw) {
+  size_t wx = 0;
+  ASSERT_NO_CL_ERROR(
+    clGetDeviceInfo(clw.get_device(), CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &wx, NULL));
+  return wx;
+}
+
+static cl_ulong local_mem_size(CLWrapper &clw) {
+  cl_ulong size = 0;
+  ASSERT_NO_CL_ERROR(
+    clGetDeviceInfo(clw.get_device(), CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &size, NULL));
+  return size;
+}
+
+/*
+ * Local memory of BasicSegmentedScan with workgroups of [wx]: subarrays of 2*wx data,
+ *   flags and partial flags (uchar since the flags were narrowed), each of which the
+ *   runtime may align; we allow 128 bytes of padding per argument.
+ */
+static size_t segscan_local_bytes(size_t element_size, size_t wx) {
+  size_t m = wx*2;
+  return (element_size + 2*sizeof(cl_uchar))*m + 3*128;
+}
+
+/*
+ * The array length we time for [bucket]: the middle of [2^bucket, 2^(bucket+1)).
+ */
+static int bucket_length(int bucket) {
+  return (1 << bucket) + (bucket > 0 ? (1 << (bucket-1)) : 0);
+}
+
+/*
+ * Time per scan: the sum of [timings] over [num_iter] scans.
+ * The scans are of device buffers so this is all device work and no host copies.
+ */
+static float scan_time(map<string,float> &timings, int num_iter) {
+  float total = 0;
+  map<string,float>::iterator i;
+  for (i = timings.begin(); i != timings.end(); i++) {
+    total += i->second;
+  }
+  return total / num_iter;
+}
+
+template <typename T, class Op>
+void autotune_scan(CLWrapper &clw, TuningProfile &profile, const autotune_options &opt) {
+  std::string device = tuning_device(clw);
+  std::string kind = tuning_kind<T,Op>("scan");
+  int min_bucket = tuning_bucket(opt.min_n);
+  int max_bucket = tuning_bucket(opt.max_n);
+  int max_n = bucket_length(max_bucket);
+  size_t max_wx = max_workgroup_size(clw);
+  cl_ulong local_mem = local_mem_size(clw);
+
+  // the contents do not matter for timing; the scans are done inplace
+  cl_mem d_data = clw.dev_malloc(sizeof(T)*max_n);
+  std::vector<T> zeros(max_n, (T) 0);
+  clw.memcpy_to_dev(d_data, sizeof(T)*max_n, &zeros[0]);
+
+  for (int w=0; w<nworkgroup_sizes; w++) {
+    size_t wx = workgroup_sizes[w];
+    for (int i=0; i<nitems_per_workitem; i++) {
+      int items = items_per_workitem[i];
+      // subarray plus per-workitem totals (see BasicScan::local_bufsize)
+      if (wx > max_wx || sizeof(T)*wx*(items+1) > local_mem) {
+        continue;
+      }
+      BasicScan<T,Op> s(clw, wx, /*capacity_hint=*/max_n, ScanBase::RECURSIVE, items);
+      for (int bucket=min_bucket; bucket<=max_bucket; bucket++) {
+        int n = bucket_length(bucket);
+        for (int alg=ScanBase::RECURSIVE; alg<=ScanBase::LOOKBACK; alg++) {
+          s.set_algorithm(ScanBase::to_algorithm(alg));
+          s.scan(d_data, n);
+          s.reset_timers();
+          for (int run=0; run<opt.num_iter; run++) {
+            s.scan(d_data, n);
+          }
+          map<string,float> timings;
+          s.get_timers(timings);
+          tuning t;
+          t.wx = wx;
+          t.items = items;
+          t.alg = alg;
+          t.ms = scan_time(timings, opt.num_iter);
+          if (opt.verbose) {
+            printf("# %s n=%d wx=%d items=%d alg=%d %.4f ms\n",
+              kind.c_str(), n, (int) wx, items, alg, t.ms);
+          }
+          profile.record(device, kind, bucket, t);
+        }
+      }
+    }
+  }
+  clw.dev_free(d_data);
+}
+
+/*
+ * Every 16th element starts a segment.
+ */
+template <typename T, class Op>
+void autotune_segscan(CLWrapper &clw, TuningProfile &profile, const autotune_options &opt) {
+  std::string device = tuning_device(clw);
+  std::string kind = tuning_kind<T,Op>("segscan");
+  int min_bucket = tuning_bucket(opt.min_n);
+  int max_bucket = tuning_bucket(opt.max_n);
+  int max_n = bucket_length(max_bucket);
+  size_t max_wx = max_workgroup_size(clw);
+  cl_ulong local_mem = local_mem_size(clw);
+
+  cl_mem d_data = clw.dev_malloc(sizeof(T)*max_n);
+  cl_mem d_flag = clw.dev_malloc(sizeof(int)*max_n);
+  std::vector<T> zeros(max_n, (T) 0);
+  std::vector<int> flag(max_n, 0);
+  for (int i=0; i<max_n; i+=16) {
+    flag[i] = 1;
+  }
+  clw.memcpy_to_dev(d_data, sizeof(T)*max_n, &zeros[0]);
+  clw.memcpy_to_dev(d_flag, sizeof(int)*max_n, &flag[0]);
+
+  for (int w=0; w<nworkgroup_sizes; w++) {
+    size_t wx = workgroup_sizes[w];
+    if (wx > max_wx || segscan_local_bytes(sizeof(T), wx) > local_mem) {
+      continue;
+    }
+    BasicSegmentedScan<T,Op> ss(clw, wx, /*capacity_hint=*/max_n);
+    for (int bucket=min_bucket; bucket<=max_bucket; bucket++) {
+      int n = bucket_length(bucket);
+      ss.scan(d_data, d_flag, n);
+      ss.reset_timers();
+      for (int run=0; run<opt.num_iter; run++) {
+        ss.scan(d_data, d_flag, n);
+      }
+      map<string,float> timings;
+      ss.get_timers(timings);
+      tuning t;
+      t.wx = wx;
+      t.items = 2;
+      t.alg = 0;
+      t.ms = scan_time(timings, opt.num_iter);
+      if (opt.verbose) {
+        printf("# %s n=%d wx=%d %.4f ms\n", kind.c_str(), n, (int) wx, t.ms);
+      }
+      profile.record(device, kind, bucket, t);
+    }
+  }
+  clw.dev_free(d_data);
+  clw.dev_free(d_flag);
+}
+
+template void autotune_scan<int,     Add<int> >(CLWrapper &, TuningProfile &, const autotune_options &);
+template void autotune_scan<int64_t, Add<int64_t> >(CLWrapper &, TuningProfile &, const autotune_options &);
+template void autotune_scan<float,   Add<float> >(CLWrapper &, TuningProfile &, const autotune_options &);
+template void autotune_scan<double,  Add<double> >(CLWrapper &, TuningProfile &, const autotune_options &);
+template void autotune_segscan<int,     Add<int> >(CLWrapper &, TuningProfile &, const autotune_options &);
+template void autotune_segscan<int64_t, Add<int64_t> >(CLWrapper &, TuningProfile &, const autotune_options &);
@@ -0,0 +1,31 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "clwrapper.h"
+#include "scanop.h"
+#include "tuning.h"
+
+struct autotune_options {
+  int min_n;     // smallest array length to tune
+  int max_n;     // largest array length to tune
+  int num_iter;  // timed scans per configuration and length
+  bool verbose;  // print each measurement
+};
+
+/*
+ * Sweep the workgroup size, elements per workitem and algorithm of BasicScan<T,Op>
+ *   over one array length per size bucket from [min_n] to [max_n] on the device of [clw],
+ *   and record the fastest configuration of each bucket in [profile].
+ * Candidates that exceed the device's workgroup or local memory limits are skipped.
+ * Times are summed from the kernel timers, so [clw] must have profiling enabled.
+ */
+template <typename T, class Op>
+void autotune_scan(CLWrapper &clw, TuningProfile &profile, const autotune_options &opt);
+
+/*
+ * As above for the workgroup size of BasicSegmentedScan<T,Op>.
+ */
+template <typename T, class Op>
+void autotune_segscan(CLWrapper &clw, TuningProfile &profile, const autotune_options &opt);
+
+#endif
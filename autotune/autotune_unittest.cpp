@@ -0,0 +1,145 @@
+#include "clwrapper.h"
+#include "autotune.h"
+#include "programcache.h"
+#include "scan.h"
+#include "scanref.h"
+#include "segscan.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#include <cstdlib>
+#include <unistd.h>
+
+static const char *profile_path = "autotune_unittest.profile";
+
+tuning make_tuning(size_t wx, int items, int alg, float ms) {
+  tuning t;
+  t.wx = wx;
+  t.items = items;
+  t.alg = alg;
+  t.ms = ms;
+  return t;
+}
+
+TEST(ProfileRoundTrip) {
+  unlink(profile_path);
+  TuningProfile p(profile_path);
+  CHECK(p.empty());
+  p.record("dev", "scan int 0", 10, make_tuning(128, 4, 1, 2.0f));
+  p.record("dev", "scan int 0", 10, make_tuning(256, 2, 0, 3.0f)); // slower, ignored
+  p.record("dev", "scan int 0", 12, make_tuning(64, 8, 0, 5.0f));
+  p.record("other", "scan int 0", 10, make_tuning(32, 2, 0, 1.0f));
+  CHECK(p.save());
+
+  TuningProfile q(profile_path);
+  tuning t;
+  CHECK(q.lookup("dev", "scan int 0", 1500, t));
+  CHECK_EQUAL(128, (int) t.wx);
+  CHECK_EQUAL(4, t.items);
+  CHECK_EQUAL(1, t.alg);
+  CHECK(!q.lookup("dev", "scan int 0", 3000, t));
+  CHECK(!q.lookup("dev", "scan long 0", 1500, t));
+  // 0 means the largest tuned length
+  CHECK(q.lookup("dev", "scan int 0", 0, t));
+  CHECK_EQUAL(64, (int) t.wx);
+
+  q.forget("dev");
+  CHECK(!q.lookup("dev", "scan int 0", 1500, t));
+  CHECK(q.lookup("other", "scan int 0", 1500, t));
+  unlink(profile_path);
+}
+
+TEST(UntunedDefaults) {
+  unlink(profile_path);
+  setenv("SCAN_TUNING_PROFILE", profile_path, 1);
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan s(clw, /*wx=*/0, /*capacity_hint=*/1000);
+  CHECK_EQUAL(256, (int) s.workgroup_size());
+  CHECK_EQUAL(2, s.items_per_workitem());
+  SegmentedScan ss(clw, /*wx=*/0, /*capacity_hint=*/1000);
+  CHECK_EQUAL(256, (int) ss.workgroup_size());
+  unsetenv("SCAN_TUNING_PROFILE");
+}
+
+/*
+ * An algorithm the scan does not know (eg, from a newer profile) falls back to the default.
+ */
+TEST(UnknownTunedAlgorithm) {
+  unlink(profile_path);
+  setenv("SCAN_TUNING_PROFILE", profile_path, 1);
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  int n = 1000;
+  TuningProfile profile(profile_path);
+  profile.record(tuning_device(clw), tuning_kind<int, Add<int> >("scan"), tuning_bucket(n),
+                 make_tuning(128, 2, /*alg=*/7, 1.0f));
+  CHECK(profile.save());
+  CHECK_EQUAL(ScanBase::LOOKBACK, ScanBase::to_algorithm(1));
+  CHECK_EQUAL(ScanBase::RECURSIVE, ScanBase::to_algorithm(7));
+
+  Scan s(clw, /*wx=*/0, /*capacity_hint=*/n);
+  CHECK_EQUAL(128, (int) s.workgroup_size());
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  s.scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+  unsetenv("SCAN_TUNING_PROFILE");
+  unlink(profile_path);
+}
+
+/*
+ * Tune a small range, then check that wx=0 picks the tuned configuration and still scans.
+ */
+TEST(TunedScan) {
+  unlink(profile_path);
+  setenv("SCAN_TUNING_PROFILE", profile_path, 1);
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  autotune_options opt;
+  opt.min_n = 1000;
+  opt.max_n = 5000;
+  opt.num_iter = 1;
+  opt.verbose = false;
+  TuningProfile profile(profile_path);
+  autotune_scan<int, Add<int> >(clw, profile, opt);
+  autotune_segscan<int, Add<int> >(clw, profile, opt);
+  CHECK(profile.save());
+
+  int n = 3000;
+  tuning t;
+  CHECK(find_tuning(clw, tuning_kind<int, Add<int> >("scan"), n, t));
+  Scan s(clw, /*wx=*/0, /*capacity_hint=*/n);
+  CHECK_EQUAL((int) t.wx, (int) s.workgroup_size());
+  CHECK_EQUAL(t.items, s.items_per_workitem());
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  s.scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+
+  CHECK(find_tuning(clw, tuning_kind<int, Add<int> >("segscan"), n, t));
+  SegmentedScan ss(clw, /*wx=*/0, /*capacity_hint=*/n);
+  CHECK_EQUAL((int) t.wx, (int) ss.workgroup_size());
+  int *flag = new int[n];
+  fill_random_data(x, n, n);
+  fill_random_data(flag, n, 2);
+  flag[0] = 1;
+  segmented_exclusive_scan_host(result, x, flag, n);
+  ss.scan(x, flag, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+
+  delete[] x;
+  delete[] result;
+  delete[] flag;
+  unsetenv("SCAN_TUNING_PROFILE");
+  unlink(profile_path);
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
@@ -0,0 +1,88 @@
+#include "clwrapper.h"
+#include "autotune.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+void print_usage(string progname) {
+  printf("Usage: %s [options]\n", progname.c_str());
+  printf("Tune Scan and SegmentedScan on the current device and save the tuning profile.\n");
+  printf("Options:\n");
+  printf("   -v         be verbose\n");
+  printf("   -n arg     smallest array length (default: 1024)\n");
+  printf("   -N arg     largest array length (default: 16777216)\n");
+  printf("   -r arg     number of runs per configuration (default: 10)\n");
+  printf("   -o arg     profile file (default: $SCAN_TUNING_PROFILE or ~/.cache/scan-tuning)\n");
+}
+
+int main(int argc, char **argv) {
+  string progname(argv[0]);
+  string path = tuning_profile_path();
+  autotune_options opt;
+  opt.min_n = 1024;
+  opt.max_n = 1 << 24;
+  opt.num_iter = 10;
+  opt.verbose = false;
+
+  int c;
+  while ((c = getopt (argc, argv, "hvn:N:r:o:")) != -1) {
+    switch (c) {
+      case 'h':
+        print_usage(progname);
+        return 1;
+      case 'v':
+        opt.verbose = true;
+        break;
+      case 'n':
+        opt.min_n = atoi(optarg);
+        break;
+      case 'N':
+        opt.max_n = atoi(optarg);
+        break;
+      case 'r':
+        opt.num_iter = atoi(optarg);
+        break;
+      case 'o':
+        path = optarg;
+        break;
+      case '?':
+        if (optopt == 'n' || optopt == 'N' || optopt == 'r' || optopt == 'o')
+          fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint (optopt))
+          fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf (stderr,
+              "Unknown option character `\\x%x'.\n",
+              optopt);
+        return 1;
+      default:
+        abort ();
+    }
+  }
+  if (opt.min_n < 1 || opt.max_n < opt.min_n || opt.max_n > (1 << 29) || opt.num_iter < 1) {
+    print_usage(progname);
+    return 1;
+  }
+
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  if (opt.verbose) {
+    cout << clinfo();
+  }
+  // new measurements replace the old ones of this device; other devices are kept
+  TuningProfile profile(path);
+  profile.forget(tuning_device(clw));
+  autotune_scan<int,     Add<int> >(clw, profile, opt);
+  autotune_scan<int64_t, Add<int64_t> >(clw, profile, opt);
+  autotune_scan<float,   Add<float> >(clw, profile, opt);
+  autotune_segscan<int,  Add<int> >(clw, profile, opt);
+  if (!profile.save()) {
+    fprintf(stderr, "Could not write `%s'.\n", path.c_str());
+    return 1;
+  }
+  printf("# Tuning profile for %s written to %s\n", tuning_device(clw).c_str(), path.c_str());
+  return 0;
+}
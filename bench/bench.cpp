@@ -0,0 +1,119 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+/*
+ * Percentiles are the nearest rank, so the p95 of fewer than 20 trials is the slowest.
+ */
+bench_stats summarize(vector<double> ms) {
+  bench_stats s;
+  s.trials = (int) ms.size();
+  if (ms.empty()) {
+    s.median = s.p95 = s.min = s.mean = s.stddev = 0;
+    return s;
+  }
+  sort(ms.begin(), ms.end());
+  int n = s.trials;
+  s.median = (n & 1) ? ms[n/2] : (ms[n/2-1] + ms[n/2]) / 2;
+  s.p95 = ms[(int) ceil(0.95 * n) - 1];
+  s.min = ms[0];
+  double sum = 0;
+  for (int i=0; i<n; i++) {
+    sum += ms[i];
+  }
+  s.mean = sum / n;
+  double var = 0;
+  for (int i=0; i<n; i++) {
+    var += (ms[i] - s.mean) * (ms[i] - s.mean);
+  }
+  s.stddev = (n > 1) ? sqrt(var / (n-1)) : 0;
+  return s;
+}
+
+vector<int> bench_sizes(int min_n, int max_n) {
+  vector<int> sizes;
+  for (long long p=1; p<=max_n; p*=2) {
+    if (p >= min_n) {
+      sizes.push_back((int) p);
+    }
+    long long odd = (p + p/2) | 1;
+    if (p > 1 && odd >= min_n && odd <= max_n) {
+      sizes.push_back((int) odd);
+    }
+  }
+  return sizes;
+}
+
+string results_table(const vector<bench_result> &results) {
+  stringstream ss;
+  ss << left << fixed << setprecision(4);
+  ss << setw(15) << "# ENGINE" << setw(11) << "N"
+     << setw(13) << "MEDIAN (ms)" << setw(13) << "P95 (ms)" << setw(13) << "STDDEV (ms)"
+     << setw(13) << "Melem/s" << setw(11) << "GB/s" << "CHECK" << endl;
+  for (size_t i=0; i<results.size(); i++) {
+    const bench_result &r = results[i];
+    ss << setw(15) << r.engine << setw(11) << r.n
+       << setw(13) << r.stats.median << setw(13) << r.stats.p95 << setw(13) << r.stats.stddev
+       << setw(13) << r.elements_per_s() * 1.0e-6 << setw(11) << r.gbytes_per_s()
+       << (r.pass ? "ok" : "FAILED") << endl;
+  }
+  return ss.str();
+}
+
+string results_csv(const vector<bench_result> &results) {
+  stringstream ss;
+  ss << setprecision(6);
+  ss << "engine,n,trials,median_ms,p95_ms,min_ms,mean_ms,stddev_ms,elements_per_s,gbytes_per_s,pass" << endl;
+  for (size_t i=0; i<results.size(); i++) {
+    const bench_result &r = results[i];
+    ss << r.engine << "," << r.n << "," << r.stats.trials << ","
+       << r.stats.median << "," << r.stats.p95 << "," << r.stats.min << ","
+       << r.stats.mean << "," << r.stats.stddev << ","
+       << r.elements_per_s() << "," << r.gbytes_per_s() << ","
+       << (r.pass ? 1 : 0) << endl;
+  }
+  return ss.str();
+}
+
+static string json_string(const string &s) {
+  stringstream ss;
+  ss << "\"";
+  for (size_t i=0; i<s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      ss << '\\' << c;
+    } else if (c < 0x20) {
+      ss << "\\u" << hex << setw(4) << setfill('0') << (int) c << dec << setfill(' ');
+    } else {
+      ss << c;
+    }
+  }
+  ss << "\"";
+  return ss.str();
+}
+
+string results_json(const vector<bench_result> &results, const string &device) {
+  stringstream ss;
+  ss << setprecision(6);
+  ss << "{" << endl;
+  ss << "  \"device\": " << json_string(device) << "," << endl;
+  ss << "  \"results\": [" << endl;
+  for (size_t i=0; i<results.size(); i++) {
+    const bench_result &r = results[i];
+    ss << "    {\"engine\": " << json_string(r.engine) << ", \"n\": " << r.n
+       << ", \"trials\": " << r.stats.trials
+       << ", \"median_ms\": " << r.stats.median << ", \"p95_ms\": " << r.stats.p95
+       << ", \"min_ms\": " << r.stats.min << ", \"mean_ms\": " << r.stats.mean
+       << ", \"stddev_ms\": " << r.stats.stddev
+       << ", \"elements_per_s\": " << r.elements_per_s()
+       << ", \"gbytes_per_s\": " << r.gbytes_per_s()
+       << ", \"pass\": " << (r.pass ? "true" : "false") << "}"
+       << (i+1 < results.size() ? "," : "") << endl;
+  }
+  ss << "  ]" << endl;
+  ss << "}" << endl;
+  return ss.str();
+}
@@ -0,0 +1,48 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Statistics over the times (ms) of repeated trials.
+ */
+struct bench_stats {
+  int trials;
+  double median;
+  double p95;
+  double min;
+  double mean;
+  double stddev;
+};
+
+bench_stats summarize(vector<double> ms);
+
+/*
+ * One engine at one size.
+ * [bytes] is the minimum traffic of one scan (eg, 2*n*sizeof(int) to read and write [n] ints)
+ *   so bytes/median is the effective bandwidth.
+ */
+struct bench_result {
+  string engine;
+  int n;
+  double bytes;
+  bench_stats stats;
+  bool pass;   // the output of the first trial matched the reference
+
+  double elements_per_s() const { return stats.median > 0 ? n / (stats.median * 1.0e-3) : 0; }
+  double gbytes_per_s() const { return stats.median > 0 ? bytes / (stats.median * 1.0e-3) * 1.0e-9 : 0; }
+};
+
+/*
+ * Sizes from [min_n] to [max_n]: each power of two and an odd size halfway to the next.
+ */
+vector<int> bench_sizes(int min_n, int max_n);
+
+string results_table(const vector<bench_result> &results);
+string results_csv(const vector<bench_result> &results);
+string results_json(const vector<bench_result> &results, const string &device);
+
+#endif
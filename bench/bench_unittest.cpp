@@ -0,0 +1,87 @@
+#include "bench.h"
+
+#include "UnitTest++.h"
+
+TEST(Summarize) {
+  vector<double> ms;
+  for (int i=20; i>=1; i--) {
+    ms.push_back(i);
+  }
+  bench_stats s = summarize(ms);
+  CHECK_EQUAL(20, s.trials);
+  CHECK_CLOSE(10.5, s.median, 1e-9);
+  CHECK_CLOSE(19.0, s.p95, 1e-9);
+  CHECK_CLOSE(1.0, s.min, 1e-9);
+  CHECK_CLOSE(10.5, s.mean, 1e-9);
+  CHECK_CLOSE(5.9160797831, s.stddev, 1e-6);
+}
+
+TEST(Summarize_Odd) {
+  vector<double> ms;
+  ms.push_back(3);
+  ms.push_back(1);
+  ms.push_back(2);
+  bench_stats s = summarize(ms);
+  CHECK_CLOSE(2.0, s.median, 1e-9);
+  CHECK_CLOSE(3.0, s.p95, 1e-9);
+}
+
+TEST(Sizes) {
+  vector<int> sizes = bench_sizes(1000, 5000);
+  const int expected[] = { 1024, 1537, 2048, 3073, 4096 };
+  CHECK_EQUAL(5, (int) sizes.size());
+  CHECK_ARRAY_EQUAL(expected, &sizes[0], 5);
+}
+
+TEST(Sizes_Small) {
+  // no size is repeated
+  vector<int> sizes = bench_sizes(1, 16);
+  const int expected[] = { 1, 2, 3, 4, 7, 8, 13, 16 };
+  CHECK_EQUAL(8, (int) sizes.size());
+  CHECK_ARRAY_EQUAL(expected, &sizes[0], 8);
+}
+
+TEST(Rates) {
+  bench_result r;
+  r.engine = "harris";
+  r.n = 1000000;
+  r.bytes = 8.0e6;
+  r.stats.median = 2.0;
+  r.pass = true;
+  CHECK_CLOSE(5.0e8, r.elements_per_s(), 1.0);
+  CHECK_CLOSE(4.0, r.gbytes_per_s(), 1e-9);
+}
+
+TEST(Csv) {
+  vector<bench_result> results(1);
+  vector<double> ms(1, 2.0);
+  results[0].engine = "simd";
+  results[0].n = 1000;
+  results[0].bytes = 8000;
+  results[0].stats = summarize(ms);
+  results[0].pass = true;
+  string csv = results_csv(results);
+  CHECK_EQUAL(0u, csv.find("engine,n,trials,median_ms,"));
+  CHECK(csv.find("\nsimd,1000,1,2,2,2,2,0,500000,0.004,1\n") != string::npos);
+}
+
+TEST(Json) {
+  vector<bench_result> results(2);
+  vector<double> ms(1, 1.0);
+  for (int i=0; i<2; i++) {
+    results[i].engine = "harris";
+    results[i].n = 1024 << i;
+    results[i].bytes = 8.0 * results[i].n;
+    results[i].stats = summarize(ms);
+    results[i].pass = (i == 0);
+  }
+  string json = results_json(results, "dev \"x\"");
+  CHECK(json.find("\"device\": \"dev \\\"x\\\"\"") != string::npos);
+  CHECK(json.find("{\"engine\": \"harris\", \"n\": 1024,") != string::npos);
+  CHECK(json.find("\"pass\": true},\n") != string::npos);
+  CHECK(json.find("\"pass\": false}\n  ]\n}\n") != string::npos);
+}
+
+int main() {
+  return UnitTest::RunAllTests();
+}
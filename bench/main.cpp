@@ -0,0 +1,336 @@
+#include "clwrapper.h"
+#include "bench.h"
+#include "parscan.h"
+#include "scan.h"
+#include "scanref.h"
+#include "segscan.h"
+#include "seq_scan.h"
+#include "simdscan.h"
+#include "tuning.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct bench_options {
+  int min_n;
+  int max_n;
+  int trials;
+  int warmup;
+  int wx;
+  int nthreads;
+  string format;
+  string output;
+  string engines;
+  bool verbose;
+};
+
+/*
+ * An engine scans [x] of length [n] inplace (segmented engines also take head [flag]s).
+ * prepare and finish are not timed; device engines use them to move the data.
+ */
+class Engine {
+  public:
+    virtual ~Engine() {}
+    virtual bool segmented() { return false; }
+    virtual void prepare(int * /*x*/, int * /*flag*/, int /*n*/) {}
+    virtual void scan(int *x, int *flag, int n) = 0;
+    virtual void finish(int * /*x*/, int /*n*/) {}
+};
+
+class SequentialEngine : public Engine {
+  private:
+    int m;
+  public:
+    SequentialEngine(int m) : m(m) {}
+    void scan(int *x, int *, int n) { recursive_scan_arb(x, n, m, 0); }
+};
+
+class SimdEngine : public Engine {
+  public:
+    void scan(int *x, int *, int n) { exclusive_scan_simd(x, x, n); }
+};
+
+class ParallelEngine : public Engine {
+  private:
+    ParallelScan s;
+  public:
+    ParallelEngine(int nthreads) : s(nthreads) {}
+    void scan(int *x, int *, int n) { s.scan(x, n); }
+};
+
+/*
+ * Host arrays, so the time includes the copies to and from the device.
+ */
+class HarrisEngine : public Engine {
+  private:
+    Scan s;
+  public:
+    HarrisEngine(CLWrapper &clw, int wx, int max_n) : s(clw, wx, /*capacity_hint=*/max_n) {}
+    void scan(int *x, int *, int n) { s.scan(x, n); }
+};
+
+/*
+ * Data already on the device, so the time is the scan alone.
+ */
+class HarrisDeviceEngine : public Engine {
+  private:
+    CLWrapper &clw;
+    Scan s;
+    cl_mem d_x;
+  public:
+    HarrisDeviceEngine(CLWrapper &clw, int wx, int max_n) : clw(clw), s(clw, wx, /*capacity_hint=*/max_n) {
+      d_x = clw.dev_malloc(sizeof(int)*max_n);
+    }
+    ~HarrisDeviceEngine() { clw.dev_free(d_x); }
+    void prepare(int *x, int *, int n) { clw.memcpy_to_dev(d_x, sizeof(int)*n, x); }
+    void scan(int *, int *, int n) { s.scan(d_x, n); }
+    void finish(int *x, int n) { clw.memcpy_from_dev(d_x, sizeof(int)*n, x); }
+};
+
+class SenguptaEngine : public Engine {
+  private:
+    SegmentedScan s;
+  public:
+    SenguptaEngine(CLWrapper &clw, int wx, int max_n) : s(clw, wx, /*capacity_hint=*/max_n) {}
+    bool segmented() { return true; }
+    void scan(int *x, int *flag, int n) { s.scan(x, flag, n); }
+};
+
+static const char *engine_names[] = {
+  "sequential", "simd", "parallel_cpu", "harris", "harris_device", "sengupta"
+};
+static const int nengines = sizeof(engine_names) / sizeof(engine_names[0]);
+
+static bool is_opencl(const string &name) {
+  return name == "harris" || name == "harris_device" || name == "sengupta";
+}
+
+static Engine *make_engine(const string &name, CLWrapper *clw, bench_options &opt) {
+  if (name == "sequential")    return new SequentialEngine(opt.wx > 0 ? opt.wx : 256);
+  if (name == "simd")          return new SimdEngine();
+  if (name == "parallel_cpu")  return new ParallelEngine(opt.nthreads);
+  if (name == "harris")        return new HarrisEngine(*clw, opt.wx, opt.max_n);
+  if (name == "harris_device") return new HarrisDeviceEngine(*clw, opt.wx, opt.max_n);
+  if (name == "sengupta")      return new SenguptaEngine(*clw, opt.wx, opt.max_n);
+  return NULL;
+}
+
+/*
+ * A monotonic clock with ns resolution; small host scans take only microseconds.
+ */
+static double elapsed_ms(struct timespec &start, struct timespec &end) {
+  return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1.0e6;
+}
+
+/*
+ * [opt.warmup] untimed scans, then [opt.trials] timed scans of a fresh copy of [data].
+ */
+static bench_result run_engine(const string &name, Engine *e, int *data, int *flag, int *expected,
+                               int n, bench_options &opt) {
+  int *x = new int[n];
+  vector<double> ms;
+  bench_result r;
+  r.engine = name;
+  r.n = n;
+  r.bytes = (e->segmented() ? 3.0 : 2.0) * sizeof(int) * n;
+  r.pass = true;
+  for (int run=0; run<opt.warmup + opt.trials; run++) {
+    memcpy(x, data, sizeof(int)*n);
+    e->prepare(x, flag, n);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    e->scan(x, flag, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    e->finish(x, n);
+    if (run == 0) {
+      r.pass = (memcmp(x, expected, sizeof(int)*n) == 0);
+    }
+    if (run >= opt.warmup) {
+      ms.push_back(elapsed_ms(start, end));
+    }
+  }
+  r.stats = summarize(ms);
+  delete[] x;
+  return r;
+}
+
+void print_usage(string progname) {
+  printf("Usage: %s [options]\n", progname.c_str());
+  printf("Benchmark the scan engines over a sweep of array sizes.\n");
+  printf("Options:\n");
+  printf("   -v         be verbose\n");
+  printf("   -n arg     smallest array length (default: 1024)\n");
+  printf("   -N arg     largest array length (default: 16777216)\n");
+  printf("   -r arg     number of timed trials (default: 20)\n");
+  printf("   -W arg     number of warm-up runs (default: 3)\n");
+  printf("   -e arg     comma-separated engines (default: all)\n");
+  printf("              sequential,simd,parallel_cpu,harris,harris_device,sengupta\n");
+  printf("   -w arg     size of workgroup for OpenCL engines (0: tuned, see autotune)\n");
+  printf("   -t arg     number of threads for parallel_cpu (default: all cores)\n");
+  printf("   -f arg     output format: table, csv or json (default: table)\n");
+  printf("   -o arg     write the output to a file instead of stdout\n");
+  printf("   -s seed    set seed for generating input data\n");
+}
+
+int main(int argc, char **argv) {
+  string progname(argv[0]);
+  bench_options opt;
+  opt.min_n = 1024;
+  opt.max_n = 1 << 24;
+  opt.trials = 20;
+  opt.warmup = 3;
+  opt.wx = 256;
+  opt.nthreads = 0;
+  opt.format = "table";
+  opt.engines = "";
+  opt.verbose = false;
+
+  int c;
+  while ((c = getopt (argc, argv, "hvn:N:r:W:e:w:t:f:o:s:")) != -1) {
+    switch (c) {
+      case 'h':
+        print_usage(progname);
+        return 1;
+      case 'v':
+        opt.verbose = true;
+        break;
+      case 'n':
+        opt.min_n = atoi(optarg);
+        break;
+      case 'N':
+        opt.max_n = atoi(optarg);
+        break;
+      case 'r':
+        opt.trials = atoi(optarg);
+        break;
+      case 'W':
+        opt.warmup = atoi(optarg);
+        break;
+      case 'e':
+        opt.engines = optarg;
+        break;
+      case 'w':
+        opt.wx = atoi(optarg);
+        break;
+      case 't':
+        opt.nthreads = atoi(optarg);
+        break;
+      case 'f':
+        opt.format = optarg;
+        break;
+      case 'o':
+        opt.output = optarg;
+        break;
+      case 's':
+        srandom(atol(optarg));
+        break;
+      case '?':
+        if (isprint (optopt))
+          fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+        else
+          fprintf (stderr,
+              "Unknown option character `\\x%x'.\n",
+              optopt);
+        return 1;
+      default:
+        abort ();
+    }
+  }
+  if (opt.min_n < 1 || opt.max_n < opt.min_n || opt.trials < 1 || opt.warmup < 0 ||
+      (opt.format != "table" && opt.format != "csv" && opt.format != "json")) {
+    print_usage(progname);
+    return 1;
+  }
+
+  vector<string> engines;
+  if (opt.engines.empty()) {
+    engines.assign(engine_names, engine_names + nengines);
+  } else {
+    stringstream ss(opt.engines);
+    string name;
+    while (getline(ss, name, ',')) {
+      engines.push_back(name);
+    }
+  }
+  CLWrapper *clw = NULL;
+  for (size_t i=0; i<engines.size(); i++) {
+    if (find(engine_names, engine_names + nengines, engines[i]) == engine_names + nengines) {
+      fprintf(stderr, "Unknown engine `%s'.\n", engines[i].c_str());
+      return 1;
+    }
+    if (is_opencl(engines[i]) && !clw) {
+      clw = new CLWrapper(/*platform=*/0,/*device=*/0,/*profiling=*/false);
+    }
+  }
+  string device = clw ? tuning_device(*clw) : string("host");
+
+  // the same input for every engine at each size
+  vector<int> sizes = bench_sizes(opt.min_n, opt.max_n);
+  int *data = new int[opt.max_n];
+  int *flag = new int[opt.max_n];
+  int *expected = new int[opt.max_n];
+  int *expected_segmented = new int[opt.max_n];
+  fill_random_data(data, opt.max_n, 256);
+  fill_random_data(flag, opt.max_n, 2);
+  flag[0] = 1;
+
+  vector<bench_result> results;
+  for (size_t i=0; i<engines.size(); i++) {
+    Engine *e = make_engine(engines[i], clw, opt);
+    for (size_t j=0; j<sizes.size(); j++) {
+      int n = sizes[j];
+      if (e->segmented()) {
+        segmented_exclusive_scan_host(expected_segmented, data, flag, n);
+      } else {
+        exclusive_scan_host(expected, data, n);
+      }
+      bench_result r = run_engine(engines[i], e, data, flag,
+        e->segmented() ? expected_segmented : expected, n, opt);
+      if (opt.verbose) {
+        fprintf(stderr, "# %s n=%d median=%.3f ms%s\n",
+          r.engine.c_str(), n, r.stats.median, r.pass ? "" : " ***TEST FAILED***");
+      }
+      results.push_back(r);
+    }
+    delete e;
+  }
+
+  string out;
+  if (opt.format == "csv") {
+    out = results_csv(results);
+  } else if (opt.format == "json") {
+    out = results_json(results, device);
+  } else {
+    out = "# DEVICE: " + device + "\n" + results_table(results);
+  }
+  if (opt.output.empty()) {
+    cout << out;
+  } else {
+    ofstream file(opt.output.c_str());
+    file << out;
+    if (!file) {
+      fprintf(stderr, "Could not write `%s'.\n", opt.output.c_str());
+      return 1;
+    }
+  }
+
+  bool pass = true;
+  for (size_t i=0; i<results.size(); i++) {
+    pass = pass && results[i].pass;
+  }
+  delete[] data;
+  delete[] flag;
+  delete[] expected;
+  delete[] expected_segmented;
+  delete clw;
+  return pass ? 0 : 2;
+}
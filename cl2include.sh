@@ -8,9 +8,36 @@ fi
 input=$1
 output=$2
 
+# inline each '#include "file"' line of $input (file is looked up next to $input, then in ../common)
+# since the embedded program is built from a string without an include path
+expand() {
+  local dir=$(dirname $1) line inc
+  while IFS= read -r line; do
+    if [[ "$line" =~ ^#include\ \"([^\"]+)\" ]]; then
+      inc=${BASH_REMATCH[1]}
+      if [ -f "$dir/$inc" ]; then
+        expand "$dir/$inc"
+      elif [ -f "$dir/../common/$inc" ]; then
+        expand "$dir/../common/$inc"
+      else
+        echo "$0: cannot find $inc (included from $1)" >&2
+        exit 1
+      fi
+    else
+      printf '%s\n' "$line"
+    fi
+  done < $1
+}
+
+# expand into a file of the same (relative) name so that xxd names the array as before
+tmp=$(mktemp -d)
+trap "rm -rf $tmp" EXIT
+mkdir -p $tmp/$(dirname $input)
+expand $input > $tmp/$input || exit 1
+
 # convert $input into a character array
 # use sed to replace the last newline char with nul
 # use awk to insert a nice header
 # finally, use sed again to comment-out the last line (containing the length of the array)
 header="// autogenerated by $0 from <$input>"
-xxd -i ${input} | sed 's/0x0a$/0x00/g' | awk "NR==1{print \"$header\"}1" | sed '$s/^/\/\/ /' > $output
+(cd $tmp; xxd -i ${input}) | sed 's/0x0a$/0x00/g' | awk "NR==1{print \"$header\"}1" | sed '$s/^/\/\/ /' > $output
@@ -0,0 +1,64 @@
+#include "bufferpool.h"
+
+size_t BufferPool::bucket(size_t nbytes) {
+  size_t size = 256;
+  while (size < nbytes) {
+    size <<= 1;
+  }
+  return size;
+}
+
+cl_mem BufferPool::acquire(size_t nbytes) {
+  size_t size = bucket(nbytes);
+  pthread_mutex_lock(&lock);
+  std::vector<cl_mem> &idle = free_buffers[size];
+  cl_mem buffer;
+  if (!idle.empty()) {
+    buffer = idle.back();
+    idle.pop_back();
+  } else {
+    buffer = clw.dev_malloc(size);
+    bucket_of[buffer] = size;
+    allocated += size;
+  }
+  pthread_mutex_unlock(&lock);
+  return buffer;
+}
+
+void BufferPool::release(cl_mem buffer) {
+  pthread_mutex_lock(&lock);
+  std::map<cl_mem, size_t>::iterator i = bucket_of.find(buffer);
+  assert(i != bucket_of.end());
+  free_buffers[i->second].push_back(buffer);
+  pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Free every idle buffer. Buffers currently acquired are unaffected.
+ */
+void BufferPool::trim() {
+  pthread_mutex_lock(&lock);
+  std::map<size_t, std::vector<cl_mem> >::iterator i;
+  for (i = free_buffers.begin(); i != free_buffers.end(); i++) {
+    for (size_t j=0; j<i->second.size(); j++) {
+      cl_mem buffer = i->second[j];
+      clw.dev_free(buffer);
+      bucket_of.erase(buffer);
+      allocated -= i->first;
+    }
+  }
+  free_buffers.clear();
+  pthread_mutex_unlock(&lock);
+}
+
+BufferPool::BufferPool(CLWrapper &clw) : clw(clw), allocated(0) {
+  pthread_mutex_init(&lock, NULL);
+}
+
+BufferPool::~BufferPool() {
+  std::map<cl_mem, size_t>::iterator i;
+  for (i = bucket_of.begin(); i != bucket_of.end(); i++) {
+    clw.dev_free(i->first);
+  }
+  pthread_mutex_destroy(&lock);
+}
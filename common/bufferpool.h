@@ -0,0 +1,43 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "clwrapper.h"
+
+#include <map>
+#include <pthread.h>
+#include <vector>
+
+/*
+ * Reusable device buffers.
+ *
+ * Requests are rounded up to a power-of-two bucket and served from a free list
+ * for that bucket, so repeated scans of similar sizes stop calling dev_malloc.
+ * Buffers returned to the pool are kept until trim() or destruction.
+ * NB: a buffer may be handed out again while earlier kernels that used it are
+ *     still queued; this is safe because all work goes to the same in-order queue.
+ *     A pool shared by scans on several queues (see service/) is only safe if
+ *     buffers are released once the commands that use them are complete.
+ * The pool may be shared between threads.
+ */
+class BufferPool {
+  private:
+    CLWrapper &clw;
+    std::map<size_t, std::vector<cl_mem> > free_buffers; // bucket size -> idle buffers
+    std::map<cl_mem, size_t> bucket_of;                  // buffer -> bucket size (all buffers we own)
+    size_t allocated;                                    // total bytes owned by the pool
+    pthread_mutex_t lock;                                // guards all of the above
+
+    static size_t bucket(size_t nbytes);
+
+  public:
+    BufferPool(CLWrapper &clw);
+    ~BufferPool();
+
+    cl_mem acquire(size_t nbytes);
+    void release(cl_mem buffer);
+    void trim();
+
+    size_t bytes_allocated() { return allocated; }
+};
+
+#endif
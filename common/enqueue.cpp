@@ -0,0 +1,54 @@
+#include "enqueue.h"
+
+float event_ms(cl_event e) {
+  cl_ulong start, end;
+  if (clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) != CL_SUCCESS ||
+      clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) != CL_SUCCESS) {
+    return 0;
+  }
+  return (end - start) * 1.0e-6f;
+}
+
+/*
+ * Wait for [e] and time it; then hand it to the caller or release it.
+ */
+static float finish(cl_event e, cl_event *event) {
+  ASSERT_NO_CL_ERROR(clWaitForEvents(1, &e));
+  float ms = event_ms(e);
+  if (event) {
+    *event = e;
+  } else {
+    ASSERT_NO_CL_ERROR(clReleaseEvent(e));
+  }
+  return ms;
+}
+
+float run_kernel_on(cl_command_queue queue, cl_kernel k, size_t *gx, size_t *wx, cl_event *event) {
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueNDRangeKernel(queue, k, /*dim=*/1, NULL, gx, wx, 0, NULL, &e));
+  return finish(e, event);
+}
+
+float memcpy_to_dev_on(cl_command_queue queue, cl_mem buffer, size_t size, const void *ptr,
+                       cl_event *event) {
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueWriteBuffer(queue, buffer, CL_TRUE, 0, size, ptr, 0, NULL, &e));
+  return finish(e, event);
+}
+
+float memcpy_from_dev_on(cl_command_queue queue, cl_mem buffer, size_t size, void *ptr,
+                         cl_event *event) {
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, size, ptr, 0, NULL, &e));
+  return finish(e, event);
+}
+
+float copy_buffer_on(cl_command_queue queue, cl_mem src, cl_mem dst, size_t size, cl_event *event) {
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueCopyBuffer(queue, src, dst, 0, 0, size, 0, NULL, &e));
+  return finish(e, event);
+}
@@ -0,0 +1,23 @@
+#ifndef ENQUEUE_H
+#define ENQUEUE_H
+
+#include "clwrapper.h"
+
+/*
+ * Blocking commands on an explicit command queue, timed from their events
+ *   as CLWrapper times the commands on its own queue (ms; 0 without profiling).
+ * If [event] is given the completed event is returned there and the caller releases it.
+ */
+float run_kernel_on(cl_command_queue queue, cl_kernel k, size_t *gx, size_t *wx, cl_event *event=NULL);
+float memcpy_to_dev_on(cl_command_queue queue, cl_mem buffer, size_t size, const void *ptr,
+                       cl_event *event=NULL);
+float memcpy_from_dev_on(cl_command_queue queue, cl_mem buffer, size_t size, void *ptr,
+                         cl_event *event=NULL);
+float copy_buffer_on(cl_command_queue queue, cl_mem src, cl_mem dst, size_t size, cl_event *event=NULL);
+
+/*
+ * Time between the start and end of [e] in ms, or 0 if its queue does not profile.
+ */
+float event_ms(cl_event e);
+
+#endif
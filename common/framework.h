@@ -4,11 +4,13 @@
 #include "utils.h"
 #include "scanref.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <numeric>
+#include <unistd.h>
 
 using namespace std;
 
@@ -18,12 +20,18 @@ struct options {
   bool verbose;
   bool debug;
   int wx;
+  int nthreads;
+  int variant;
+  int items;
+  bool pad;
   long seed;
+  const char *trace; // Chrome trace file, or NULL
 };
 struct options opt;
 
 /*
  * Run [num_iter] iterations of the scan operation.
+ * If SORTED the operation is a sort instead and results are checked against std::sort.
  */
 #if SEGMENTED
 extern void run(int *data, int *flag, int n, int num_iter, map<string,float> &timings);
@@ -37,9 +45,14 @@ void print_usage(string progname) {
   printf("   -v         be verbose\n");
   printf("   -d         print debug information\n");
   printf("   -n arg     size of input data\n");
-  printf("   -w arg     size of workgroup for OpenCL implementations\n");
+  printf("   -w arg     size of workgroup for OpenCL implementations (0: tuned, see autotune)\n");
+  printf("   -t arg     number of threads for host implementations (default: all cores)\n");
+  printf("   -a arg     algorithm variant for implementations that have several (default: 0)\n");
+  printf("   -i arg     elements per workitem for OpenCL implementations (default: 2)\n");
+  printf("   -p         pad local memory to avoid bank conflicts\n");
   printf("   -r arg     number of runs\n");
   printf("   -s seed    set seed for generating input data\n");
+  printf("   -T file    write a Chrome trace of the OpenCL commands to file (harris, sengupta)\n");
 }
 
 struct _max_str {
@@ -94,10 +107,15 @@ int main(int argc, char **argv) {
   opt.verbose = false;
   opt.debug = false;
   opt.wx = 256;
+  opt.nthreads = 0;
+  opt.variant = 0;
+  opt.items = 2;
+  opt.pad = false;
   opt.seed = -1;
+  opt.trace = NULL;
 
   int c;
-  while ((c = getopt (argc, argv, "hdvn:r:w:s:")) != -1) {
+  while ((c = getopt (argc, argv, "hdvpn:r:w:t:a:i:s:T:")) != -1) {
     switch (c) {
       case 'h':
         print_usage(progname);
@@ -117,12 +135,27 @@ int main(int argc, char **argv) {
       case 'w':
         opt.wx = atoi(optarg);
         break;
+      case 't':
+        opt.nthreads = atoi(optarg);
+        break;
+      case 'a':
+        opt.variant = atoi(optarg);
+        break;
+      case 'i':
+        opt.items = atoi(optarg);
+        break;
+      case 'p':
+        opt.pad = true;
+        break;
       case 's':
         opt.seed = atol(optarg);
         srandom(opt.seed);
         break;
+      case 'T':
+        opt.trace = optarg;
+        break;
       case '?':
-        if (optopt == 'n' || optopt == 'r' || optopt == 's' || optopt == 'w')
+        if (optopt == 'n' || optopt == 'r' || optopt == 's' || optopt == 'w' || optopt == 't' || optopt == 'a' || optopt == 'i' || optopt == 'T')
           fprintf (stderr, "Option -%c requires an argument.\n", optopt);
         else if (isprint (optopt))
           fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -164,6 +197,9 @@ int main(int argc, char **argv) {
   int *expected_result = new int[n];
 #if SEGMENTED
   segmented_exclusive_scan_host(expected_result, data, flag, n);
+#elif SORTED
+  copy(data, data+n, expected_result);
+  sort(expected_result, expected_result+n);
 #else
   exclusive_scan_host(expected_result, data, n);
 #endif
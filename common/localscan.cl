@@ -0,0 +1,83 @@
+/*
+ * Work-efficient (Blelloch) scan of a power-of-two array in local memory
+ *   (HARRIS Section 39.2.2), shared by the scan kernels and the kernels built on a scan
+ *   (eg, compact/ and radixsort/).
+ *
+ * Parameterised like scanop.cl (which it includes) by -D or #define before the include:
+ *   SCAN_T is the element type of the local array (default T), OP/IDENTITY the operator
+ *   and PAD(i) the local index of element i (default i; see CONFLICT_FREE in harris/scan.cl).
+ *
+ * Each of the m/2 workitems handles the elements 2*lid and 2*lid+1 of each level.
+ * There is a barrier before each level but none after the last, so a workitem must
+ *   pass a barrier before it reads an element of another workitem.
+ */
+#ifndef LOCALSCAN_CL
+#define LOCALSCAN_CL
+
+#include "scanop.cl"
+
+#ifndef SCAN_T
+#define SCAN_T T
+#endif
+
+#ifndef PAD
+#define PAD(i) (i)
+#endif
+
+/*
+ * Inplace upsweep (reduce) on a local array [x] of length [m].
+ * NB: [m] must be a power of two.
+ */
+inline void upsweep_pow2(__local SCAN_T *x, int m) {
+  int lid = get_local_id(0);
+  int bi = (lid*2)+1;
+
+  int depth = 1 + (int) log2((float)m);
+  for (int d=0; d<depth; d++) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int mask = (0x1 << d) - 1;
+    if ((lid & mask) == mask && bi < m) {
+      int offset = (0x1 << d);
+      int ai = bi - offset;
+      x[PAD(bi)] = OP(x[PAD(ai)], x[PAD(bi)]);
+    }
+  }
+}
+
+/*
+ * Inplace sweepdown on a local array [x] of length [m].
+ * NB: [m] must be a power of two.
+ */
+inline void sweepdown_pow2(__local SCAN_T *x, int m) {
+  int lid = get_local_id(0);
+  int bi = (lid*2)+1;
+
+  int depth = (int) log2((float)m);
+  for (int d=depth; d>-1; d--) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int mask = (0x1 << d) - 1;
+    if ((lid & mask) == mask && bi < m) {
+      int offset = (0x1 << d);
+      int ai = bi - offset;
+      SCAN_T tmp = x[PAD(ai)];
+              x[PAD(ai)] = x[PAD(bi)];
+                           x[PAD(bi)] = OP(x[PAD(bi)], tmp);
+    }
+  }
+}
+
+/*
+ * Inplace scan on a local array [x] of length [m].
+ * NB: m must be a power of two.
+ */
+inline void scan_pow2(__local SCAN_T *x, int m) {
+  int lid = get_local_id(0);
+  int lane1 = (lid*2)+1;
+  upsweep_pow2(x, m);
+  if (lane1 == (m-1)) {
+    x[PAD(lane1)] = IDENTITY;
+  }
+  sweepdown_pow2(x, m);
+}
+
+#endif
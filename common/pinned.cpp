@@ -0,0 +1,23 @@
+#include "pinned.h"
+
+PinnedBuffer::PinnedBuffer(CLWrapper &clw, size_t nbytes, cl_command_queue queue) :
+  clw(clw), queue(queue ? queue : clw.get_command_queue()), nbytes(nbytes) {
+  cl_int err;
+  buffer = clCreateBuffer(clw.get_context(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, nbytes, NULL, &err);
+  ASSERT_NO_CL_ERROR(err);
+  ptr = clEnqueueMapBuffer(this->queue, buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+    0, nbytes, 0, NULL, NULL, &err);
+  ASSERT_NO_CL_ERROR(err);
+}
+
+PinnedBuffer::~PinnedBuffer() {
+  clEnqueueUnmapMemObject(queue, buffer, ptr, 0, NULL, NULL);
+  clReleaseMemObject(buffer);
+}
+
+void *PinnedBuffer::read(cl_mem src, size_t size, size_t offset) {
+  assert(size <= nbytes);
+  ASSERT_NO_CL_ERROR(
+    clEnqueueReadBuffer(queue, src, CL_TRUE, offset, size, ptr, 0, NULL, NULL));
+  return ptr;
+}
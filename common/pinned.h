@@ -0,0 +1,32 @@
+#ifndef PINNED_H
+#define PINNED_H
+
+#include "clwrapper.h"
+
+/*
+ * A small page-locked host buffer for reading back scalars (eg, scan totals).
+ *
+ * The buffer is allocated with CL_MEM_ALLOC_HOST_PTR and mapped once, so a
+ * blocking read into it is a direct DMA rather than a staged copy through
+ * pageable memory. Reads go to [queue], or the command queue of [clw] if NULL.
+ */
+class PinnedBuffer {
+  private:
+    CLWrapper &clw;
+    cl_command_queue queue;
+    cl_mem buffer;
+    void *ptr;
+    size_t nbytes;
+
+  public:
+    PinnedBuffer(CLWrapper &clw, size_t nbytes, cl_command_queue queue=NULL);
+    ~PinnedBuffer();
+
+    /*
+     * Blocking read of [size] bytes at [offset] of device buffer [src].
+     * Returns a pointer to the pinned copy (valid until the next read).
+     */
+    void *read(cl_mem src, size_t size, size_t offset=0);
+};
+
+#endif
@@ -0,0 +1,312 @@
+#include "programcache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+typedef std::pair<cl_context, std::string> program_key;
+static std::map<program_key, cl_program> programs;
+static std::map<cl_context, int> users;  // cached_program calls not yet released
+static pthread_mutex_t programs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * 64-bit FNV-1a hash.
+ */
+static unsigned long long fnv1a(const std::string &s) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (size_t i=0; i<s.size(); i++) {
+    h ^= (unsigned char) s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static std::string device_info(cl_device_id device, cl_device_info param) {
+  size_t size = 0;
+  if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::vector<char> value(size);
+  if (clGetDeviceInfo(device, param, size, &value[0], NULL) != CL_SUCCESS) {
+    return std::string();
+  }
+  return std::string(&value[0]);
+}
+
+/*
+ * Directory for program binaries: $SCAN_KERNEL_CACHE, or ~/.cache/scan-kernels if unset.
+ * An empty $SCAN_KERNEL_CACHE disables the disk cache (returns "").
+ */
+static std::string cache_dir() {
+  const char *env = getenv("SCAN_KERNEL_CACHE");
+  if (env) {
+    std::string dir(env);
+    if (!dir.empty()) {
+      mkdir(dir.c_str(), 0755);
+    }
+    return dir;
+  }
+  const char *home = getenv("HOME");
+  if (!home) {
+    return std::string();
+  }
+  std::string dir = std::string(home) + "/.cache";
+  mkdir(dir.c_str(), 0755);
+  dir += "/scan-kernels";
+  mkdir(dir.c_str(), 0755);
+  return dir;
+}
+
+static std::string dir_of(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+/*
+ * Contents of file [path] with each '#include "file"' line replaced by that file
+ *   (looked up next to [path], then in ../common), as cl2include.sh does for embedded programs.
+ */
+static bool read_expanded(const std::string &path, std::string &text) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::string dir = dir_of(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t open = line.find('"');
+    size_t close = (open == std::string::npos) ? open : line.find('"', open+1);
+    if (line.compare(0, 9, "#include ") == 0 && close != std::string::npos) {
+      std::string inc = line.substr(open+1, close-open-1);
+      if (!read_expanded(dir + "/" + inc, text) &&
+          !read_expanded(dir + "/../common/" + inc, text)) {
+        return false;
+      }
+    } else {
+      text += line;
+      text += "\n";
+    }
+  }
+  return true;
+}
+
+/*
+ * Program text: the embedded [source] or the contents of file [name] (with its includes).
+ */
+static bool program_text(const char *name, const char *source, std::string &text) {
+  text.clear();
+  if (source) {
+    text = source;
+    return true;
+  }
+  return read_expanded(name, text);
+}
+
+/*
+ * A binary is only valid for the same device, driver, program text and build options.
+ * The full key is stored in the file so that a hash collision is just a miss.
+ */
+static std::string binary_key(CLWrapper &clw, const std::string &text, const std::string &flags) {
+  cl_device_id device = clw.get_device();
+  std::stringstream key;
+  key << device_info(device, CL_DEVICE_NAME) << "|"
+      << device_info(device, CL_DEVICE_VERSION) << "|"
+      << device_info(device, CL_DRIVER_VERSION) << "|"
+      << std::hex << fnv1a(text) << "|" << flags;
+  return key.str();
+}
+
+static std::string binary_path(const std::string &dir, const std::string &key) {
+  std::stringstream path;
+  path << dir << "/" << std::hex << fnv1a(key) << ".bin";
+  return path.str();
+}
+
+/*
+ * Load and build the cached binary for [key], or return NULL on any mismatch or failure.
+ */
+static cl_program load_binary(CLWrapper &clw, const std::string &path, const std::string &key,
+                              const std::string &flags) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) {
+    return NULL;
+  }
+  std::string stored;
+  std::getline(file, stored);
+  if (stored != key) {
+    return NULL;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  std::string binary = ss.str();
+  if (binary.empty()) {
+    return NULL;
+  }
+
+  cl_device_id device = clw.get_device();
+  size_t size = binary.size();
+  const unsigned char *bytes = (const unsigned char *) binary.data();
+  cl_int status, err;
+  cl_program program = clCreateProgramWithBinary(clw.get_context(), 1, &device, &size, &bytes, &status, &err);
+  if (err != CL_SUCCESS || status != CL_SUCCESS) {
+    if (program) {
+      clReleaseProgram(program);
+    }
+    return NULL;
+  }
+  if (clBuildProgram(program, 1, &device, flags.c_str(), NULL, NULL) != CL_SUCCESS) {
+    clReleaseProgram(program);
+    return NULL;
+  }
+  return program;
+}
+
+/*
+ * Write the binary of [program] for [key]. We write to a temporary file and rename it
+ *   so that concurrent processes never see a partial binary.
+ * Failures are not fatal; we just compile again next time.
+ */
+static void save_binary(cl_program program, const std::string &path, const std::string &key) {
+  size_t nbytes = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, 0, NULL, &nbytes) != CL_SUCCESS) {
+    return;
+  }
+  size_t ndevices = nbytes / sizeof(size_t);
+  if (ndevices != 1) {
+    return;
+  }
+  size_t size = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL) != CL_SUCCESS ||
+      size == 0) {
+    return;
+  }
+  std::vector<unsigned char> binary(size);
+  unsigned char *bytes = &binary[0];
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &bytes, NULL) != CL_SUCCESS) {
+    return;
+  }
+
+  std::stringstream tmp;
+  tmp << path << "." << getpid() << ".tmp";
+  {
+    std::ofstream file(tmp.str().c_str(), std::ios::binary);
+    if (!file) {
+      return;
+    }
+    file << key << "\n";
+    file.write((const char *) bytes, size);
+    if (!file) {
+      file.close();
+      unlink(tmp.str().c_str());
+      return;
+    }
+  }
+  if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+    unlink(tmp.str().c_str());
+  }
+}
+
+/*
+ * We hold the lock while compiling, so concurrent first uses of a program compile it once.
+ */
+cl_program cached_program(CLWrapper &clw, const char *name, const char *source, const std::string &flags) {
+  program_key key(clw.get_context(), std::string(name) + " " + flags);
+  pthread_mutex_lock(&programs_lock);
+  users[key.first]++;
+  std::map<program_key, cl_program>::iterator i = programs.find(key);
+  if (i != programs.end()) {
+    cl_program program = i->second;
+    pthread_mutex_unlock(&programs_lock);
+    return program;
+  }
+
+  std::string dir = cache_dir();
+  std::string text, bkey, path;
+  bool have_text = program_text(name, source, text);
+  cl_program program = NULL;
+  if (!dir.empty() && have_text) {
+    bkey = binary_key(clw, text, flags);
+    path = binary_path(dir, bkey);
+    program = load_binary(clw, path, bkey, flags);
+  }
+  if (!program) {
+    // clw.compile reports a missing file
+    program = have_text ? clw.compile_from_string(text.c_str(), flags)
+                        : clw.compile(name, flags);
+    // clw keeps its own reference to the programs it compiles
+    ASSERT_NO_CL_ERROR(clRetainProgram(program));
+    if (!path.empty()) {
+      save_binary(program, path, bkey);
+    }
+  }
+  ASSERT_NO_CL_ERROR(clRetainContext(key.first));
+  programs[key] = program;
+  pthread_mutex_unlock(&programs_lock);
+  return program;
+}
+
+void release_cached_programs(CLWrapper &clw) {
+  cl_context context = clw.get_context();
+  pthread_mutex_lock(&programs_lock);
+  std::map<cl_context, int>::iterator u = users.find(context);
+  if (u == users.end() || --u->second > 0) {
+    pthread_mutex_unlock(&programs_lock);
+    return;
+  }
+  users.erase(u);
+  std::map<program_key, cl_program>::iterator i = programs.lower_bound(program_key(context, std::string()));
+  while (i != programs.end() && i->first.first == context) {
+    clReleaseProgram(i->second);
+    clReleaseContext(context);
+    programs.erase(i++);
+  }
+  pthread_mutex_unlock(&programs_lock);
+}
+
+TemporaryKernelCache::TemporaryKernelCache() {
+  const char *env = getenv("SCAN_KERNEL_CACHE");
+  was_set = (env != NULL);
+  saved = env ? env : "";
+  char dir[] = "/tmp/scan_kernel_cache_XXXXXX";
+  if (mkdtemp(dir)) {
+    path = dir;
+  }
+  // an empty path disables the disk cache
+  setenv("SCAN_KERNEL_CACHE", path.c_str(), 1);
+}
+
+TemporaryKernelCache::~TemporaryKernelCache() {
+  if (!path.empty()) {
+    DIR *d = opendir(path.c_str());
+    if (d) {
+      struct dirent *e;
+      while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.') {
+          unlink((path + "/" + e->d_name).c_str());
+        }
+      }
+      closedir(d);
+    }
+    rmdir(path.c_str());
+  }
+  if (was_set) {
+    setenv("SCAN_KERNEL_CACHE", saved.c_str(), 1);
+  } else {
+    unsetenv("SCAN_KERNEL_CACHE");
+  }
+}
+
+cl_kernel create_kernel(cl_program program, const char *name) {
+  cl_int err;
+  cl_kernel kernel = clCreateKernel(program, name, &err);
+  ASSERT_NO_CL_ERROR(err);
+  return kernel;
+}
@@ -0,0 +1,60 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "clwrapper.h"
+
+#include <string>
+
+/*
+ * Compiled programs shared across Scan/SegmentedScan instances.
+ *
+ * Programs are keyed by context, program name and build options, so each
+ *   specialization (element type, operator, variant) is compiled once per context.
+ * Each call of cached_program counts one user of the context of [clw], and must be matched
+ *   by one release_cached_programs (the objects that create kernels call these in their
+ *   constructor and destructor). We retain the context and its programs until the last user
+ *   releases them; holding the context keeps its handle from being reused for a different context.
+ *
+ * [source] is the embedded program text, or NULL to compile the file [name]
+ *   (its '#include "file"' lines are inlined, as cl2include.sh does for embedded programs).
+ *
+ * Compiled binaries are also kept on disk (in $SCAN_KERNEL_CACHE, default ~/.cache/scan-kernels;
+ *   set it empty to disable), keyed by device name and version, driver version,
+ *   a hash of the program text and the build options.
+ * So later processes build the program from its binary instead of compiling the source.
+ *
+ * cached_program may be called from several threads.
+ */
+cl_program cached_program(CLWrapper &clw, const char *name, const char *source, const std::string &flags);
+
+/*
+ * Drop one user of the context of [clw]; after the last, release the programs
+ *   held by cached_program for that context (the disk cache is kept).
+ */
+void release_cached_programs(CLWrapper &clw);
+
+/*
+ * Points $SCAN_KERNEL_CACHE at a new temporary directory for the lifetime of the object,
+ *   then removes the directory and restores the previous setting.
+ * The unit tests hold one so that they never write binaries into $HOME.
+ */
+class TemporaryKernelCache {
+  private:
+    std::string path;
+    std::string saved;
+    bool was_set;
+
+  public:
+    TemporaryKernelCache();
+    ~TemporaryKernelCache();
+
+    const std::string &dir() { return path; }
+};
+
+/*
+ * Create a kernel that belongs to the caller (release with clReleaseKernel).
+ * Unlike clw.kernel_of_name this is not shared with other specializations of the same program.
+ */
+cl_kernel create_kernel(cl_program program, const char *name);
+
+#endif
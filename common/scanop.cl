@@ -0,0 +1,49 @@
+/*
+ * Element type and associative operator of the scan kernels (the OpenCL side of scanop.h).
+ *
+ * T is the element type, SCAN_OP the associative operator (one of OP_*)
+ *   and IDENTITY its identity element for T, all set with -D by the host.
+ *   OP(a,b) is always applied with [a] the earlier (left) operand.
+ *
+ * Kernels #include this file; cl2include.sh (and cached_program, for kernels
+ *   compiled from the working directory) inline it, since the programs are
+ *   built from a string without an include path.
+ */
+#ifndef SCANOP_CL
+#define SCANOP_CL
+
+#if ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#ifndef T
+#define T int
+#endif
+
+#define OP_ADD 0
+#define OP_MAX 1
+#define OP_MIN 2
+#define OP_AND 3
+#define OP_OR  4
+
+#ifndef SCAN_OP
+#define SCAN_OP OP_ADD
+#endif
+
+#ifndef IDENTITY
+#define IDENTITY 0
+#endif
+
+#if   SCAN_OP == OP_ADD
+#define OP(a,b) ((a) + (b))
+#elif SCAN_OP == OP_MAX
+#define OP(a,b) max((a), (b))
+#elif SCAN_OP == OP_MIN
+#define OP(a,b) min((a), (b))
+#elif SCAN_OP == OP_AND
+#define OP(a,b) ((a) & (b))
+#elif SCAN_OP == OP_OR
+#define OP(a,b) ((a) | (b))
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SCANOP_H
+#define SCANOP_H
+
+#include <limits>
+#include <stdint.h>
+
+/*
+ * Element types and associative operators for typed scans.
+ *
+ * Each operator provides
+ *   - identity() and apply(a,b) for the host implementations,
+ *   - cl_id() and cl_identity() which we pass to the OpenCL kernels as
+ *     -D SCAN_OP=<cl_id> -D IDENTITY=<cl_identity>.
+ * apply(a,b) is called with [a] the earlier (left) operand.
+ *
+ * Each element type provides its OpenCL name (-D T=<name>) and the build options it needs.
+ * The SCAN_OP ids must agree with the OP_* defines in scanop.cl.
+ */
+
+template <typename T> struct cl_type;
+
+template <> struct cl_type<int> {
+  static const char *name()    { return "int"; }
+  static const char *lowest()  { return "INT_MIN"; }
+  static const char *highest() { return "INT_MAX"; }
+  static const char *options() { return ""; }
+};
+
+template <> struct cl_type<int64_t> {
+  static const char *name()    { return "long"; }
+  static const char *lowest()  { return "LONG_MIN"; }
+  static const char *highest() { return "LONG_MAX"; }
+  static const char *options() { return ""; }
+};
+
+template <> struct cl_type<float> {
+  static const char *name()    { return "float"; }
+  static const char *lowest()  { return "-INFINITY"; }
+  static const char *highest() { return "INFINITY"; }
+  static const char *options() { return ""; }
+};
+
+template <> struct cl_type<double> {
+  static const char *name()    { return "double"; }
+  static const char *lowest()  { return "-INFINITY"; }
+  static const char *highest() { return "INFINITY"; }
+  static const char *options() { return " -D ENABLE_FP64=1"; }
+};
+
+template <typename T> T lowest_value() {
+  return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                              :  std::numeric_limits<T>::min();
+}
+
+template <typename T> T highest_value() {
+  return std::numeric_limits<T>::has_infinity ?  std::numeric_limits<T>::infinity()
+                                              :  std::numeric_limits<T>::max();
+}
+
+template <typename T> struct Add {
+  static T identity()              { return 0; }
+  static T apply(T a, T b)         { return a + b; }
+  static int cl_id()               { return 0; }
+  static const char *cl_identity() { return "0"; }
+};
+
+template <typename T> struct Max {
+  static T identity()              { return lowest_value<T>(); }
+  static T apply(T a, T b)         { return a < b ? b : a; }
+  static int cl_id()               { return 1; }
+  static const char *cl_identity() { return cl_type<T>::lowest(); }
+};
+
+template <typename T> struct Min {
+  static T identity()              { return highest_value<T>(); }
+  static T apply(T a, T b)         { return b < a ? b : a; }
+  static int cl_id()               { return 2; }
+  static const char *cl_identity() { return cl_type<T>::highest(); }
+};
+
+/* bitwise operators are only defined for integer types */
+template <typename T> struct And {
+  static T identity()              { return ~(T)0; }
+  static T apply(T a, T b)         { return a & b; }
+  static int cl_id()               { return 3; }
+  static const char *cl_identity() { return "-1"; }
+};
+
+template <typename T> struct Or {
+  static T identity()              { return 0; }
+  static T apply(T a, T b)         { return a | b; }
+  static int cl_id()               { return 4; }
+  static const char *cl_identity() { return "0"; }
+};
+
+#endif
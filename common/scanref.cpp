@@ -1,19 +1,93 @@
 #include "scanref.h"
 
 void exclusive_scan_host(int *output, int *input, int n) {
-  output[0] = 0;
-  for (int i=1; i<n; i++) {
-    output[i] = output[i-1] + input[i-1];
+  exclusive_scan_host<int, Add<int> >(output, input, n);
+}
+
+template <typename T, class Op>
+void exclusive_scan_host(T *output, T *input, int n) {
+  T sum = Op::identity();
+  for (int i=0; i<n; i++) {
+    T tmp = input[i];
+    output[i] = sum;
+    sum = Op::apply(sum, tmp);
   }
 }
 
 void segmented_exclusive_scan_host(int *output, int *input, int *flag, int n) {
-  output[0] = 0;
+  segmented_exclusive_scan_host<int, Add<int> >(output, input, flag, n);
+}
+
+template <typename T, class Op>
+void segmented_exclusive_scan_host(T *output, T *input, int *flag, int n) {
+  output[0] = Op::identity();
   for (int i=1; i<n; i++) {
     if (flag[i]) {
-      output[i] = 0;
+      output[i] = Op::identity();
     } else {
-      output[i] = output[i-1] + input[i-1];
+      output[i] = Op::apply(output[i-1], input[i-1]);
+    }
+  }
+}
+
+void segmented_exclusive_scan_offsets_host(int *output, int *input, int n, int *offsets, int nsegments) {
+  segmented_exclusive_scan_offsets_host<int, Add<int> >(output, input, n, offsets, nsegments);
+}
+
+template <typename T, class Op>
+void segmented_exclusive_scan_offsets_host(T *output, T *input, int n, int *offsets, int nsegments) {
+  int s = 0;
+  T sum = Op::identity();
+  for (int i=0; i<n; i++) {
+    // several offsets may equal i (empty segments)
+    bool head = false;
+    while (s < nsegments && offsets[s] <= i) {
+      head |= (offsets[s] == i);
+      s++;
+    }
+    if (head) {
+      sum = Op::identity();
+    }
+    output[i] = sum;
+    sum = Op::apply(sum, input[i]);
+  }
+}
+
+void segmented_exclusive_scan_keys_host(int *output, int *input, int *keys, int n) {
+  segmented_exclusive_scan_keys_host<int, Add<int> >(output, input, keys, n);
+}
+
+template <typename T, class Op>
+void segmented_exclusive_scan_keys_host(T *output, T *input, int *keys, int n) {
+  T sum = Op::identity();
+  for (int i=0; i<n; i++) {
+    if (i > 0 && keys[i] != keys[i-1]) {
+      sum = Op::identity();
     }
+    output[i] = sum;
+    sum = Op::apply(sum, input[i]);
   }
 }
+
+#define INSTANTIATE(T, OP) \
+  template void exclusive_scan_host<T, OP<T> >(T *output, T *input, int n); \
+  template void segmented_exclusive_scan_host<T, OP<T> >(T *output, T *input, int *flag, int n); \
+  template void segmented_exclusive_scan_offsets_host<T, OP<T> >(T *output, T *input, int n, int *offsets, int nsegments); \
+  template void segmented_exclusive_scan_keys_host<T, OP<T> >(T *output, T *input, int *keys, int n);
+
+INSTANTIATE(int,     Add)
+INSTANTIATE(int,     Max)
+INSTANTIATE(int,     Min)
+INSTANTIATE(int,     And)
+INSTANTIATE(int,     Or)
+INSTANTIATE(int64_t, Add)
+INSTANTIATE(int64_t, Max)
+INSTANTIATE(int64_t, Min)
+INSTANTIATE(int64_t, And)
+INSTANTIATE(int64_t, Or)
+INSTANTIATE(float,   Add)
+INSTANTIATE(float,   Max)
+INSTANTIATE(float,   Min)
+INSTANTIATE(double,  Add)
+INSTANTIATE(double,  Max)
+INSTANTIATE(double,  Min)
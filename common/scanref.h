@@ -1,14 +1,45 @@
 #ifndef SCANREF_H
 #define SCANREF_H
 
+#include "scanop.h"
+
 /*
  * Exclusive scan on array [input] of length [n]
+ * This is a plain loop, the reference for every other scan (including exclusive_scan_simd).
  */
 void exclusive_scan_host(int *output, int *input, int n);
 
+/*
+ * Exclusive scan on array [input] of length [n] of type [T] under operator [Op] (see scanop.h).
+ * Instantiated for the same specializations as BasicScan.
+ */
+template <typename T, class Op>
+void exclusive_scan_host(T *output, T *input, int n);
+
 /*
  * Segmented exclusive scan on array tuple ([input], [flag]), both of length [n]
  */
 void segmented_exclusive_scan_host(int *output, int *input, int *flag, int n);
 
+template <typename T, class Op>
+void segmented_exclusive_scan_host(T *output, T *input, int *flag, int n);
+
+/*
+ * Segmented exclusive scan on array [input] of length [n] where segment s
+ *   starts at element [offsets][s]. [offsets] must be ascending; offsets >= n are ignored.
+ */
+void segmented_exclusive_scan_offsets_host(int *output, int *input, int n, int *offsets, int nsegments);
+
+template <typename T, class Op>
+void segmented_exclusive_scan_offsets_host(T *output, T *input, int n, int *offsets, int nsegments);
+
+/*
+ * Segmented exclusive scan on array [input] of length [n] where a segment
+ *   starts wherever [keys][i] != [keys][i-1].
+ */
+void segmented_exclusive_scan_keys_host(int *output, int *input, int *keys, int n);
+
+template <typename T, class Op>
+void segmented_exclusive_scan_keys_host(T *output, T *input, int *keys, int n);
+
 #endif
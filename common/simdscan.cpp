@@ -0,0 +1,191 @@
+#include "simdscan.h"
+
+#include <cstddef>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+typedef int (*scan_fn)(int *, const int *, int, int);
+typedef int (*reduce_fn)(const int *, int);
+
+static int exclusive_scan_scalar(int *output, const int *input, int n, int carry) {
+  for (int i=0; i<n; i++) {
+    int tmp = input[i];
+              output[i] = carry;
+                          carry += tmp;
+  }
+  return carry;
+}
+
+static int reduce_scalar(const int *input, int n) {
+  int sum = 0;
+  for (int i=0; i<n; i++) {
+    sum += input[i];
+  }
+  return sum;
+}
+
+#if SIMD_X86
+/*
+ * SSE2: 4 lanes.
+ * Two shift-and-adds give an inclusive scan of the register.
+ */
+__attribute__((target("sse2")))
+static int exclusive_scan_sse2(int *output, const int *input, int n, int carry) {
+  __m128i c = _mm_set1_epi32(carry);
+  int i = 0;
+  for (; i+4<=n; i+=4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&input[i]);
+    __m128i x = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    // exclusive = inclusive - input
+    _mm_storeu_si128((__m128i *)&output[i], _mm_add_epi32(c, _mm_sub_epi32(x, v)));
+    c = _mm_add_epi32(c, _mm_shuffle_epi32(x, 0xFF));
+  }
+  return exclusive_scan_scalar(&output[i], &input[i], n-i, _mm_cvtsi128_si32(c));
+}
+
+__attribute__((target("sse2")))
+static int reduce_sse2(const int *input, int n) {
+  __m128i s = _mm_setzero_si128();
+  int i = 0;
+  for (; i+4<=n; i+=4) {
+    s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i *)&input[i]));
+  }
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+  return _mm_cvtsi128_si32(s) + reduce_scalar(&input[i], n-i);
+}
+
+/*
+ * AVX2: 8 lanes.
+ * Byte shifts only work within each 128-bit half, so after scanning both halves
+ * we add the last element of the low half to every element of the high half.
+ */
+__attribute__((target("avx2")))
+static int exclusive_scan_avx2(int *output, const int *input, int n, int carry) {
+  const __m256i last_of_low = _mm256_set1_epi32(3);
+  const __m256i last        = _mm256_set1_epi32(7);
+  __m256i c = _mm256_set1_epi32(carry);
+  int i = 0;
+  for (; i+8<=n; i+=8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&input[i]);
+    __m256i x = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+            x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+    __m256i t = _mm256_permutevar8x32_epi32(x, last_of_low);
+            x = _mm256_add_epi32(x, _mm256_blend_epi32(_mm256_setzero_si256(), t, 0xF0));
+    _mm256_storeu_si256((__m256i *)&output[i], _mm256_add_epi32(c, _mm256_sub_epi32(x, v)));
+    c = _mm256_add_epi32(c, _mm256_permutevar8x32_epi32(x, last));
+  }
+  return exclusive_scan_scalar(&output[i], &input[i], n-i, _mm256_cvtsi256_si32(c));
+}
+
+__attribute__((target("avx2")))
+static int reduce_avx2(const int *input, int n) {
+  __m256i s = _mm256_setzero_si256();
+  int i = 0;
+  for (; i+8<=n; i+=8) {
+    s = _mm256_add_epi32(s, _mm256_loadu_si256((const __m256i *)&input[i]));
+  }
+  __m128i h = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0x4E));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0xB1));
+  return _mm_cvtsi128_si32(h) + reduce_scalar(&input[i], n-i);
+}
+
+/*
+ * AVX-512: 16 lanes.
+ * Lane permutes cross the whole register, so each step shifts by [offset] lanes
+ * (zeroing the lanes below [offset]) and adds.
+ */
+__attribute__((target("avx512f")))
+static int exclusive_scan_avx512(int *output, const int *input, int n, int carry) {
+  const __m512i lane = _mm512_setr_epi32(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m512i last = _mm512_set1_epi32(15);
+  __m512i shift[4];
+  __mmask16 keep[4];
+  for (int d=0; d<4; d++) {
+    shift[d] = _mm512_sub_epi32(lane, _mm512_set1_epi32(1 << d));
+    keep[d] = (__mmask16)(0xFFFF << (1 << d));
+  }
+  __m512i c = _mm512_set1_epi32(carry);
+  int i = 0;
+  for (; i+16<=n; i+=16) {
+    __m512i v = _mm512_loadu_si512((const void *)&input[i]);
+    __m512i x = v;
+    for (int d=0; d<4; d++) {
+      x = _mm512_add_epi32(x, _mm512_maskz_permutexvar_epi32(keep[d], shift[d], x));
+    }
+    _mm512_storeu_si512((void *)&output[i], _mm512_add_epi32(c, _mm512_sub_epi32(x, v)));
+    c = _mm512_add_epi32(c, _mm512_maskz_permutexvar_epi32(0xFFFF, last, x));
+  }
+  return exclusive_scan_scalar(&output[i], &input[i], n-i, _mm512_cvtsi512_si32(c));
+}
+
+__attribute__((target("avx512f")))
+static int reduce_avx512(const int *input, int n) {
+  __m512i s = _mm512_setzero_si512();
+  int i = 0;
+  for (; i+16<=n; i+=16) {
+    s = _mm512_add_epi32(s, _mm512_loadu_si512((const void *)&input[i]));
+  }
+  int lanes[16];
+  _mm512_storeu_si512((void *)lanes, s);
+  return reduce_scalar(lanes, 16) + reduce_scalar(&input[i], n-i);
+}
+#endif
+
+// supported implementations, widest first; the first is the one dispatched to
+static simd_impl supported[4];
+static int nsupported = 0;
+// written once, by whichever thread first calls in
+static pthread_once_t dispatched = PTHREAD_ONCE_INIT;
+
+static void add_impl(const char *name, scan_fn scan, reduce_fn reduce) {
+  simd_impl &impl = supported[nsupported++];
+  impl.isa            = name;
+  impl.exclusive_scan = scan;
+  impl.reduce         = reduce;
+}
+
+static void dispatch() {
+#if SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    add_impl("avx512", exclusive_scan_avx512, reduce_avx512);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    add_impl("avx2", exclusive_scan_avx2, reduce_avx2);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    add_impl("sse2", exclusive_scan_sse2, reduce_sse2);
+  }
+#endif
+  add_impl("scalar", exclusive_scan_scalar, reduce_scalar);
+}
+
+int exclusive_scan_simd(int *output, const int *input, int n, int carry) {
+  pthread_once(&dispatched, dispatch);
+  return supported[0].exclusive_scan(output, input, n, carry);
+}
+
+int reduce_simd(const int *input, int n) {
+  pthread_once(&dispatched, dispatch);
+  return supported[0].reduce(input, n);
+}
+
+const char *simd_isa() {
+  pthread_once(&dispatched, dispatch);
+  return supported[0].isa;
+}
+
+int simd_impls(const simd_impl **impls) {
+  pthread_once(&dispatched, dispatch);
+  *impls = supported;
+  return nsupported;
+}
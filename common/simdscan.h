@@ -0,0 +1,46 @@
+#ifndef SIMDSCAN_H
+#define SIMDSCAN_H
+
+/*
+ * Vectorized host primitives.
+ *
+ * On x86 we pick the widest of AVX-512, AVX2 and SSE2 supported by the running cpu
+ * (once, on first use from any thread) and fall back to a scalar loop everywhere else.
+ * Within each vector register we use a log-step shift-and-add (Hillis-Steele)
+ * and carry the running total from one register to the next.
+ * [output] may alias [input] for an inplace scan.
+ */
+
+/*
+ * Exclusive scan on array [input] of length [n], where every output is offset by [carry].
+ * Returns the reduction of [input] plus [carry] (ie, the next carry).
+ */
+int exclusive_scan_simd(int *output, const int *input, int n, int carry=0);
+
+/*
+ * Reduction (sum) of array [input] of length [n].
+ */
+int reduce_simd(const int *input, int n);
+
+/*
+ * Name of the instruction set chosen by the dispatcher ("avx512", "avx2", "sse2" or "scalar").
+ */
+const char *simd_isa();
+
+/*
+ * One instruction set's exclusive_scan_simd and reduce_simd, called directly.
+ */
+struct simd_impl {
+  const char *isa;
+  int (*exclusive_scan)(int *output, const int *input, int n, int carry);
+  int (*reduce)(const int *input, int n);
+};
+
+/*
+ * Set [impls] to the implementations supported by the running cpu, widest first
+ *   (the first is the one chosen by the dispatcher, the last is "scalar"),
+ *   and return how many there are; eg, to test every instruction set, not just the chosen one.
+ */
+int simd_impls(const simd_impl **impls);
+
+#endif
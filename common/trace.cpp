@@ -0,0 +1,220 @@
+#include "trace.h"
+#include "enqueue.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+
+Trace::Trace() : calls(0), nesting(0) {}
+
+Trace::~Trace() {
+  clear();
+}
+
+/*
+ * A profiling counter of [e], or 0 if the queue does not profile.
+ */
+cl_ulong Trace::profiling_info(cl_event e, cl_profiling_info param) {
+  cl_ulong t = 0;
+  if (clGetEventProfilingInfo(e, param, sizeof(cl_ulong), &t, NULL) != CL_SUCCESS) {
+    return 0;
+  }
+  return t;
+}
+
+void Trace::record(cl_event e, const std::string &name, bool kernel, int depth, int n,
+                   size_t groups, size_t bytes) {
+  ASSERT_NO_CL_ERROR(clRetainEvent(e));
+  trace_record r;
+  r.name = name;
+  r.kernel = kernel;
+  r.call = calls > 0 ? calls-1 : 0;
+  r.depth = depth;
+  r.n = n;
+  r.groups = groups;
+  r.bytes = bytes;
+  r.queued = r.submit = r.start = r.end = 0;
+  r.event = e;
+  records.push_back(r);
+}
+
+/*
+ * Record the completed command [e] and release it.
+ */
+void Trace::finish(cl_event e, const std::string &name, bool kernel, int depth, int n,
+                   size_t groups, size_t bytes) {
+  record(e, name, kernel, depth, n, groups, bytes);
+  ASSERT_NO_CL_ERROR(clReleaseEvent(e));
+}
+
+std::string Trace::kernel_name(cl_kernel k) {
+  char name[256];
+  ASSERT_NO_CL_ERROR(clGetKernelInfo(k, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL));
+  return std::string(name);
+}
+
+float Trace::run_kernel(cl_command_queue queue, cl_kernel k, size_t *gx, size_t *wx, int depth, int n) {
+  cl_event e;
+  float ms = run_kernel_on(queue, k, gx, wx, &e);
+  finish(e, kernel_name(k), true, depth, n, *gx / *wx, 0);
+  return ms;
+}
+
+float Trace::memcpy_to_dev(cl_command_queue queue, cl_mem buffer, size_t size, const void *ptr, int n) {
+  cl_event e;
+  float ms = memcpy_to_dev_on(queue, buffer, size, ptr, &e);
+  finish(e, "memcpy_to_dev", false, 0, n, 0, size);
+  return ms;
+}
+
+float Trace::memcpy_from_dev(cl_command_queue queue, cl_mem buffer, size_t size, void *ptr, int n) {
+  cl_event e;
+  float ms = memcpy_from_dev_on(queue, buffer, size, ptr, &e);
+  finish(e, "memcpy_from_dev", false, 0, n, 0, size);
+  return ms;
+}
+
+float Trace::copy_buffer(cl_command_queue queue, cl_mem src, cl_mem dst, size_t size, int n) {
+  cl_event e;
+  float ms = copy_buffer_on(queue, src, dst, size, &e);
+  finish(e, "copy_buffer", false, 0, n, 0, size);
+  return ms;
+}
+
+void Trace::resolve() {
+  for (size_t i=0; i<records.size(); i++) {
+    trace_record &r = records[i];
+    if (!r.event) {
+      continue;
+    }
+    ASSERT_NO_CL_ERROR(clWaitForEvents(1, &r.event));
+    r.queued = profiling_info(r.event, CL_PROFILING_COMMAND_QUEUED);
+    r.submit = profiling_info(r.event, CL_PROFILING_COMMAND_SUBMIT);
+    r.start = profiling_info(r.event, CL_PROFILING_COMMAND_START);
+    r.end = profiling_info(r.event, CL_PROFILING_COMMAND_END);
+    ASSERT_NO_CL_ERROR(clReleaseEvent(r.event));
+    r.event = NULL;
+  }
+}
+
+void Trace::clear() {
+  for (size_t i=0; i<records.size(); i++) {
+    if (records[i].event) {
+      clReleaseEvent(records[i].event);
+    }
+  }
+  records.clear();
+  calls = 0;
+}
+
+static double us(cl_ulong t, cl_ulong origin) {
+  return t < origin ? 0.0 : (t - origin) * 1.0e-3;
+}
+
+static std::string quote(const std::string &s) {
+  std::string q = "\"";
+  for (size_t i=0; i<s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\') {
+      q += '\\';
+    }
+    q += s[i];
+  }
+  return q + "\"";
+}
+
+std::string Trace::chrome_json() {
+  resolve();
+  cl_ulong origin = 0;
+  for (size_t i=0; i<records.size(); i++) {
+    cl_ulong t = records[i].queued ? records[i].queued : records[i].start;
+    if (i == 0 || t < origin) {
+      origin = t;
+    }
+  }
+
+  std::stringstream json;
+  json.setf(std::ios::fixed);
+  json.precision(3);
+  json << "{\"traceEvents\":[\n";
+  // name the rows: transfers, then one per recursion level
+  std::set<int> rows;
+  rows.insert(0);
+  for (size_t i=0; i<records.size(); i++) {
+    if (records[i].kernel) {
+      rows.insert(records[i].depth + 1);
+    }
+  }
+  for (std::set<int>::iterator row = rows.begin(); row != rows.end(); row++) {
+    std::stringstream name;
+    if (*row == 0) {
+      name << "transfers";
+    } else {
+      name << "level " << (*row - 1);
+    }
+    json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << *row
+         << ",\"args\":{\"name\":" << quote(name.str()) << "}}"
+         << (records.empty() && *row == *rows.rbegin() ? "\n" : ",\n");
+  }
+  for (size_t i=0; i<records.size(); i++) {
+    const trace_record &r = records[i];
+    json << "{\"name\":" << quote(r.name)
+         << ",\"cat\":\"" << (r.kernel ? "kernel" : "transfer") << "\""
+         << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << (r.kernel ? r.depth + 1 : 0)
+         << ",\"ts\":" << us(r.start, origin)
+         << ",\"dur\":" << us(r.end, r.start)
+         << ",\"args\":{\"call\":" << r.call
+         << ",\"depth\":" << r.depth
+         << ",\"n\":" << r.n
+         << ",\"groups\":" << r.groups
+         << ",\"bytes\":" << r.bytes
+         << ",\"queued_us\":" << us(r.queued, origin)
+         << ",\"submit_us\":" << us(r.submit, origin) << "}}"
+         << (i+1 < records.size() ? ",\n" : "\n");
+  }
+  json << "],\"displayTimeUnit\":\"ms\"}\n";
+  return json.str();
+}
+
+bool Trace::write_chrome_json(const std::string &path) {
+  std::ofstream file(path.c_str());
+  if (!file) {
+    return false;
+  }
+  file << chrome_json();
+  return (bool) file;
+}
+
+struct level_totals {
+  int count;
+  double ms;        // start to end
+  double queue_ms;  // queued to start
+};
+
+std::string Trace::level_summary() {
+  resolve();
+  typedef std::pair<int, std::string> level_key;
+  std::map<level_key, level_totals> levels;
+  for (size_t i=0; i<records.size(); i++) {
+    const trace_record &r = records[i];
+    level_totals &t = levels[level_key(r.depth, r.name)];
+    t.count++;
+    t.ms += (r.end - r.start) * 1.0e-6;
+    t.queue_ms += (r.queued && r.start > r.queued) ? (r.start - r.queued) * 1.0e-6 : 0.0;
+  }
+
+  std::stringstream out;
+  char line[128];
+  snprintf(line, sizeof(line), "%5s  %-28s %7s %12s %12s %12s\n",
+    "level", "command", "count", "total ms", "mean ms", "queue ms");
+  out << line;
+  for (std::map<level_key, level_totals>::iterator i = levels.begin(); i != levels.end(); i++) {
+    const level_totals &t = i->second;
+    snprintf(line, sizeof(line), "%5d  %-28s %7d %12.4f %12.4f %12.4f\n",
+      i->first.first, i->first.second.c_str(), t.count, t.ms, t.ms / t.count, t.queue_ms / t.count);
+    out << line;
+  }
+  return out.str();
+}
@@ -0,0 +1,105 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "clwrapper.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * One traced command: a kernel launch or a transfer.
+ * Timestamps are the device's profiling counters (ns), read when the trace is resolved.
+ */
+struct trace_record {
+  std::string name;  // kernel function, or memcpy_to_dev/memcpy_from_dev/copy_buffer
+  bool kernel;       // false for transfers
+  int call;          // index of the (outermost) scan call that enqueued it
+  int depth;         // recursion level (0 is the array itself)
+  int n;             // elements at this level
+  size_t groups;     // workgroups launched (0 for transfers)
+  size_t bytes;      // bytes moved (0 for kernels)
+  cl_ulong queued, submit, start, end;
+  cl_event event;    // until resolved
+};
+
+/*
+ * Opt-in trace of the commands of Scan and SegmentedScan (see set_trace).
+ *
+ * Unlike get_timers, which sums each kernel over all levels and calls,
+ *   every enqueue is kept with its recursion level, length and workgroup count,
+ *   so we can see which level or which call is slow.
+ * The events are kept (retained) and only read when the trace is resolved,
+ *   so tracing non-blocking scans adds no waits.
+ * Timestamps need a profiling CLWrapper; without one they are all 0.
+ *
+ * The blocking helpers below are those of common/enqueue.h, recording the command;
+ *   they return its time in ms, as CLWrapper does.
+ * A Trace is not thread-safe; give each scan that runs concurrently its own.
+ */
+class Trace {
+  private:
+    std::vector<trace_record> records;
+    int calls;      // scan calls begun so far
+    int nesting;    // depth of begin_call
+
+    static cl_ulong profiling_info(cl_event e, cl_profiling_info param);
+    void finish(cl_event e, const std::string &name, bool kernel, int depth, int n,
+                size_t groups, size_t bytes);
+
+  public:
+    Trace();
+    ~Trace();
+
+    /*
+     * Bracket one scan call; nested calls (eg, a host scan calling the device scan)
+     *   count as one.
+     */
+    void begin_call() { if (nesting++ == 0) calls++; }
+    void end_call() { nesting--; }
+
+    // keep [e] (retained) as a command of the current call
+    void record(cl_event e, const std::string &name, bool kernel, int depth, int n,
+                size_t groups, size_t bytes);
+
+    static std::string kernel_name(cl_kernel k);
+
+    float run_kernel(cl_command_queue queue, cl_kernel k, size_t *gx, size_t *wx, int depth, int n);
+    float memcpy_to_dev(cl_command_queue queue, cl_mem buffer, size_t size, const void *ptr, int n);
+    float memcpy_from_dev(cl_command_queue queue, cl_mem buffer, size_t size, void *ptr, int n);
+    float copy_buffer(cl_command_queue queue, cl_mem src, cl_mem dst, size_t size, int n);
+
+    // wait for all recorded commands and read their timestamps
+    void resolve();
+    void clear();
+
+    size_t size() { return records.size(); }
+    const trace_record &at(size_t i) { resolve(); return records[i]; }
+
+    /*
+     * The trace as Chrome trace event JSON (chrome://tracing or ui.perfetto.dev).
+     * Transfers are on the first row and the kernels of each recursion level on their own row;
+     *   times are in us from the first command queued.
+     */
+    std::string chrome_json();
+    bool write_chrome_json(const std::string &path);
+
+    /*
+     * Table of the count, total and mean time of each command at each level,
+     *   and the mean delay from queued to start.
+     */
+    std::string level_summary();
+};
+
+/*
+ * Brackets a scan call of [trace] for the lifetime of the object (if [trace] is not NULL).
+ */
+class TraceCall {
+  private:
+    Trace *trace;
+
+  public:
+    TraceCall(Trace *trace) : trace(trace) { if (trace) trace->begin_call(); }
+    ~TraceCall() { if (trace) trace->end_call(); }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "tuning.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+TuningProfile::TuningProfile(const std::string &path) : path(path) {
+  std::ifstream file(path.c_str());
+  std::string line;
+  while (std::getline(file, line)) {
+    std::vector<std::string> field;
+    std::stringstream ss(line);
+    std::string f;
+    while (std::getline(ss, f, '|')) {
+      field.push_back(f);
+    }
+    if (field.size() != 7) {
+      continue; // skip anything we do not understand
+    }
+    tuning t;
+    t.wx = (size_t) atol(field[3].c_str());
+    t.items = atoi(field[4].c_str());
+    t.alg = atoi(field[5].c_str());
+    t.ms = (float) atof(field[6].c_str());
+    if (t.wx == 0 || t.items < 1) {
+      continue;
+    }
+    record(field[0], field[1], atoi(field[2].c_str()), t);
+  }
+}
+
+std::string TuningProfile::key(const std::string &device, const std::string &kind, int bucket) {
+  std::stringstream ss;
+  ss << device << "|" << kind << "|" << bucket;
+  return ss.str();
+}
+
+bool TuningProfile::lookup(const std::string &device, const std::string &kind, int n, tuning &t) const {
+  if (n > 0) {
+    std::map<std::string, tuning>::const_iterator i = entries.find(key(device, kind, tuning_bucket(n)));
+    if (i == entries.end()) {
+      return false;
+    }
+    t = i->second;
+    return true;
+  }
+  for (int bucket=30; bucket>=0; bucket--) {
+    std::map<std::string, tuning>::const_iterator i = entries.find(key(device, kind, bucket));
+    if (i != entries.end()) {
+      t = i->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TuningProfile::record(const std::string &device, const std::string &kind, int bucket, const tuning &t) {
+  std::string k = key(device, kind, bucket);
+  std::map<std::string, tuning>::iterator i = entries.find(k);
+  if (i == entries.end() || t.ms < i->second.ms) {
+    entries[k] = t;
+  }
+}
+
+void TuningProfile::forget(const std::string &device) {
+  std::string prefix = device + "|";
+  std::map<std::string, tuning>::iterator i = entries.begin();
+  while (i != entries.end()) {
+    if (i->first.compare(0, prefix.size(), prefix) == 0) {
+      entries.erase(i++);
+    } else {
+      i++;
+    }
+  }
+}
+
+/*
+ * Write to a temporary file and rename it so readers never see a partial profile.
+ */
+bool TuningProfile::save() const {
+  std::stringstream tmp;
+  tmp << path << "." << getpid() << ".tmp";
+  {
+    std::ofstream file(tmp.str().c_str());
+    if (!file) {
+      return false;
+    }
+    std::map<std::string, tuning>::const_iterator i;
+    for (i = entries.begin(); i != entries.end(); i++) {
+      const tuning &t = i->second;
+      file << i->first << "|" << t.wx << "|" << t.items << "|" << t.alg << "|" << t.ms << "\n";
+    }
+    if (!file) {
+      file.close();
+      unlink(tmp.str().c_str());
+      return false;
+    }
+  }
+  if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+    unlink(tmp.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+int tuning_bucket(int n) {
+  int bucket = 0;
+  while (n > 1) {
+    n >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+std::string tuning_profile_path() {
+  const char *env = getenv("SCAN_TUNING_PROFILE");
+  if (env) {
+    return std::string(env);
+  }
+  const char *home = getenv("HOME");
+  if (!home) {
+    return std::string("scan-tuning");
+  }
+  std::string dir = std::string(home) + "/.cache";
+  mkdir(dir.c_str(), 0755);
+  return dir + "/scan-tuning";
+}
+
+std::string tuning_device(CLWrapper &clw) {
+  size_t size = 0;
+  cl_device_id device = clw.get_device();
+  if (clGetDeviceInfo(device, CL_DEVICE_NAME, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+    return std::string("unknown");
+  }
+  std::vector<char> name(size);
+  if (clGetDeviceInfo(device, CL_DEVICE_NAME, size, &name[0], NULL) != CL_SUCCESS) {
+    return std::string("unknown");
+  }
+  return std::string(&name[0]);
+}
+
+bool find_tuning(CLWrapper &clw, const std::string &kind, int n, tuning &t) {
+  TuningProfile profile(tuning_profile_path());
+  return profile.lookup(tuning_device(clw), kind, n, t);
+}
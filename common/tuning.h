@@ -0,0 +1,82 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "clwrapper.h"
+#include "scanop.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+
+/*
+ * Tuned launch configurations, kept in a profile file.
+ *
+ * The profile records, for each device and kind of scan (eg, "scan long 0", see tuning_kind),
+ *   the fastest configuration found for each size bucket (n in [2^b, 2^(b+1))).
+ * autotune/ fills it in; Scan and SegmentedScan read it when constructed with wx=0.
+ *
+ * The file is $SCAN_TUNING_PROFILE, or ~/.cache/scan-tuning if unset.
+ * Each line is "device|kind|bucket|wx|items|algorithm|ms".
+ */
+struct tuning {
+  size_t wx;     // workgroup size
+  int items;     // elements per workitem
+  int alg;       // ScanBase::algorithm (0 where there is no choice)
+  float ms;      // time measured by the tuner
+};
+
+class TuningProfile {
+  private:
+    std::string path;
+    std::map<std::string, tuning> entries; // "device|kind|bucket" -> fastest configuration
+
+    static std::string key(const std::string &device, const std::string &kind, int bucket);
+
+  public:
+    TuningProfile(const std::string &path);
+
+    /*
+     * Configuration for arrays of length [n], or false if that bucket was never tuned.
+     * If [n] is 0 we return the largest tuned bucket.
+     */
+    bool lookup(const std::string &device, const std::string &kind, int n, tuning &t) const;
+
+    // keep [t] for [bucket] if it is faster than what we have
+    void record(const std::string &device, const std::string &kind, int bucket, const tuning &t);
+
+    // drop all entries of [device]
+    void forget(const std::string &device);
+
+    bool save() const;
+    bool empty() const { return entries.empty(); }
+};
+
+/*
+ * Size bucket of [n] ( = floor(log2 n) ).
+ */
+int tuning_bucket(int n);
+
+std::string tuning_profile_path();
+
+/*
+ * Name of the device of [clw], as used in the profile.
+ */
+std::string tuning_device(CLWrapper &clw);
+
+/*
+ * Kind of scan in the profile: the [name] of the scan, element type and operator,
+ *   eg, "scan int 0" for Scan.
+ */
+template <typename T, class Op>
+std::string tuning_kind(const char *name) {
+  std::stringstream ss;
+  ss << name << " " << cl_type<T>::name() << " " << Op::cl_id();
+  return ss.str();
+}
+
+/*
+ * Look up the tuned configuration of [kind] for arrays of length [n] on the device of [clw].
+ */
+bool find_tuning(CLWrapper &clw, const std::string &kind, int n, tuning &t);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Stream compaction and allocate-and-scatter (expand) built on a scan.
+ *
+ * T is the element type of the compacted values (set by the Compact constructor).
+ *
+ * Each workgroup of wx workitems handles a tile of m = 2*wx elements.
+ * We never store a scan of length [n]:
+ *   [count_tiles] writes the total count of each tile into [part],
+ *   the host scans [part] (see Scan) and
+ *   [compact_tiles]/[expand_tiles] redo the scan of each tile in local memory
+ *   and scatter directly to the output.
+ * [part] has length k+1 where the last element is zeroed by [count_tiles]
+ *   so that after the exclusive scan part[k] holds the grand total
+ *   (which the host reads back directly).
+ * The tile scans are the upsweep_pow2/scan_pow2 of common/localscan.cl on int counts.
+ */
+#define SCAN_T int
+#include "localscan.cl"
+
+/*
+ * Load the counts of the tile starting at [base] into local [x] (length m),
+ *   padding elements >= n with 0. If [predicate] then counts are 0 or 1.
+ */
+inline void load_counts(__global int *counts, __local int *x, int base, int n, int predicate) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    int c = (base+l < n) ? counts[base+l] : 0;
+    x[l] = predicate ? (c != 0) : c;
+  }
+}
+
+/*
+ * First pass: the total count of each tile into [part] (length k+1).
+ */
+__kernel void count_tiles(
+  __global int *counts, //length [n]
+  __global int *part,   //length [k+1]
+  __local  int *x,      //length [m]
+           int n,
+           int predicate
+) {
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = 2*get_local_size(0);
+  int k = get_num_groups(0);
+
+  load_counts(counts, x, grpid*m, n, predicate);
+  upsweep_pow2(x, m);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if (lid == 0) {
+    part[grpid] = x[m-1];
+    if (grpid == 0) {
+      part[k] = 0;
+    }
+  }
+}
+
+/*
+ * Second pass of [compact]: out[offset of i] = in[i] for each i with predicate[i] != 0.
+ * [part] is the exclusive scan of the tile counts.
+ */
+__kernel void compact_tiles(
+  __global T   *in,        //length [n]
+  __global int *predicate, //length [n]
+  __global T   *out,       //length [total]
+  __global int *part,      //length [k+1]
+  __local  int *x,         //length [m]
+           int n
+) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = 2*wx;
+  int base = grpid*m;
+
+  load_counts(predicate, x, base, n, /*predicate=*/1);
+  // keep our own flags before the scan overwrites them
+  int keep[2];
+  for (int i=0; i<2; i++) {
+    keep[i] = x[(i*wx) + lid];
+  }
+  scan_pow2(x, m);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  int offset = part[grpid];
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    if (keep[i]) {
+      out[offset + x[l]] = in[base+l];
+    }
+  }
+}
+
+/*
+ * As compact_tiles, also moving the int [keys] with the same offsets.
+ */
+__kernel void compact_pair_tiles(
+  __global T   *in,        //length [n]
+  __global int *keys,      //length [n]
+  __global int *predicate, //length [n]
+  __global T   *out,       //length [total]
+  __global int *keys_out,  //length [total]
+  __global int *part,      //length [k+1]
+  __local  int *x,         //length [m]
+           int n
+) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = 2*wx;
+  int base = grpid*m;
+
+  load_counts(predicate, x, base, n, /*predicate=*/1);
+  int keep[2];
+  for (int i=0; i<2; i++) {
+    keep[i] = x[(i*wx) + lid];
+  }
+  scan_pow2(x, m);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  int offset = part[grpid];
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    if (keep[i]) {
+      out[offset + x[l]] = in[base+l];
+      keys_out[offset + x[l]] = keys[base+l];
+    }
+  }
+}
+
+/*
+ * Second pass of [expand]: element i gets counts[i] consecutive slots of [out]
+ *   starting at its offset and writes its index i into each.
+ * Nothing is written if the total exceeds [capacity].
+ * [part] is the exclusive scan of the tile counts.
+ */
+__kernel void expand_tiles(
+  __global int *counts,    //length [n]
+  __global int *out,       //length [capacity]
+  __global int *part,      //length [k+1]
+  __local  int *x,         //length [m]
+           int capacity,
+           int n
+) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = 2*wx;
+  int k = get_num_groups(0);
+  int base = grpid*m;
+
+  if (part[k] > capacity) {
+    return;
+  }
+
+  load_counts(counts, x, base, n, /*predicate=*/0);
+  int count[2];
+  for (int i=0; i<2; i++) {
+    count[i] = x[(i*wx) + lid];
+  }
+  scan_pow2(x, m);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  int offset = part[grpid];
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    for (int j=0; j<count[i]; j++) {
+      out[offset + x[l] + j] = base+l;
+    }
+  }
+}
@@ -0,0 +1,124 @@
+#include "compact.h"
+#include "programcache.h"
+#include "scanop.h"
+
+#include <sstream>
+
+/*
+ * Source of compact.cl, or NULL to compile it from the working directory.
+ */
+#if EMBED_CL
+#include "compact.cl.h"
+static const char *compact_source = (const char *)&compact_cl;
+#else
+static const char *compact_source = NULL;
+#endif
+
+/*
+ * Count each subarray of [counts] (or its nonzero elements if [predicate])
+ *   and scan these counts. The returned buffer (length k+1) ends with the total.
+ */
+template <typename T>
+cl_mem BasicCompact<T>::tile_offsets(cl_mem counts, int n, bool predicate) {
+  int k = (n + m-1) / m;
+  size_t gx = k * wx;
+  cl_mem d_part = pool.acquire(sizeof(int)*(k+1));
+  clw.kernel_arg(count_tiles,
+    counts, d_part, sizeof(int)*m, n, (int) predicate);
+  k0 += clw.run_kernel_with_timing(count_tiles, /*dim=*/1, &gx, &wx);
+  scan.scan(d_part, k+1);
+  return d_part;
+}
+
+template <typename T>
+int BasicCompact<T>::compact(cl_mem in, cl_mem predicate, cl_mem out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  int k = (n + m-1) / m;
+  size_t gx = k * wx;
+  cl_mem d_part = tile_offsets(predicate, n, /*predicate=*/true);
+  clw.kernel_arg(compact_tiles,
+    in, predicate, out, d_part, sizeof(int)*m, n);
+  k1 += clw.run_kernel_with_timing(compact_tiles, /*dim=*/1, &gx, &wx);
+  int total = *(int *) pinned.read(d_part, sizeof(int), sizeof(int)*k);
+  pool.release(d_part);
+  return total;
+}
+
+template <typename T>
+int BasicCompact<T>::compact_pairs(cl_mem in, cl_mem keys, cl_mem predicate, cl_mem out,
+                                   cl_mem keys_out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  int k = (n + m-1) / m;
+  size_t gx = k * wx;
+  cl_mem d_part = tile_offsets(predicate, n, /*predicate=*/true);
+  clw.kernel_arg(compact_pair_tiles,
+    in, keys, predicate, out, keys_out, d_part, sizeof(int)*m, n);
+  k1 += clw.run_kernel_with_timing(compact_pair_tiles, /*dim=*/1, &gx, &wx);
+  int total = *(int *) pinned.read(d_part, sizeof(int), sizeof(int)*k);
+  pool.release(d_part);
+  return total;
+}
+
+template <typename T>
+int BasicCompact<T>::expand(cl_mem counts, cl_mem out, int capacity, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  int k = (n + m-1) / m;
+  size_t gx = k * wx;
+  cl_mem d_part = tile_offsets(counts, n, /*predicate=*/false);
+  clw.kernel_arg(expand_tiles,
+    counts, out, d_part, sizeof(int)*m, capacity, n);
+  k2 += clw.run_kernel_with_timing(expand_tiles, /*dim=*/1, &gx, &wx);
+  int total = *(int *) pinned.read(d_part, sizeof(int), sizeof(int)*k);
+  pool.release(d_part);
+  return total;
+}
+
+template <typename T>
+BasicCompact<T>::BasicCompact(CLWrapper &clw, size_t wx) : clw(clw), scan(clw, wx),
+  wx(wx), pool(clw), pinned(clw, sizeof(int)),
+  k0(0), k1(0), k2(0) {
+  m = wx * 2;
+  stringstream flags;
+  flags << "-D T=" << cl_type<T>::name() << cl_type<T>::options();
+  cl_program program = cached_program(clw, "compact.cl", compact_source, flags.str());
+  count_tiles = create_kernel(program, "count_tiles");
+  compact_tiles = create_kernel(program, "compact_tiles");
+  compact_pair_tiles = create_kernel(program, "compact_pair_tiles");
+  expand_tiles = create_kernel(program, "expand_tiles");
+}
+
+template <typename T>
+BasicCompact<T>::~BasicCompact() {
+  clReleaseKernel(count_tiles);
+  clReleaseKernel(compact_tiles);
+  clReleaseKernel(compact_pair_tiles);
+  clReleaseKernel(expand_tiles);
+  release_cached_programs(clw);
+}
+
+template <typename T>
+void BasicCompact<T>::reset_timers() {
+  k0 = k1 = k2 = 0;
+  scan.reset_timers();
+}
+
+template <typename T>
+void BasicCompact<T>::get_timers(map<string,float> &timings) {
+  if (clw.has_profiling()) {
+    timings.insert(make_pair("COMPACT1. count_tiles   ",   k0));
+    timings.insert(make_pair("COMPACT2. compact_tiles ",   k1));
+    timings.insert(make_pair("COMPACT3. expand_tiles  ",   k2));
+  }
+  scan.get_timers(timings);
+}
+
+template class BasicCompact<int>;
+template class BasicCompact<int64_t>;
+template class BasicCompact<float>;
+template class BasicCompact<double>;
@@ -0,0 +1,70 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "pinned.h"
+#include "scan.h"
+
+/*
+ * Stream compaction and allocate-and-scatter (expand) built on Scan.
+ *
+ * Both fuse the count pass, the scan and the scatter:
+ *   only the per-subarray counts are scanned (by Scan) and each subarray
+ *   rescans its own counts in local memory while scattering,
+ *   so no offsets array of length [n] is ever stored.
+ * The total is the last element of the scanned counts and comes back
+ *   with a single pinned readback.
+ *
+ * Compaction of elements of type [T]; instantiated for int, int64_t, float and double.
+ */
+template <typename T>
+class BasicCompact {
+  private:
+    CLWrapper &clw;
+    Scan scan;   // scans the per-subarray counts
+    cl_kernel count_tiles;
+    cl_kernel compact_tiles;
+    cl_kernel compact_pair_tiles;
+    cl_kernel expand_tiles;
+    size_t wx;   // workgroup size
+    int m;       // length of each subarray ( = wx*2 )
+    BufferPool pool;
+    PinnedBuffer pinned; // readback of the total
+
+    //timings
+    float k0; float k1; float k2; //kernels
+
+    cl_mem tile_offsets(cl_mem counts, int n, bool predicate);
+
+  public:
+    BasicCompact(CLWrapper &clw, size_t wx=256);
+    ~BasicCompact();
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    /*
+     * Write the elements in[i] with predicate[i] != 0 to the front of [out] (in order).
+     * Returns the number of elements written. [out] must have room for [n] elements.
+     */
+    int compact(cl_mem in, cl_mem predicate, cl_mem out, int n);
+
+    /*
+     * As above but also write the int keys[i] with predicate[i] != 0 to the front of
+     *   [keys_out], in one pass with the same offsets (eg, the keys and values of reducebykey/).
+     */
+    int compact_pairs(cl_mem in, cl_mem keys, cl_mem predicate, cl_mem out, cl_mem keys_out, int n);
+
+    /*
+     * Allocate counts[i] consecutive slots of [out] to each element i
+     *   (at the exclusive scan of [counts]) and write i into each of them.
+     * Returns the total number of slots.
+     * If this exceeds [capacity] nothing is written and the caller should
+     *   call again with a larger [out].
+     */
+    int expand(cl_mem counts, cl_mem out, int capacity, int n);
+};
+
+typedef BasicCompact<int> Compact;
+
+#endif
@@ -0,0 +1,187 @@
+#include "clwrapper.h"
+#include "compact.h"
+#include "programcache.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#define N 8
+
+TEST(Simple) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Compact c(clw, /*wx=*/4);
+  int x[N]            = { 3, 1, 7, 0, 4, 1, 6, 3 };
+  int p[N]            = { 1, 0, 1, 0, 0, 1, 1, 0 };
+  const int result[4] = { 3, 7, 1, 6 };
+  int y[N];
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*N);
+  cl_mem d_p = clw.dev_malloc(sizeof(int)*N);
+  cl_mem d_y = clw.dev_malloc(sizeof(int)*N);
+  clw.memcpy_to_dev(d_x, sizeof(int)*N, x);
+  clw.memcpy_to_dev(d_p, sizeof(int)*N, p);
+  int count = c.compact(d_x, d_p, d_y, N);
+  CHECK_EQUAL(4, count);
+  clw.memcpy_from_dev(d_y, sizeof(int)*count, y);
+  CHECK_ARRAY_EQUAL(result, y, count);
+  clw.dev_free(d_x);
+  clw.dev_free(d_p);
+  clw.dev_free(d_y);
+}
+
+template <typename T>
+void compact_test(int n, int wx) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicCompact<T> c(clw, wx);
+  T *x = new T[n];
+  int *p = new int[n];
+  T *y = new T[n];
+  T *result = new T[n];
+  for (int i=0; i<n; i++) {
+    x[i] = (T) rand_int(n) / (T) 2;
+  }
+  fill_random_data(p, n, 3);
+  int expected = 0;
+  for (int i=0; i<n; i++) {
+    if (p[i]) {
+      result[expected++] = x[i];
+    }
+  }
+  cl_mem d_x = clw.dev_malloc(sizeof(T)*n);
+  cl_mem d_p = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_y = clw.dev_malloc(sizeof(T)*n);
+  clw.memcpy_to_dev(d_x, sizeof(T)*n, x);
+  clw.memcpy_to_dev(d_p, sizeof(int)*n, p);
+  int count = c.compact(d_x, d_p, d_y, n);
+  CHECK_EQUAL(expected, count);
+  clw.memcpy_from_dev(d_y, sizeof(T)*count, y);
+  CHECK_ARRAY_EQUAL(result, y, count);
+  clw.dev_free(d_x);
+  clw.dev_free(d_p);
+  clw.dev_free(d_y);
+  delete[] x;
+  delete[] p;
+  delete[] y;
+  delete[] result;
+}
+
+TEST(Compact_1000) {
+  compact_test<int>(1000, 128);
+}
+
+TEST(Compact_1000001) {
+  compact_test<int>(1000001, 128);
+}
+
+TEST(Compact_Double_100000) {
+  compact_test<double>(100000, 64);
+}
+
+/*
+ * Values and int keys compacted together with the same offsets.
+ */
+TEST(CompactPairs_Double_100000) {
+  int n = 100000;
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicCompact<double> c(clw, /*wx=*/128);
+  double *x = new double[n];
+  int *keys = new int[n];
+  int *p = new int[n];
+  double *y = new double[n];
+  int *ykeys = new int[n];
+  double *result = new double[n];
+  int *rkeys = new int[n];
+  fill_random_data(keys, n, n);
+  fill_random_data(p, n, 3);
+  int expected = 0;
+  for (int i=0; i<n; i++) {
+    x[i] = (double) rand_int(n) / 2.0;
+    if (p[i]) {
+      result[expected] = x[i];
+      rkeys[expected++] = keys[i];
+    }
+  }
+  cl_mem d_x = clw.dev_malloc(sizeof(double)*n);
+  cl_mem d_keys = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_p = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_y = clw.dev_malloc(sizeof(double)*n);
+  cl_mem d_ykeys = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_x, sizeof(double)*n, x);
+  clw.memcpy_to_dev(d_keys, sizeof(int)*n, keys);
+  clw.memcpy_to_dev(d_p, sizeof(int)*n, p);
+  int count = c.compact_pairs(d_x, d_keys, d_p, d_y, d_ykeys, n);
+  CHECK_EQUAL(expected, count);
+  clw.memcpy_from_dev(d_y, sizeof(double)*count, y);
+  clw.memcpy_from_dev(d_ykeys, sizeof(int)*count, ykeys);
+  CHECK_ARRAY_EQUAL(result, y, count);
+  CHECK_ARRAY_EQUAL(rkeys, ykeys, count);
+  clw.dev_free(d_x);
+  clw.dev_free(d_keys);
+  clw.dev_free(d_p);
+  clw.dev_free(d_y);
+  clw.dev_free(d_ykeys);
+  delete[] x;
+  delete[] keys;
+  delete[] p;
+  delete[] y;
+  delete[] ykeys;
+  delete[] result;
+  delete[] rkeys;
+}
+
+TEST(Expand_Nutshell) {
+  // the example from the top-level README
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Compact c(clw, /*wx=*/4);
+  int counts[4]       = { 3, 0, 2, 1 };
+  const int result[6] = { 0, 0, 0, 2, 2, 3 };
+  int y[6];
+  cl_mem d_counts = clw.dev_malloc(sizeof(int)*4);
+  cl_mem d_y = clw.dev_malloc(sizeof(int)*6);
+  clw.memcpy_to_dev(d_counts, sizeof(int)*4, counts);
+  CHECK_EQUAL(6, c.expand(d_counts, d_y, /*capacity=*/6, 4));
+  clw.memcpy_from_dev(d_y, sizeof(int)*6, y);
+  CHECK_ARRAY_EQUAL(result, y, 6);
+  clw.dev_free(d_counts);
+  clw.dev_free(d_y);
+}
+
+TEST(Expand_Random_100000) {
+  int n = 100000;
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Compact c(clw, /*wx=*/128);
+  int *counts = new int[n];
+  fill_random_data(counts, n, 4);
+  int expected = 0;
+  for (int i=0; i<n; i++) {
+    expected += counts[i];
+  }
+  int *result = new int[expected];
+  for (int i=0, j=0; i<n; i++) {
+    for (int c=0; c<counts[i]; c++) {
+      result[j++] = i;
+    }
+  }
+  cl_mem d_counts = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_counts, sizeof(int)*n, counts);
+
+  // too small: nothing written but we learn the total
+  cl_mem d_small = clw.dev_malloc(sizeof(int)*n);
+  CHECK_EQUAL(expected, c.expand(d_counts, d_small, /*capacity=*/n, n));
+  clw.dev_free(d_small);
+
+  int *y = new int[expected];
+  cl_mem d_y = clw.dev_malloc(sizeof(int)*expected);
+  CHECK_EQUAL(expected, c.expand(d_counts, d_y, /*capacity=*/expected, n));
+  clw.memcpy_from_dev(d_y, sizeof(int)*expected, y);
+  CHECK_ARRAY_EQUAL(result, y, expected);
+  clw.dev_free(d_y);
+  clw.dev_free(d_counts);
+  delete[] counts;
+  delete[] result;
+  delete[] y;
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
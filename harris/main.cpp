@@ -15,7 +15,12 @@ void run(int *data, int n, int num_iter, map<string,float> &timings) {
 
   // BUILD PROGRAM AND KERNELS
   CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
-  Scan *s = new Scan(clw, opt.wx);
+  Scan *s = new Scan(clw, opt.wx, /*capacity_hint=*/n, Scan::to_algorithm(opt.variant),
+                     opt.items, opt.pad);
+  Trace trace;
+  if (opt.trace) {
+    s->set_trace(&trace);
+  }
 
   int *x = new int[n];
   for (int run=0; run<num_iter; run++) {
@@ -26,4 +31,10 @@ void run(int *data, int n, int num_iter, map<string,float> &timings) {
   delete[] x;
 
   s->get_timers(timings);
+  if (opt.trace) {
+    trace.write_chrome_json(opt.trace);
+    if (opt.verbose) {
+      cout << trace.level_summary();
+    }
+  }
 }
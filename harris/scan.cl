@@ -1,57 +1,132 @@
 /*
- * Inplace upsweep (reduce) on a local array [x] of length [m].
- * NB: [m] must be a power of two.
+ * Compile-time specialization (set by the Scan constructor).
+ *
+ * T is the element type, SCAN_OP the associative operator (one of OP_*)
+ *   and IDENTITY its identity element for T (see common/scanop.cl).
+ *   OP(a,b) is always applied with [a] the earlier (left) operand.
+ *
+ * ITEMS_PER_THREAD is the number of elements each workitem handles,
+ *   so each workgroup scans a subarray of length m = wx*ITEMS_PER_THREAD.
+ *   With 2 items we use the classic upsweep/sweepdown over the whole subarray.
+ *   Otherwise each workitem scans its items sequentially in registers and
+ *   the workgroup only upsweeps/sweepdowns the wx per-workitem totals.
+ * CONFLICT_FREE pads local arrays with one element every NUM_BANKS elements
+ *   so that the strided accesses of the tree phases avoid bank conflicts (HARRIS pg14).
+ *   Every local access goes through PAD, including the per-workitem loops of the
+ *   ITEMS_PER_THREAD != 2 tiles: workitem lid reads elements lid*ITEMS_PER_THREAD+i,
+ *   a stride that maps a warp onto distinct banks once padded for power of two
+ *   items up to NUM_BANKS (without padding 8 items would be an 8-way conflict).
+ *   Larger items leave some conflicts, eg, with 64 items lid*66 is a 2-way conflict.
+ */
+#include "scanop.cl"
+
+#ifndef ITEMS_PER_THREAD
+#define ITEMS_PER_THREAD 2
+#endif
+
+#ifndef CONFLICT_FREE
+#define CONFLICT_FREE 0
+#endif
+
+#define LOG_NUM_BANKS 5
+#if CONFLICT_FREE
+#define PAD(i) ((i) + ((i) >> LOG_NUM_BANKS))
+#else
+#define PAD(i) (i)
+#endif
+
+#include "localscan.cl"
+
+/*
+ * Subarray (tile) primitives shared by the kernels below.
+ * Each workgroup holds one subarray of length m = wx*ITEMS_PER_THREAD in local [x].
+ * When ITEMS_PER_THREAD != 2 we need a further local array of length wx
+ *   for the per-workitem totals, which we place directly after the subarray.
+ * Global loads and stores are coalesced (workitem lid touches lid, lid+wx, ...).
+ */
+inline __local T *tile_totals(__local T *x) {
+  int m = get_local_size(0) * ITEMS_PER_THREAD;
+  return &x[PAD(m-1)+1];
+}
+
+/*
+ * Load the subarray of [in] starting at [base] into [x], padding elements >= n with IDENTITY.
  */
-inline void upsweep_pow2(__local int *x, int m) {
+inline void load_tile(__global T *in, __local T *x, int base, int n) {
+  int wx = get_local_size(0);
   int lid = get_local_id(0);
-  int bi = (lid*2)+1;
+  for (int i=0; i<ITEMS_PER_THREAD; i++) {
+    int l = (i*wx) + lid;
+    x[PAD(l)] = (base+l < n) ? in[base+l] : IDENTITY;
+  }
+}
 
-  int depth = 1 + (int) log2((float)m);
-  for (int d=0; d<depth; d++) {
-    barrier(CLK_LOCAL_MEM_FENCE);
-    int mask = (0x1 << d) - 1;
-    if ((lid & mask) == mask) {
-      int offset = (0x1 << d);
-      int ai = bi - offset;
-      x[bi] += x[ai];
+/*
+ * Store OP([offset], [x]) to the subarray of [out] starting at [base], skipping elements >= n.
+ */
+inline void store_tile(__global T *out, __local T *x, int base, int n, T offset) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int i=0; i<ITEMS_PER_THREAD; i++) {
+    int l = (i*wx) + lid;
+    if (base+l < n) {
+      out[base+l] = OP(offset, x[PAD(l)]);
     }
   }
 }
 
 /*
- * Inplace sweepdown on a local array [x] of length [m].
- * NB: [m] must be a power of two.
+ * Reduce phase of a subarray scan.
+ * Afterwards the subarray total is at *tile_root(x), which may be read and
+ *   overwritten (with IDENTITY for an exclusive scan) by the last workitem.
  */
-inline void sweepdown_pow2(__local int *x, int m) {
+inline void upsweep_tile(__local T *x) {
+  int wx = get_local_size(0);
+#if ITEMS_PER_THREAD == 2
+  upsweep_pow2(x, 2*wx);
+#else
   int lid = get_local_id(0);
-  int bi = (lid*2)+1;
-
-  int depth = (int) log2((float)m);
-  for (int d=depth; d>-1; d--) {
-    barrier(CLK_LOCAL_MEM_FENCE);
-    int mask = (0x1 << d) - 1;
-    if ((lid & mask) == mask) {
-      int offset = (0x1 << d);
-      int ai = bi - offset;
-      int tmp = x[ai];
-                x[ai] = x[bi];
-                        x[bi] += tmp;
-    }
+  __local T *t = tile_totals(x);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  T sum = IDENTITY;
+  for (int i=0; i<ITEMS_PER_THREAD; i++) {
+    sum = OP(sum, x[PAD((lid*ITEMS_PER_THREAD)+i)]);
   }
+  t[PAD(lid)] = sum;
+  upsweep_pow2(t, wx);
+#endif
+}
+
+inline __local T *tile_root(__local T *x) {
+  int wx = get_local_size(0);
+#if ITEMS_PER_THREAD == 2
+  return &x[PAD((2*wx)-1)];
+#else
+  return &tile_totals(x)[PAD(wx-1)];
+#endif
 }
 
 /*
- * Inplace scan on a local array [x] of length [m].
- * NB: m must be a power of two.
+ * Sweepdown phase of a subarray scan (following upsweep_tile).
  */
-inline void scan_pow2(__local int *x, int m) {
+inline void sweepdown_tile(__local T *x) {
+  int wx = get_local_size(0);
+#if ITEMS_PER_THREAD == 2
+  sweepdown_pow2(x, 2*wx);
+#else
   int lid = get_local_id(0);
-  int lane1 = (lid*2)+1;
-  upsweep_pow2(x, m);
-  if (lane1 == (m-1)) {
-    x[lane1] = 0;
+  __local T *t = tile_totals(x);
+  sweepdown_pow2(t, wx);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  T sum = t[PAD(lid)];
+  for (int i=0; i<ITEMS_PER_THREAD; i++) {
+    int l = (lid*ITEMS_PER_THREAD)+i;
+    T tmp = x[PAD(l)];
+            x[PAD(l)] = sum;
+                        sum = OP(sum, tmp);
   }
-  sweepdown_pow2(x, m);
+#endif
 }
 
 /*
@@ -61,151 +136,330 @@ inline void scan_pow2(__local int *x, int m) {
  * NB: [m] must be a power of two, and
  *     there must be exactly one workgroup of size m/2
  */
-__kernel void scan_pow2_wrapper(__global int *data, __local int *x, int m) {
+__kernel void scan_pow2_wrapper(__global T *data, __local T *x, int m) {
   int gid = get_global_id(0);
   int lane0 = (gid*2);
   int lane1 = (gid*2)+1;
 
   // load data into local arrays
-  x[lane0] = data[lane0];
-  x[lane1] = data[lane1];
+  x[PAD(lane0)] = data[lane0];
+  x[PAD(lane1)] = data[lane1];
 
   // inplace local scan
   scan_pow2(x, m);
 
   // writeback data
-  data[lane0] = x[lane0];
-  data[lane1] = x[lane1];
+  data[lane0] = x[PAD(lane0)];
+  data[lane1] = x[PAD(lane1)];
 }
 
-__kernel void scan_pad_to_pow2(__global int *data, __local int * x, int n) {
-  int gid = get_global_id(0);
-  int lane0 = (gid*2);
-  int lane1 = (gid*2)+1;
-  int m = 2*get_local_size(0);
+/*
+ * Scan of a global array [in] of length [n] into [out] using a single workgroup.
+ * [in] and [out] may be the same buffer.
+ * The reduction of all [n] elements is written to [reduction] (length 1).
+ * NB: We assume n <= m, and
+ *     there must be exactly one workgroup of size m/ITEMS_PER_THREAD
+ */
+__kernel void scan_pad_to_pow2(__global T *in, __global T *out, __global T *reduction, __local T * x, int n) {
+  int lid = get_local_id(0);
+  int wx = get_local_size(0);
 
-  x[lane0] = lane0 < n ? data[lane0] : 0;
-  x[lane1] = lane1 < n ? data[lane1] : 0;
+  load_tile(in, x, 0, n);
 
-  upsweep_pow2(x, m);
-  if (lane1 == (m-1)) {
-    x[lane1] = 0;
+  upsweep_tile(x);
+  if (lid == (wx-1)) {
+    *reduction = *tile_root(x);
+    *tile_root(x) = IDENTITY;
   }
-  sweepdown_pow2(x, m);
+  sweepdown_tile(x);
 
-  if (lane0 < n)
-    data[lane0] = x[lane0];
-  if (lane1 < n)
-    data[lane1] = x[lane1];
+  store_tile(out, x, 0, n, IDENTITY);
 }
 
 /*
  * First phase of a multiblock scan.
  *
- * Given a global array [data] of length arbitrary length [n].
- * We assume that we have k workgroups each of size m/2 workitems.
- * Each workgroup handles a subarray of length [m] (where m is a power of two).
- * The last subarray will be padded with 0 if necessary (n < k*m).
+ * Given a global array [in] of length arbitrary length [n], writing to [out].
+ * [in] and [out] may be the same buffer; only the first [n] elements are touched.
+ * We assume that we have k workgroups each of size m/ITEMS_PER_THREAD workitems.
+ * Each workgroup handles a subarray of length [m].
+ * The last subarray will be padded with IDENTITY if necessary (n < k*m).
  * We use the primitives above to perform a scan operation within each subarray.
- * We store the intermediate reduction of each subarray (following upsweep_pow2) in [part].
+ * We store the intermediate reduction of each subarray (following upsweep_tile) in [part].
  * These partial values can themselves be scanned and fed into [scan_inc_subarrays].
  */
 __kernel void scan_subarrays(
-  __global int *data, //length [n]
-  __local  int *x,    //length [m]
-  __global int *part, //length [m]
+  __global T *in,   //length [n]
+  __global T *out,  //length [n]
+  __local  T *x,    //length [m] (plus padding)
+  __global T *part, //length [k]
            int n
 #if DEBUG
-  , __global int *debug   //length [k*m]
+  , __global T *debug   //length [k*m]
 #endif
 ) {
   // workgroup size
   int wx = get_local_size(0);
-  // global identifiers and indexes
-  int gid = get_global_id(0);
-  int lane0 = (2*gid)  ;
-  int lane1 = (2*gid)+1;
   // local identifiers and indexes
   int lid = get_local_id(0);
-  int local_lane0 = (2*lid)  ;
-  int local_lane1 = (2*lid)+1;
   int grpid = get_group_id(0);
   // list lengths
-  int m = wx * 2;
-  int k = get_num_groups(0);
+  int m = wx * ITEMS_PER_THREAD;
+  int base = grpid * m;
 
-  // copy into local data padding elements >= n with 0
-  x[local_lane0] = (lane0 < n) ? data[lane0] : 0;
-  x[local_lane1] = (lane1 < n) ? data[lane1] : 0;
+  // copy into local data padding elements >= n with IDENTITY
+  load_tile(in, x, base, n);
 
   // ON EACH SUBARRAY
   // a reduce on each subarray
-  upsweep_pow2(x, m);
+  upsweep_tile(x);
   // last workitem per workgroup saves last element of each subarray in [part] before zeroing
   if (lid == (wx-1)) {
-    part[grpid] = x[local_lane1];
-                  x[local_lane1] = 0;
+    part[grpid] = *tile_root(x);
+                  *tile_root(x) = IDENTITY;
   }
   // a sweepdown on each subarray
-  sweepdown_pow2(x, m);
+  sweepdown_tile(x);
 
   // copy back to global data
-  if (lane0 < n) {
-    data[lane0] = x[local_lane0];
-  }
-  if (lane1 < n) {
-    data[lane1] = x[local_lane1];
-  }
+  store_tile(out, x, base, n, IDENTITY);
 
 #if DEBUG
-  debug[lane0] = x[local_lane0];
-  debug[lane1] = x[local_lane1];
+  store_tile(debug, x, base, (grpid+1)*m, IDENTITY);
 #endif
 }
 
 /*
  * Perform the second phase of an inplace exclusive scan on a global array [data] of arbitrary length [n].
  *
- * We assume that we have k workgroups each of size m/2 workitems.
- * Each workgroup handles a subarray of length [m] (where m is a power of two).
- * We sum each element by the sum of the preceding subarrays taken from [part].
+ * We assume that we have k workgroups each of size m/ITEMS_PER_THREAD workitems.
+ * Each workgroup handles a subarray of length [m].
+ * We combine each element with the reduction of the preceding subarrays taken from [part].
  */
 __kernel void scan_inc_subarrays(
-  __global int *data, //length [n]
-  __local  int *x,    //length [m]
-  __global int *part, //length [m]
+  __global T *data, //length [n]
+  __global T *part, //length [k]
            int n
-#if DEBUG
-  , __global int *debug   //length [k*m]
-#endif
 ) {
-  // global identifiers and indexes
-  int gid = get_global_id(0);
-  int lane0 = (2*gid)  ;
-  int lane1 = (2*gid)+1;
+  // workgroup size
+  int wx = get_local_size(0);
   // local identifiers and indexes
   int lid = get_local_id(0);
-  int local_lane0 = (2*lid)  ;
-  int local_lane1 = (2*lid)+1;
   int grpid = get_group_id(0);
+  // list lengths
+  int m = wx * ITEMS_PER_THREAD;
+  int base = grpid * m;
+
+  T offset = part[grpid];
+  for (int i=0; i<ITEMS_PER_THREAD; i++) {
+    int g = base + (i*wx) + lid;
+    if (g < n) {
+      data[g] = OP(offset, data[g]);
+    }
+  }
+}
+
+/*
+ * Tile status for the single-pass scan.
+ */
+#define TILE_EMPTY     0 // tile has not published anything yet
+#define TILE_AGGREGATE 1 // tile has published the reduction of its own elements
+#define TILE_PREFIX    2 // tile has published the reduction of all elements up to and including itself
+
+/*
+ * Reset the tile counter and flags of the [status] array used by [scan_lookback] for k tiles.
+ */
+__kernel void scan_lookback_init(__global int *status, int k) {
+  int gid = get_global_id(0);
+  if (gid < k+1) {
+    status[gid] = 0;
+  }
+}
+
+/*
+ * Single-pass scan of a global array [in] of arbitrary length [n] into [out]
+ *   using decoupled look-back (MERRILL AND GARLAND).
+ * [in] and [out] may be the same buffer.
+ *
+ * We assume k workgroups each of size m/ITEMS_PER_THREAD workitems,
+ *   [status] of length 1+k initialised by [scan_lookback_init], and [value] of length 2k:
+ *   status[0]           counter used to hand out tiles in launch order
+ *   status[1..k]        flag of each tile (TILE_*)
+ *   value[0..k-1]       aggregate of each tile
+ *   value[k..2k-1]      inclusive prefix of each tile
+ * Tiles are numbered by the order in which workgroups start (not get_group_id)
+ *   so every tile we wait on is already running.
+ *
+ * Each workgroup reduces its tile (upsweep) and publishes the aggregate.
+ * The last workitem then walks backwards over its predecessors,
+ *   combining aggregates until it finds a published inclusive prefix.
+ * The tile publishes its own inclusive prefix and finishes with a local sweepdown,
+ *   so [in] is read once and [out] written once.
+ * The last tile writes its inclusive prefix, the reduction of all [n] elements, to [reduction].
+ */
+__kernel void scan_lookback(
+  __global T *in,                 //length [n]
+  __global T *out,                //length [n]
+  __local  T *x,                  //length [m] (plus padding)
+  __global volatile int *status,  //length [1+k]
+  __global volatile T *value,     //length [2k]
+  __global T *reduction,          //length [1]
+           int n
+) {
+  __local int tile;
+  __local T exclusive;
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int m = wx * ITEMS_PER_THREAD;
+  int k = get_num_groups(0);
+  __global volatile int *flag      = &status[1];
+  __global volatile T *aggregate   = &value[0];
+  __global volatile T *prefix      = &value[k];
+
+  if (lid == 0) {
+    tile = atomic_inc(&status[0]);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  int base = tile * m;
 
-  // copy into local data padding elements >= n with identity
-  x[local_lane0] = (lane0 < n) ? data[lane0] : 0;
-  x[local_lane1] = (lane1 < n) ? data[lane1] : 0;
+  // copy into local data padding elements >= n with IDENTITY
+  load_tile(in, x, base, n);
 
-  x[local_lane0] += part[grpid];
-  x[local_lane1] += part[grpid];
+  upsweep_tile(x);
+
+  if (lid == (wx-1)) {
+    T total = *tile_root(x);
+    T sum = IDENTITY;
+    if (tile == 0) {
+      prefix[0] = total;
+      write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+      atomic_xchg(&flag[0], TILE_PREFIX);
+    } else {
+      aggregate[tile] = total;
+      write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+      atomic_xchg(&flag[tile], TILE_AGGREGATE);
+
+      // look-back
+      int pred = tile - 1;
+      while (true) {
+        int f = atomic_add(&flag[pred], 0);
+        if (f == TILE_EMPTY) {
+          continue;
+        }
+        read_mem_fence(CLK_GLOBAL_MEM_FENCE);
+        if (f == TILE_PREFIX) {
+          sum = OP(prefix[pred], sum);
+          break;
+        }
+        sum = OP(aggregate[pred], sum);
+        pred--;
+      }
+
+      prefix[tile] = OP(sum, total);
+      write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+      atomic_xchg(&flag[tile], TILE_PREFIX);
+    }
+    if (tile == k-1) {
+      *reduction = OP(sum, total);
+    }
+    exclusive = sum;
+    *tile_root(x) = IDENTITY;
+  }
+  sweepdown_tile(x);
 
   // copy back to global data
-  if (lane0 < n) {
-    data[lane0] = x[local_lane0];
+  store_tile(out, x, base, n, exclusive);
+}
+
+/*
+ * Inplace scan of elements [start, end) of [data] by one workgroup.
+ * An array that fits in one subarray is the single pass of scan_pad_to_pow2;
+ *   longer arrays are scanned one subarray at a time, carrying the running total.
+ */
+inline void scan_range(__global T *data, __local T *x, int start, int end) {
+  int lid = get_local_id(0);
+  int wx = get_local_size(0);
+  int m = wx * ITEMS_PER_THREAD;
+  T carry = IDENTITY;
+  for (int base=start; base<end; base+=m) {
+    load_tile(data, x, base, end);
+    upsweep_tile(x);
+    // every workitem needs the subarray total before the root is cleared
+    barrier(CLK_LOCAL_MEM_FENCE);
+    T total = *tile_root(x);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == (wx-1)) {
+      *tile_root(x) = IDENTITY;
+    }
+    sweepdown_tile(x);
+    store_tile(data, x, base, end, carry);
+    carry = OP(carry, total);
   }
-  if (lane1 < n) {
-    data[lane1] = x[local_lane1];
+}
+
+/*
+ * Batched scan of [narrays] independent arrays packed in [data] (inplace).
+ * Workgroup g scans array g, which spans offsets[g] up to (but excluding)
+ *   offsets[g+1], or [n] for the last array.
+ */
+__kernel void scan_batch_offsets(
+  __global T   *data,    //length [n]
+  __global int *offsets, //length [narrays]
+  __local  T   *x,       //length [m] (plus padding)
+           int narrays,
+           int n
+) {
+  int grpid = get_group_id(0);
+  int start = offsets[grpid];
+  int end = (grpid+1 < narrays) ? offsets[grpid+1] : n;
+  scan_range(data, x, start, min(end, n));
+}
+
+/*
+ * Batched scan of [narrays] arrays of the same [length] stored one after another (inplace).
+ */
+__kernel void scan_batch_uniform(
+  __global T   *data,    //length [narrays*length]
+  __local  T   *x,       //length [m] (plus padding)
+           int length
+) {
+  int grpid = get_group_id(0);
+  int start = grpid * length;
+  scan_range(data, x, start, start + length);
+}
+
+/*
+ * Combine [carry] into each of the [n] elements of [data] (see BasicScan::add_carry).
+ */
+__kernel void scan_add_offset(
+  __global T *data,  //length [n]
+           T carry,
+           int n
+) {
+  int gid = get_global_id(0);
+  if (gid < n) {
+    data[gid] = OP(carry, data[gid]);
   }
+}
 
-#if DEBUG
-  debug[lane0] = x[local_lane0];
-  debug[lane1] = x[local_lane1];
-#endif
+/*
+ * Streaming scan: add the running total of earlier chunks [carry_in] to the scanned
+ *   chunk [data] and pass on the running total including this chunk
+ *   ([total] is the chunk's reduction) in [carry_out].
+ */
+__kernel void scan_add_carry(
+  __global T *data,      //length [n]
+  __global T *carry_in,  //length 1
+  __global T *carry_out, //length 1
+  __global T *total,     //length 1
+           int n
+) {
+  int gid = get_global_id(0);
+  T carry = *carry_in;
+  if (gid < n) {
+    data[gid] = OP(carry, data[gid]);
+  }
+  if (gid == 0) {
+    *carry_out = OP(carry, *total);
+  }
 }
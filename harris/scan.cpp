@@ -1,77 +1,757 @@
 #include "scan.h"
+#include "enqueue.h"
+#include "programcache.h"
+#include "tuning.h"
 
-#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
 
-void Scan::scan(int *data, int n) {
-  int k = (int) ceil((float)n/(float)m);
-  cl_mem d_data = clw.dev_malloc(sizeof(int)*k*m);
-  m0 += clw.memcpy_to_dev(d_data, sizeof(int)*n, data);
-  recursive_scan(d_data, n);
-  m1 += clw.memcpy_from_dev(d_data, sizeof(int)*n, data);
-  clw.dev_free(d_data);
+/*
+ * Source of scan.cl, or NULL to compile it from the working directory.
+ */
+#if EMBED_CL
+#include "scan.cl.h"
+static const char *scan_source = (const char *)&scan_cl;
+#else
+static const char *scan_source = NULL;
+#endif
+
+ScanBase::algorithm ScanBase::to_algorithm(int a, algorithm fallback) {
+  if (a == RECURSIVE || a == LOOKBACK) {
+    return (algorithm) a;
+  }
+  fprintf(stderr, "Unknown scan algorithm %d, using %d.\n", a, (int) fallback);
+  return fallback;
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(T *data, int n) {
+  TraceCall call(trace);
+  cl_mem d_host = wrap_host(data, n);
+  if (d_host) {
+    recursive_scan(d_host, d_host, n, d_reduction);
+    unwrap_host(d_host, n);
+    return;
+  }
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  recursive_scan(d_data, d_data, n, d_reduction);
+  download(d_data, sizeof(T)*n, data, n, m1);
+  pool.release(d_data);
+}
+
+/*
+ * As above but also returns the reduction of all [n] elements in [total].
+ * The total is a by-product of the scan; we only add a tiny pinned readback.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(T *data, int n, T *total) {
+  TraceCall call(trace);
+  scan(data, n);
+  *total = read_reduction();
+}
+
+/*
+ * Inplace scan of a device buffer.
+ * The kernels never touch elements beyond [n] so we scan the caller's buffer directly.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(cl_mem data, int n) {
+  TraceCall call(trace);
+  recursive_scan(data, data, n, d_reduction);
+}
+
+/*
+ * Out-of-place scan of device buffer [in] into [out] (both of length [n]).
+ * [in] is left unchanged.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(cl_mem in, cl_mem out, int n) {
+  TraceCall call(trace);
+  recursive_scan(in, out, n, d_reduction);
+}
+
+/*
+ * Scan of device buffers that also returns the reduction of all [n] elements in [total].
+ * [in] and [out] may be the same buffer.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(cl_mem in, cl_mem out, int n, T *total) {
+  TraceCall call(trace);
+  recursive_scan(in, out, n, d_reduction);
+  *total = read_reduction();
+}
+
+/*
+ * Scan of device buffers that writes the reduction of all [n] elements to
+ *   device buffer [total] (length 1) without any readback.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan(cl_mem in, cl_mem out, int n, cl_mem total) {
+  TraceCall call(trace);
+  recursive_scan(in, out, n, total);
+}
+
+/*
+ * The carry is a kernel argument, so there is no upload and no scratch buffer.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::add_carry(cl_mem data, int n, T carry) {
+  if (n < 1) {
+    return;
+  }
+  TraceCall call(trace);
+  level = 0;
+  level_n = n;
+  size_t gx = ((n + wx-1) / wx) * wx;
+  clw.kernel_arg(scan_add_offset,
+    data, carry, n);
+  run_kernel(scan_add_offset, &gx, k5);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_batch(T *data, int n, int *offsets, int narrays) {
+  TraceCall call(trace);
+  cl_mem d_offsets = pool.acquire(sizeof(int)*narrays);
+  upload(d_offsets, sizeof(int)*narrays, offsets, narrays, m0);
+  cl_mem d_host = wrap_host(data, n);
+  if (d_host) {
+    scan_batch(d_host, n, d_offsets, narrays);
+    unwrap_host(d_host, n);
+  } else {
+    cl_mem d_data = pool.acquire(sizeof(T)*n);
+    upload(d_data, sizeof(T)*n, data, n, m0);
+    scan_batch(d_data, n, d_offsets, narrays);
+    download(d_data, sizeof(T)*n, data, n, m1);
+    pool.release(d_data);
+  }
+  pool.release(d_offsets);
+}
+
+/*
+ * Arrays longer than a subarray are handled by looping within their workgroup,
+ *   so there is no recursion and no partial buffer whatever the lengths.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_batch(cl_mem data, int n, cl_mem offsets, int narrays) {
+  if (narrays < 1) {
+    return;
+  }
+  TraceCall call(trace);
+  level = 0;
+  level_n = n;
+  size_t gx = narrays * wx;
+  clw.kernel_arg(scan_batch_offsets,
+    data, offsets, local_bufsize(), narrays, n);
+  run_kernel(scan_batch_offsets, &gx, k4);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_batch(T *data, int length, int narrays) {
+  TraceCall call(trace);
+  int n = length * narrays;
+  cl_mem d_host = wrap_host(data, n);
+  if (d_host) {
+    scan_batch(d_host, length, narrays);
+    unwrap_host(d_host, n);
+    return;
+  }
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  scan_batch(d_data, length, narrays);
+  download(d_data, sizeof(T)*n, data, n, m1);
+  pool.release(d_data);
 }
 
-void Scan::scan(cl_mem data, int n) {
-  int k = (int) ceil((float)n/(float)m);
-  cl_mem d_data = clw.dev_malloc(sizeof(int)*k*m);
-  c0 += clw.copy_buffer(data, d_data, sizeof(int)*n);
-  recursive_scan(d_data, n);
-  c1 += clw.copy_buffer(d_data, data, sizeof(int)*n);
-  clw.dev_free(d_data);
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_batch(cl_mem data, int length, int narrays) {
+  if (narrays < 1 || length < 1) {
+    return;
+  }
+  TraceCall call(trace);
+  level = 0;
+  level_n = length * narrays;
+  size_t gx = narrays * wx;
+  clw.kernel_arg(scan_batch_uniform,
+    data, local_bufsize(), length);
+  run_kernel(scan_batch_uniform, &gx, k4);
+}
+
+/*
+ * The staging and partial buffers are kept from the pool until the last command is done;
+ *   a later command on another queue (eg, scan_stream's uploads) could otherwise take
+ *   one that is still being scanned.
+ */
+template <typename T, class Op>
+cl_event BasicScan<T,Op>::scan_async(T *data, int n, cl_event wait) {
+  TraceCall call(trace);
+  release_in_flight(/*wait=*/false);
+  defer = true;
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueWriteBuffer(queue, d_data, CL_FALSE, 0, sizeof(T)*n, data,
+      wait ? 1 : 0, wait ? &wait : NULL, &e));
+  record_transfer(e, "memcpy_to_dev", n, sizeof(T)*n);
+  last_event = NULL;
+  chain(e, m0);
+  async = true;
+  recursive_scan(d_data, d_data, n, d_reduction);
+  async = false;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueReadBuffer(queue, d_data, CL_FALSE, 0, sizeof(T)*n, data,
+      1, &last_event, &e));
+  record_transfer(e, "memcpy_from_dev", n, sizeof(T)*n);
+  chain(e, m1);
+  release(d_data);
+  e = last_event;
+  last_event = NULL;
+  hold_deferred(e);
+  return e;
+}
+
+template <typename T, class Op>
+cl_event BasicScan<T,Op>::scan_async(cl_mem in, cl_mem out, int n, cl_event wait) {
+  TraceCall call(trace);
+  release_in_flight(/*wait=*/false);
+  if (wait) {
+    ASSERT_NO_CL_ERROR(clRetainEvent(wait));
+  }
+  last_event = wait;
+  defer = true;
+  async = true;
+  recursive_scan(in, out, n, d_reduction);
+  async = false;
+  cl_event e = last_event;
+  last_event = NULL;
+  hold_deferred(e);
+  return e;
+}
+
+/*
+ * Each chunk is uploaded into the next of [nbuffers] rotating device buffers (once the
+ *   download of the chunk that last used it is done), scanned behind its upload on the
+ *   main queue, offset by the carry of the chunks before it and downloaded behind that.
+ * So with three buffers the upload of one chunk, the scan of the next and the download
+ *   of the one after can all be in flight. Device memory is bounded by the buffers
+ *   and the partials of one chunk whatever [n].
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_stream(T *data, int64_t n, int chunk, int nbuffers) {
+  scan_stream(data, data, n, chunk, nbuffers);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::scan_stream(const T *in, T *out, int64_t n, int chunk, int nbuffers) {
+  if (n < 1) {
+    return;
+  }
+  TraceCall call(trace);
+  create_stream_queues();
+  int64_t nchunks = (n + chunk-1) / chunk;
+  int nbuf = (int) min((int64_t) max(nbuffers, 1), nchunks);
+  vector<cl_mem> d_buf(nbuf);
+  vector<cl_event> downloaded(nbuf, (cl_event) NULL);
+  for (int i=0; i<nbuf; i++) {
+    d_buf[i] = pool.acquire(sizeof(T)*chunk);
+  }
+  cl_mem d_carry[2] = { pool.acquire(sizeof(T)), pool.acquire(sizeof(T)) };
+  T identity = Op::identity();
+  upload(d_carry[0], sizeof(T), &identity, 1, m0);
+
+  async = true;
+  last_event = NULL;
+  for (int64_t c=0; c<nchunks; c++) {
+    int slot = (int) (c % nbuf);
+    int64_t offset = c * chunk;
+    int len = (int) min((int64_t) chunk, n - offset);
+    size_t gx = ((len + wx-1) / wx) * wx;
+    cl_event uploaded;
+    ASSERT_NO_CL_ERROR(
+      clEnqueueWriteBuffer(upload_queue, d_buf[slot], CL_FALSE, 0, sizeof(T)*len, &in[offset],
+        downloaded[slot] ? 1 : 0, downloaded[slot] ? &downloaded[slot] : NULL, &uploaded));
+    ASSERT_NO_CL_ERROR(clFlush(upload_queue));
+    if (downloaded[slot]) {
+      ASSERT_NO_CL_ERROR(clReleaseEvent(downloaded[slot]));
+    }
+    record_transfer(uploaded, "memcpy_to_dev", len, sizeof(T)*len);
+    chain(uploaded, m0);
+    recursive_scan(d_buf[slot], d_buf[slot], len, d_reduction);
+    clw.kernel_arg(scan_add_carry,
+      d_buf[slot], d_carry[c & 1], d_carry[(c+1) & 1], d_reduction, len);
+    run_kernel(scan_add_carry, &gx, k5);
+    ASSERT_NO_CL_ERROR(clFlush(queue));
+    ASSERT_NO_CL_ERROR(
+      clEnqueueReadBuffer(download_queue, d_buf[slot], CL_FALSE, 0, sizeof(T)*len, &out[offset],
+        1, &last_event, &downloaded[slot]));
+    ASSERT_NO_CL_ERROR(clFlush(download_queue));
+    record_transfer(downloaded[slot], "memcpy_from_dev", len, sizeof(T)*len);
+    track(downloaded[slot], m1);
+  }
+  async = false;
+
+  for (int i=0; i<nbuf; i++) {
+    ASSERT_NO_CL_ERROR(clWaitForEvents(1, &downloaded[i]));
+    ASSERT_NO_CL_ERROR(clReleaseEvent(downloaded[i]));
+    pool.release(d_buf[i]);
+  }
+  ASSERT_NO_CL_ERROR(clReleaseEvent(last_event));
+  last_event = NULL;
+  pool.release(d_carry[0]);
+  pool.release(d_carry[1]);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::create_stream_queues() {
+  if (upload_queue) {
+    return;
+  }
+  cl_int err;
+  cl_command_queue_properties props = clw.has_profiling() ? CL_QUEUE_PROFILING_ENABLE : 0;
+  upload_queue = clCreateCommandQueue(clw.get_context(), clw.get_device(), props, &err);
+  ASSERT_NO_CL_ERROR(err);
+  download_queue = clCreateCommandQueue(clw.get_context(), clw.get_device(), props, &err);
+  ASSERT_NO_CL_ERROR(err);
+}
+
+/*
+ * Run kernel [k] over [gx] workitems and add its time to [timer].
+ * Blocking scans wait for each kernel. Under scan_async we only enqueue it
+ *   behind [last_event] and time it later from its event.
+ * Traced kernels are recorded at the current [level].
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::run_kernel(cl_kernel k, size_t *gx, float &timer) {
+  if (!async) {
+    timer += trace ? trace->run_kernel(queue, k, gx, &wx, level, level_n)
+                   : run_kernel_on(queue, k, gx, &wx);
+    return;
+  }
+  cl_event e;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueNDRangeKernel(queue, k, /*dim=*/1, NULL, gx, &wx,
+      last_event ? 1 : 0, last_event ? &last_event : NULL, &e));
+  if (trace) {
+    trace->record(e, Trace::kernel_name(k), true, level, level_n, *gx / wx, 0);
+  }
+  chain(e, timer);
+}
+
+/*
+ * Blocking copies of [size] bytes ([n] elements) to and from the device,
+ *   adding their time to [timer].
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::upload(cl_mem buffer, size_t size, const void *ptr, int n, float &timer) {
+  timer += trace ? trace->memcpy_to_dev(queue, buffer, size, ptr, n)
+                 : memcpy_to_dev_on(queue, buffer, size, ptr);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::download(cl_mem buffer, size_t size, void *ptr, int n, float &timer) {
+  timer += trace ? trace->memcpy_from_dev(queue, buffer, size, ptr, n)
+                 : memcpy_from_dev_on(queue, buffer, size, ptr);
+}
+
+/*
+ * Record the non-blocking transfer [e] (if tracing).
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::record_transfer(cl_event e, const char *name, int n, size_t size) {
+  if (trace) {
+    trace->record(e, name, false, 0, n, 0, size);
+  }
 }
 
-void Scan::recursive_scan(cl_mem d_data, int n) {
-  int k = (int) ceil((float)n/(float)m);
+/*
+ * Make [e] the command that the next one waits on, keeping it to be timed into [timer].
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::chain(cl_event e, float &timer) {
+  if (last_event) {
+    ASSERT_NO_CL_ERROR(clReleaseEvent(last_event));
+  }
+  track(e, timer);
+  last_event = e;
+}
+
+/*
+ * Keep [e] to be timed into [timer] (when profiling).
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::track(cl_event e, float &timer) {
+  if (clw.has_profiling()) {
+    ASSERT_NO_CL_ERROR(clRetainEvent(e));
+    pending.push_back(make_pair(e, &timer));
+  }
+}
+
+/*
+ * Add the times of completed scan_async commands to their timers.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::collect_timers() {
+  for (size_t i=0; i<pending.size(); i++) {
+    cl_event e = pending[i].first;
+    cl_ulong start, end;
+    ASSERT_NO_CL_ERROR(clWaitForEvents(1, &e));
+    ASSERT_NO_CL_ERROR(
+      clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL));
+    ASSERT_NO_CL_ERROR(
+      clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL));
+    *pending[i].second += (end - start) * 1.0e-6f;
+    ASSERT_NO_CL_ERROR(clReleaseEvent(e));
+  }
+  pending.clear();
+  release_in_flight(/*wait=*/true);
+}
+
+/*
+ * Hand [buffer] back to the pool, or (under scan_async) once its commands are done.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::release(cl_mem buffer) {
+  if (defer) {
+    deferred.push_back(buffer);
+  } else {
+    pool.release(buffer);
+  }
+}
+
+/*
+ * Stop deferring and keep the buffers released since from the pool until [e] completes.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::hold_deferred(cl_event e) {
+  for (size_t i=0; i<deferred.size(); i++) {
+    ASSERT_NO_CL_ERROR(clRetainEvent(e));
+    in_flight.push_back(make_pair(e, deferred[i]));
+  }
+  deferred.clear();
+  defer = false;
+}
+
+/*
+ * Hand back the buffers of scan_async whose commands are done (or wait for all of them).
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::release_in_flight(bool wait) {
+  size_t kept = 0;
+  for (size_t i=0; i<in_flight.size(); i++) {
+    cl_event e = in_flight[i].first;
+    cl_int status = CL_COMPLETE;
+    if (wait) {
+      ASSERT_NO_CL_ERROR(clWaitForEvents(1, &e));
+    } else {
+      ASSERT_NO_CL_ERROR(
+        clGetEventInfo(e, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL));
+    }
+    // a negative status is an aborted command, which is also done with the buffer
+    if (status <= CL_COMPLETE) {
+      pool.release(in_flight[i].second);
+      ASSERT_NO_CL_ERROR(clReleaseEvent(e));
+    } else {
+      in_flight[kept++] = in_flight[i];
+    }
+  }
+  in_flight.resize(kept);
+}
+
+/*
+ * A buffer that wraps host [data] (length [n]), or NULL if we should copy instead:
+ *   zero-copy is off, or [data] is not aligned well enough for the runtime to use it
+ *   in place (it would copy it behind our back).
+ */
+template <typename T, class Op>
+cl_mem BasicScan<T,Op>::wrap_host(T *data, int n) {
+  if (!zero_copy || n < 1 || ((size_t) data) % host_align != 0) {
+    return NULL;
+  }
+  cl_int err;
+  cl_mem buffer = clCreateBuffer(clw.get_context(), CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+    sizeof(T)*n, data, &err);
+  return (err == CL_SUCCESS) ? buffer : NULL;
+}
+
+/*
+ * Map a wrapped buffer once its kernels are done, so the result is in the host array.
+ * On a device that shares host memory the map returns the array itself.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::unwrap_host(cl_mem buffer, int n) {
+  cl_int err;
+  void *ptr = clEnqueueMapBuffer(queue, buffer, CL_TRUE, CL_MAP_READ, 0, sizeof(T)*n,
+    0, NULL, NULL, &err);
+  ASSERT_NO_CL_ERROR(err);
+  ASSERT_NO_CL_ERROR(clEnqueueUnmapMemObject(queue, buffer, ptr, 0, NULL, NULL));
+  ASSERT_NO_CL_ERROR(clFinish(queue));
+  ASSERT_NO_CL_ERROR(clReleaseMemObject(buffer));
+}
+
+template <typename T, class Op>
+T BasicScan<T,Op>::read_reduction() {
+  return *(T *) pinned.read(d_reduction, sizeof(T));
+}
+
+/*
+ * Scan [d_in] into [d_out] (which may be the same buffer).
+ * Only the top level reads from [d_in]; all other work is inplace on [d_out].
+ * The reduction of the whole array is the reduction of its partials,
+ *   so [d_total] is passed down and written by the last level.
+ * [depth] is the recursion level, as recorded by a trace.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::recursive_scan(cl_mem d_in, cl_mem d_out, int n, cl_mem d_total, int depth) {
+  level = depth;
+  level_n = n;
+  int k = (n + m-1) / m;
   //size of each subarray stored in local memory
-  size_t bufsize = sizeof(int)*m;
-  if (k == 1) {
+  size_t bufsize = local_bufsize();
+  if (k > 1 && algorithm_for(n) == LOOKBACK) {
+    lookback_scan(d_in, d_out, n, d_total);
+  } else if (k == 1) {
     clw.kernel_arg(scan_pad_to_pow2,
-      d_data, bufsize, n);
-    k0 += clw.run_kernel_with_timing(scan_pad_to_pow2, /*dim=*/1, &wx, &wx);
+      d_in, d_out, d_total, bufsize, n);
+    run_kernel(scan_pad_to_pow2, &wx, k0);
   } else {
     size_t gx = k * wx;
-    cl_mem d_partial = clw.dev_malloc(sizeof(int)*k);
+    cl_mem d_partial = pool.acquire(sizeof(T)*k);
     clw.kernel_arg(scan_subarrays,
-      d_data, bufsize, d_partial, n);
-    k1 += clw.run_kernel_with_timing(scan_subarrays, /*dim=*/1, &gx, &wx);
-    recursive_scan(d_partial, k);
+      d_in, d_out, bufsize, d_partial, n);
+    run_kernel(scan_subarrays, &gx, k1);
+    recursive_scan(d_partial, d_partial, k, d_total, depth+1);
+    level = depth;
+    level_n = n;
     clw.kernel_arg(scan_inc_subarrays,
-      d_data, bufsize, d_partial, n);
-    k2 += clw.run_kernel_with_timing(scan_inc_subarrays, /*dim=*/1, &gx, &wx);
+      d_out, d_partial, n);
+    run_kernel(scan_inc_subarrays, &gx, k2);
 
-    clw.dev_free(d_partial);
+    release(d_partial);
   }
 }
 
-Scan::Scan(CLWrapper &clw, size_t wx) : clw(clw), wx(wx),
-  c0(0), c1(0), m0(0), m1(0), k0(0), k1(0), k2(0) {
-  m = wx * 2;
-#if EMBED_CL
-  #include "scan.cl.h"
-  clw.create_all_kernels(clw.compile_from_string((char *)&scan_cl));
-#else
-  clw.create_all_kernels(clw.compile("scan.cl"));
-#endif
-  scan_pow2 = clw.kernel_of_name("scan_pow2_wrapper");
-  scan_pad_to_pow2 = clw.kernel_of_name("scan_pad_to_pow2");
-  scan_subarrays = clw.kernel_of_name("scan_subarrays");
-  scan_inc_subarrays = clw.kernel_of_name("scan_inc_subarrays");
+/*
+ * Single-pass scan of [d_in] into [d_out] (which may be the same buffer).
+ * We need one small launch to reset the tile status before the scan itself.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::lookback_scan(cl_mem d_in, cl_mem d_out, int n, cl_mem d_total) {
+  int k = (n + m-1) / m;
+  size_t bufsize = local_bufsize();
+  size_t gx = k * wx;
+  size_t gx_init = ((k+1 + wx-1) / wx) * wx;
+  cl_mem d_status = pool.acquire(sizeof(int)*(1+k));
+  cl_mem d_value = pool.acquire(sizeof(T)*(2*k));
+  clw.kernel_arg(scan_lookback_init,
+    d_status, k);
+  run_kernel(scan_lookback_init, &gx_init, k3);
+  clw.kernel_arg(scan_lookback,
+    d_in, d_out, bufsize, d_status, d_value, d_total, n);
+  run_kernel(scan_lookback, &gx, k3);
+  release(d_status);
+  release(d_value);
 }
 
-void Scan::reset_timers() {
-  c0 = c1 = 0;
+/*
+ * Local memory needed by each workgroup: the subarray of length [m] and,
+ *   if we use more than two items per workitem, the [wx] per-workitem totals.
+ * Must agree with PAD and tile_totals in scan.cl.
+ */
+template <typename T, class Op>
+size_t BasicScan<T,Op>::local_bufsize() {
+  int len = m;
+  int totals = (items == 2) ? 0 : (int) wx;
+  if (conflict_free) {
+    len += (m-1) >> 5;
+    totals += totals ? ((wx-1) >> 5) : 0;
+  }
+  return sizeof(T)*(len + totals);
+}
+
+/*
+ * Make sure the pool holds every buffer needed to scan an array of length [n],
+ *   ie, the staging buffer and one partial buffer per recursion level.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::reserve(int n) {
+  vector<cl_mem> buffers;
+  int k = (n + m-1) / m;
+  buffers.push_back(pool.acquire(sizeof(T)*n));
+  if (k > 1 && algorithm_for(n) == LOOKBACK) {
+    buffers.push_back(pool.acquire(sizeof(int)*(1+k)));
+    buffers.push_back(pool.acquire(sizeof(T)*(2*k)));
+    k = 1;
+  }
+  while (k > 1) {
+    buffers.push_back(pool.acquire(sizeof(T)*k));
+    k = (k + m-1) / m;
+  }
+  for (size_t i=0; i<buffers.size(); i++) {
+    pool.release(buffers[i]);
+  }
+}
+
+/*
+ * Take the configuration tuned for arrays of length [n] (falling back to the largest
+ *   tuned length), and remember the algorithm tuned for each length with that configuration.
+ * Without a profile entry we keep the constructor arguments and a workgroup of 256.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::load_tuning(int n) {
+  std::string device = tuning_device(clw);
+  std::string kind = tuning_kind<T,Op>("scan");
+  TuningProfile profile(tuning_profile_path());
+  tuning t;
+  if (!profile.lookup(device, kind, n, t) && !profile.lookup(device, kind, 0, t)) {
+    wx = 256;
+    return;
+  }
+  wx = t.wx;
+  items = t.items;
+  alg = to_algorithm(t.alg, alg);
+  tuned_alg.assign(31, -1);
+  for (int bucket=0; bucket<31; bucket++) {
+    tuning b;
+    if (profile.lookup(device, kind, 1 << bucket, b) && b.wx == wx && b.items == items) {
+      tuned_alg[bucket] = to_algorithm(b.alg, alg);
+    }
+  }
+}
+
+template <typename T, class Op>
+typename BasicScan<T,Op>::algorithm BasicScan<T,Op>::algorithm_for(int n) {
+  if (!tuned_alg.empty() && tuned_alg[tuning_bucket(n)] >= 0) {
+    return (algorithm) tuned_alg[tuning_bucket(n)];
+  }
+  return alg;
+}
+
+/*
+ * Free all pooled device buffers.
+ */
+template <typename T, class Op>
+void BasicScan<T,Op>::trim() {
+  release_in_flight(/*wait=*/true);
+  pool.trim();
+}
+
+template <typename T, class Op>
+BasicScan<T,Op>::BasicScan(CLWrapper &clw, size_t wx, int capacity_hint, algorithm alg,
+  int items, bool conflict_free) : clw(clw),
+  alg(alg), wx(wx), items(items), conflict_free(conflict_free),
+  own_pool(new BufferPool(clw)), pool(*own_pool), queue(clw.get_command_queue()),
+  pinned(clw, sizeof(T), queue),
+  async(false), last_event(NULL), defer(false), zero_copy(false), host_align(1),
+  upload_queue(NULL), download_queue(NULL), trace(NULL), level(0), level_n(0),
+  m0(0), m1(0), k0(0), k1(0), k2(0), k3(0), k4(0), k5(0) {
+  init(capacity_hint);
+}
+
+template <typename T, class Op>
+BasicScan<T,Op>::BasicScan(CLWrapper &clw, cl_command_queue queue, BufferPool &pool, size_t wx,
+  int capacity_hint, algorithm alg, int items, bool conflict_free) : clw(clw),
+  alg(alg), wx(wx), items(items), conflict_free(conflict_free),
+  own_pool(NULL), pool(pool), queue(queue),
+  pinned(clw, sizeof(T), queue),
+  async(false), last_event(NULL), defer(false), zero_copy(false), host_align(1),
+  upload_queue(NULL), download_queue(NULL), trace(NULL), level(0), level_n(0),
+  m0(0), m1(0), k0(0), k1(0), k2(0), k3(0), k4(0), k5(0) {
+  init(capacity_hint);
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::init(int capacity_hint) {
+  if (wx == 0) {
+    load_tuning(capacity_hint);
+  }
+  m = this->wx * items;
+  stringstream flags;
+  flags << "-D T=" << cl_type<T>::name()
+        << " -D SCAN_OP=" << Op::cl_id() << " -D IDENTITY=" << Op::cl_identity()
+        << " -D ITEMS_PER_THREAD=" << items << " -D CONFLICT_FREE=" << (conflict_free ? 1 : 0)
+        << cl_type<T>::options();
+  cl_program program = cached_program(clw, "scan.cl", scan_source, flags.str());
+  scan_pow2 = create_kernel(program, "scan_pow2_wrapper");
+  scan_pad_to_pow2 = create_kernel(program, "scan_pad_to_pow2");
+  scan_subarrays = create_kernel(program, "scan_subarrays");
+  scan_inc_subarrays = create_kernel(program, "scan_inc_subarrays");
+  scan_lookback_init = create_kernel(program, "scan_lookback_init");
+  scan_lookback = create_kernel(program, "scan_lookback");
+  scan_batch_offsets = create_kernel(program, "scan_batch_offsets");
+  scan_batch_uniform = create_kernel(program, "scan_batch_uniform");
+  scan_add_carry = create_kernel(program, "scan_add_carry");
+  scan_add_offset = create_kernel(program, "scan_add_offset");
+  d_reduction = pool.acquire(sizeof(T));
+  if (capacity_hint > 0) {
+    reserve(capacity_hint);
+  }
+  cl_bool unified = CL_FALSE;
+  cl_uint align_bits = 0;
+  if (clGetDeviceInfo(clw.get_device(), CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL) == CL_SUCCESS &&
+      clGetDeviceInfo(clw.get_device(), CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &align_bits, NULL) == CL_SUCCESS) {
+    zero_copy = (unified == CL_TRUE);
+    host_align = max((size_t) align_bits / 8, sizeof(T));
+  }
+}
+
+template <typename T, class Op>
+BasicScan<T,Op>::~BasicScan() {
+  clReleaseKernel(scan_pow2);
+  clReleaseKernel(scan_pad_to_pow2);
+  clReleaseKernel(scan_subarrays);
+  clReleaseKernel(scan_inc_subarrays);
+  clReleaseKernel(scan_lookback_init);
+  clReleaseKernel(scan_lookback);
+  clReleaseKernel(scan_batch_offsets);
+  clReleaseKernel(scan_batch_uniform);
+  clReleaseKernel(scan_add_carry);
+  clReleaseKernel(scan_add_offset);
+  release_cached_programs(clw);
+  collect_timers();
+  if (upload_queue) {
+    clReleaseCommandQueue(upload_queue);
+    clReleaseCommandQueue(download_queue);
+  }
+  pool.release(d_reduction);
+  delete own_pool;
+}
+
+template <typename T, class Op>
+void BasicScan<T,Op>::reset_timers() {
+  collect_timers();
   m0 = m1 = 0;
-  k0 = k1 = k2 = 0;
+  k0 = k1 = k2 = k3 = k4 = k5 = 0;
 }
 
-void Scan::get_timers(map<string,float> &timings) {
+template <typename T, class Op>
+void BasicScan<T,Op>::get_timers(map<string,float> &timings) {
+  collect_timers();
   if (clw.has_profiling()) {
     timings.insert(make_pair("SCAN1. data_memcpy_to_dev",   m0));
     timings.insert(make_pair("SCAN2. scan_pad_to_pow2  ",   k0));
     timings.insert(make_pair("SCAN3. scan_subarrays    ",   k1));
     timings.insert(make_pair("SCAN4. scan_inc_subarrays",   k2));
     timings.insert(make_pair("SCAN5. data_memcpy_from_dev", m1));
-    timings.insert(make_pair("SCAN6. data_cpy_to_dev",      c0));
-    timings.insert(make_pair("SCAN7. data_cpy_from_dev",    c1));
+    timings.insert(make_pair("SCAN6. scan_lookback     ",   k3));
+    timings.insert(make_pair("SCAN7. scan_batch        ",   k4));
+    timings.insert(make_pair("SCAN8. scan_add_carry    ",   k5));
   }
 }
+
+template class BasicScan<int,     Add<int> >;
+template class BasicScan<int,     Max<int> >;
+template class BasicScan<int,     Min<int> >;
+template class BasicScan<int,     And<int> >;
+template class BasicScan<int,     Or<int> >;
+template class BasicScan<int64_t, Add<int64_t> >;
+template class BasicScan<int64_t, Max<int64_t> >;
+template class BasicScan<int64_t, Min<int64_t> >;
+template class BasicScan<int64_t, And<int64_t> >;
+template class BasicScan<int64_t, Or<int64_t> >;
+template class BasicScan<float,   Add<float> >;
+template class BasicScan<float,   Max<float> >;
+template class BasicScan<float,   Min<float> >;
+template class BasicScan<double,  Add<double> >;
+template class BasicScan<double,  Max<double> >;
+template class BasicScan<double,  Min<double> >;
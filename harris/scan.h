@@ -1,32 +1,204 @@
 #ifndef SCAN_H
 #define SCAN_H
 
+#include "bufferpool.h"
 #include "clwrapper.h"
+#include "pinned.h"
+#include "scanop.h"
+#include "trace.h"
 
-class Scan {
+class ScanBase {
+  public:
+    enum algorithm {
+      RECURSIVE,  // scan subarrays, recursively scan their totals, then add back (3 kernels per level)
+      LOOKBACK    // single-pass scan with decoupled look-back over preceding subarrays
+    };
+
+    /*
+     * [a] as an algorithm, eg, from a tuning profile or the command line;
+     *   any other value gives [fallback], with a warning.
+     */
+    static algorithm to_algorithm(int a, algorithm fallback=RECURSIVE);
+};
+
+/*
+ * Exclusive scan of elements of type [T] under the associative operator [Op] (see scanop.h).
+ * Each specialization compiles scan.cl with its own -D T/SCAN_OP/IDENTITY;
+ *   the program is shared by all instances with the same specialization and variant.
+ * Instantiated for int and int64_t with Add, Max, Min, And and Or,
+ *   and for float and double with Add, Max and Min.
+ */
+template <typename T, class Op=Add<T> >
+class BasicScan : public ScanBase {
   private:
     CLWrapper &clw;
     cl_kernel scan_pow2;
     cl_kernel scan_pad_to_pow2;
     cl_kernel scan_subarrays;
     cl_kernel scan_inc_subarrays;
-    size_t wx; // workgroup size
-    int m;     // length of each subarray ( = wx*2 )
+    cl_kernel scan_lookback_init;
+    cl_kernel scan_lookback;
+    cl_kernel scan_batch_offsets;
+    cl_kernel scan_batch_uniform;
+    cl_kernel scan_add_carry;
+    cl_kernel scan_add_offset;
+    algorithm alg;
+    vector<int> tuned_alg; // per size bucket, the algorithm from the tuning profile (or -1)
+    size_t wx;          // workgroup size
+    int items;          // elements per workitem
+    bool conflict_free; // pad local arrays to avoid bank conflicts
+    int m;              // length of each subarray ( = wx*items )
+    BufferPool *own_pool; // NULL if [pool] is shared with other scans
+    BufferPool &pool;     // staging and partial buffers reused across calls
+    cl_command_queue queue; // where we enqueue (the queue of [clw] unless given)
+    cl_mem d_reduction;  // total of the last scan
+    PinnedBuffer pinned; // readback of the total
+    bool async;          // enqueue without waiting (see scan_async)
+    cl_event last_event; // last command enqueued by scan_async
+    vector<pair<cl_event, float *> > pending; // events of scan_async still to be timed
+    bool defer;          // hold released buffers until the scan_async being enqueued completes
+    vector<cl_mem> deferred;                     // buffers released while enqueueing it
+    vector<pair<cl_event, cl_mem> > in_flight;   // buffers of scan_async, back to the pool once done
+    bool zero_copy;      // wrap host arrays instead of copying them (see set_zero_copy)
+    size_t host_align;   // alignment (bytes) a host array needs to be wrapped
+    cl_command_queue upload_queue;   // copies of scan_stream (created on first use)
+    cl_command_queue download_queue;
+    Trace *trace;        // commands are recorded here if not NULL (see set_trace)
+    int level;           // recursion level and length of the commands being enqueued
+    int level_n;
 
     //timings
-    float c0; float c1;           //copy buffers
     float m0; float m1;           //memcpy buffers
     float k0; float k1; float k2; //kernels
+    float k3;                     //single-pass kernels
+    float k4;                     //batched kernels
+    float k5;                     //streaming carry and add_carry
 
-    void recursive_scan(cl_mem d_data, int n);
+    void recursive_scan(cl_mem d_in, cl_mem d_out, int n, cl_mem d_total, int depth=0);
+    void lookback_scan(cl_mem d_in, cl_mem d_out, int n, cl_mem d_total);
+    T read_reduction();
+    void run_kernel(cl_kernel k, size_t *gx, float &timer);
+    void upload(cl_mem buffer, size_t size, const void *ptr, int n, float &timer);
+    void download(cl_mem buffer, size_t size, void *ptr, int n, float &timer);
+    void record_transfer(cl_event e, const char *name, int n, size_t size);
+    void chain(cl_event e, float &timer);
+    void track(cl_event e, float &timer);
+    void create_stream_queues();
+    void collect_timers();
+    void release(cl_mem buffer);
+    void hold_deferred(cl_event e);
+    void release_in_flight(bool wait);
+    size_t local_bufsize();
+    void init(int capacity_hint);
+    void load_tuning(int n);
+    cl_mem wrap_host(T *data, int n);
+    void unwrap_host(cl_mem buffer, int n);
+    algorithm algorithm_for(int n);
 
   public:
-    Scan(CLWrapper &clw, size_t wx=256);
+    /*
+     * With [wx] 0 the workgroup size, elements per workitem and algorithm come from the
+     *   tuning profile (see common/tuning.h) for arrays of length [capacity_hint]
+     *   (or the largest tuned length if 0); [alg] and [items] are then only the fallback.
+     * Each scan then also takes the tuned algorithm for its own length.
+     */
+    BasicScan(CLWrapper &clw, size_t wx=256, int capacity_hint=0, algorithm alg=RECURSIVE,
+              int items=2, bool conflict_free=false);
+
+    /*
+     * As above but enqueue on [queue] (of the context of [clw]) and take buffers from [pool],
+     *   which may be shared with scans on other queues and threads (see service/).
+     * The blocking forms wait for every command before its buffers go back to the pool,
+     *   and scan_async holds its buffers until its commands are done;
+     *   scan_stream does not, so do not use it with a shared pool.
+     */
+    BasicScan(CLWrapper &clw, cl_command_queue queue, BufferPool &pool, size_t wx=256,
+              int capacity_hint=0, algorithm alg=RECURSIVE, int items=2, bool conflict_free=false);
+    ~BasicScan();
     void reset_timers();
     void get_timers(map<string,float> &timings);
 
-    void scan(int *data, int n);
+    void reserve(int n);
+    void trim();
+    void set_algorithm(algorithm a) { alg = a; tuned_alg.clear(); }
+    size_t workgroup_size() { return wx; }
+
+    /*
+     * Zero-copy scans of host arrays, on by default where the device shares host memory
+     *   (CL_DEVICE_HOST_UNIFIED_MEMORY, eg, CPU runtimes).
+     * The host forms of scan and scan_batch then run the kernels on a buffer that wraps the
+     *   caller's array (CL_MEM_USE_HOST_PTR) and map it to make the result visible,
+     *   so there are no copies (m0/m1 stay 0). The kernels never touch elements beyond [n],
+     *   so the caller's array needs no padding, but it must be aligned to the device's
+     *   base address alignment (eg, 4096 bytes with posix_memalign);
+     *   other arrays are copied as before.
+     */
+    void set_zero_copy(bool on) { zero_copy = on; }
+    bool has_zero_copy() { return zero_copy; }
+    int items_per_workitem() { return items; }
+
+    /*
+     * Record every kernel launch and transfer in [t] (or stop recording if NULL, the default)
+     *   with its recursion level, length and workgroup count (see common/trace.h).
+     * Blocking scans then launch each command with an event; otherwise nothing changes.
+     * [t] must outlive the scan or be unset first.
+     */
+    void set_trace(Trace *t) { trace = t; }
+
+    void scan(T *data, int n);
     void scan(cl_mem data, int n);
+    void scan(cl_mem in, cl_mem out, int n);
+
+    // as above but also return (or write to device) the reduction of all n elements
+    void scan(T *data, int n, T *total);
+    void scan(cl_mem in, cl_mem out, int n, T *total);
+    void scan(cl_mem in, cl_mem out, int n, cl_mem total);
+
+    /*
+     * data[i] = OP(carry, data[i]) for the [n] elements of device buffer [data],
+     *   eg, to combine the reduction of the preceding parts into a part scanned on its own
+     *   (see multidevice/ and hetero/).
+     */
+    void add_carry(cl_mem data, int n, T carry);
+
+    /*
+     * Non-blocking scans. Every command is enqueued behind the previous one
+     *   (and the first behind [wait], if given) and we return the event of the last;
+     *   the caller owns it (clWaitForEvents, then clReleaseEvent).
+     * The host form also copies [data] to and from the device without blocking,
+     *   so [data] must not be touched until the event completes.
+     * Like the blocking forms they take the tuned algorithm for [n] (see algorithm_for).
+     * Their pooled buffers only go back to the pool once the returned event completes
+     *   (checked on the next scan_async, and waited for by get_timers, reset_timers and trim),
+     *   so other commands (eg, the uploads of scan_stream on their own queue) cannot reuse them.
+     * Timings are read from the events when get_timers is next called.
+     */
+    cl_event scan_async(T *data, int n, cl_event wait=NULL);
+    cl_event scan_async(cl_mem in, cl_mem out, int n, cl_event wait=NULL);
+
+    /*
+     * Inplace scan of host [data] of any (64-bit) length, streamed through
+     *   [nbuffers] device buffers of [chunk] elements each.
+     * Uploads, scans and downloads run on separate queues so successive chunks overlap,
+     *   and the running total is carried on the device from chunk to chunk.
+     * For full overlap [data] should be pinned host memory.
+     * The second form reads [in] and writes [out] (eg, two mapped files).
+     */
+    void scan_stream(T *data, int64_t n, int chunk=1<<22, int nbuffers=3);
+    void scan_stream(const T *in, T *out, int64_t n, int chunk=1<<22, int nbuffers=3);
+
+    /*
+     * Inplace scans of many independent arrays in a single launch (one workgroup per array).
+     * Array i spans [offsets][i] up to [offsets][i+1] (or [n] for the last array);
+     *   [offsets] must be ascending.
+     * The uniform form scans [narrays] consecutive arrays of [length] elements.
+     */
+    void scan_batch(T *data, int n, int *offsets, int narrays);
+    void scan_batch(cl_mem data, int n, cl_mem offsets, int narrays);
+    void scan_batch(T *data, int length, int narrays);
+    void scan_batch(cl_mem data, int length, int narrays);
 };
 
+typedef BasicScan<int, Add<int> > Scan;
+
 #endif
@@ -1,10 +1,14 @@
 #include "clwrapper.h"
+#include "programcache.h"
 #include "scan.h"
 #include "scanref.h"
 #include "utils.h"
 
 #include "UnitTest++.h"
 
+#include <dirent.h>
+#include <unistd.h>
+
 #define N 8
 
 TEST(Simple) {
@@ -16,9 +20,10 @@ TEST(Simple) {
   CHECK_ARRAY_EQUAL(result, x, N);
 }
 
-void random_test(int n, int wx) {
+void random_test(int n, int wx, Scan::algorithm alg=Scan::RECURSIVE,
+                 int items=2, bool conflict_free=false) {
   CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
-  Scan *s = new Scan(clw, wx);
+  Scan *s = new Scan(clw, wx, /*capacity_hint=*/0, alg, items, conflict_free);
   int *x = new int[n];
   int *result = new int[n];
   fill_random_data(x, n, n);
@@ -41,6 +46,562 @@ TEST(Random_1048576) {
   random_test(1048576, 128);
 }
 
+TEST(Lookback_1024) {
+  random_test(1024, 128, Scan::LOOKBACK);
+}
+
+TEST(Lookback_1000001) {
+  random_test(1000001, 128, Scan::LOOKBACK);
+}
+
+// past 2^24 a float no longer holds n exactly (the last tile was dropped)
+TEST(Lookback_16777217) {
+  random_test(16777217, 256, Scan::LOOKBACK);
+}
+
+TEST(ConflictFree_100000) {
+  random_test(100000, 128, Scan::RECURSIVE, /*items=*/2, /*conflict_free=*/true);
+}
+
+TEST(Items1_100000) {
+  random_test(100000, 64, Scan::RECURSIVE, /*items=*/1, /*conflict_free=*/false);
+}
+
+TEST(Items8_ConflictFree_100000) {
+  random_test(100000, 64, Scan::RECURSIVE, /*items=*/8, /*conflict_free=*/true);
+}
+
+// a single padded tile (scan_pad_to_pow2), and a partial last tile
+TEST(Items8_ConflictFree_SingleTile_300) {
+  random_test(300, 64, Scan::RECURSIVE, /*items=*/8, /*conflict_free=*/true);
+}
+
+TEST(Items8_ConflictFree_1000) {
+  random_test(1000, 64, Scan::RECURSIVE, /*items=*/8, /*conflict_free=*/true);
+}
+
+TEST(Items8_ConflictFree_Lookback_100000) {
+  random_test(100000, 64, Scan::LOOKBACK, /*items=*/8, /*conflict_free=*/true);
+}
+
+TEST(Items12_ConflictFree_100000) {
+  random_test(100000, 64, Scan::RECURSIVE, /*items=*/12, /*conflict_free=*/true);
+}
+
+TEST(PooledBuffersAcrossSizes) {
+  // buffers handed back by the pool hold stale data from the previous call
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, /*wx=*/128, /*capacity_hint=*/65536);
+  int sizes[] = { 65536, 1000, 65536, 1, 300 };
+  for (int i=0; i<5; i++) {
+    int n = sizes[i];
+    int *x = new int[n];
+    int *result = new int[n];
+    fill_random_data(x, n, n);
+    exclusive_scan_host(result, x, n);
+    s->scan(x, n);
+    CHECK_ARRAY_EQUAL(result, x, n);
+    delete[] x;
+    delete[] result;
+  }
+  s->trim();
+  int x[N]            = { 3, 1, 7,  0,  4,  1,  6,  3 };
+  const int result[N] = { 0, 3, 4, 11, 11, 15, 16, 22 };
+  s->scan(x, N);
+  CHECK_ARRAY_EQUAL(result, x, N);
+}
+
+/*
+ * Scan [n] random values drawn from ([0..max) * scale) + bias
+ */
+template <typename T, class Op>
+void typed_test(int n, int wx, int max, T scale, T bias,
+                Scan::algorithm alg=Scan::RECURSIVE) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicScan<T,Op> *s = new BasicScan<T,Op>(clw, wx, /*capacity_hint=*/0, alg);
+  T *x = new T[n];
+  T *result = new T[n];
+  for (int i=0; i<n; i++) {
+    x[i] = ((T) rand_int(max) * scale) + bias;
+  }
+  exclusive_scan_host<T,Op>(result, x, n);
+  s->scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Int64_Add_1000000) {
+  // sum exceeds 32 bits
+  typed_test<int64_t, Add<int64_t> >(1000000, 128, 1000000, /*scale=*/1<<16, /*bias=*/0);
+}
+
+TEST(Int64_Add_Lookback_1000000) {
+  typed_test<int64_t, Add<int64_t> >(1000000, 128, 1000000, /*scale=*/1<<16, /*bias=*/0, Scan::LOOKBACK);
+}
+
+TEST(Int64_Max_100000) {
+  typed_test<int64_t, Max<int64_t> >(100000, 128, 100000, /*scale=*/1LL<<32, /*bias=*/-(1LL<<40));
+}
+
+TEST(Float_Add_100000) {
+  // multiples of 0.5 summing below 2^23 are exact so order of evaluation does not matter
+  typed_test<float, Add<float> >(100000, 128, 16, /*scale=*/0.5f, /*bias=*/0.0f);
+}
+
+TEST(Float_Max_Lookback_100000) {
+  typed_test<float, Max<float> >(100000, 128, 100000, /*scale=*/0.25f, /*bias=*/-1000.0f, Scan::LOOKBACK);
+}
+
+TEST(Double_Add_100000) {
+  typed_test<double, Add<double> >(100000, 128, 100000, /*scale=*/0.5, /*bias=*/0.0);
+}
+
+TEST(Double_Min_100000) {
+  typed_test<double, Min<double> >(100000, 128, 100000, /*scale=*/0.5, /*bias=*/-1000.0);
+}
+
+TEST(Int_Max_100000) {
+  typed_test<int, Max<int> >(100000, 128, 100000, /*scale=*/1, /*bias=*/-50000);
+}
+
+TEST(Int_Min_Lookback_100000) {
+  typed_test<int, Min<int> >(100000, 128, 100000, /*scale=*/1, /*bias=*/-50000, Scan::LOOKBACK);
+}
+
+TEST(Int_And_100000) {
+  // mostly set bits so the running conjunction survives for a while
+  typed_test<int, And<int> >(100000, 128, 2, /*scale=*/1, /*bias=*/-2);
+}
+
+TEST(Int_Or_100000) {
+  typed_test<int, Or<int> >(100000, 128, 1<<20, /*scale=*/1, /*bias=*/0);
+}
+
+void device_test(int n, int wx, bool inplace) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, wx);
+  int *x = new int[n];
+  int *y = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  cl_mem d_in = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_in, sizeof(int)*n, x);
+  if (inplace) {
+    s->scan(d_in, n);
+    clw.memcpy_from_dev(d_in, sizeof(int)*n, y);
+  } else {
+    cl_mem d_out = clw.dev_malloc(sizeof(int)*n);
+    s->scan(d_in, d_out, n);
+    clw.memcpy_from_dev(d_out, sizeof(int)*n, y);
+    clw.dev_free(d_out);
+    // input is left unchanged
+    clw.memcpy_from_dev(d_in, sizeof(int)*n, result);
+    CHECK_ARRAY_EQUAL(x, result, n);
+    exclusive_scan_host(result, x, n);
+  }
+  CHECK_ARRAY_EQUAL(result, y, n);
+  clw.dev_free(d_in);
+  delete[] x;
+  delete[] y;
+  delete[] result;
+}
+
+TEST(Device_Inplace_100000) {
+  device_test(100000, 128, /*inplace=*/true);
+}
+
+TEST(Device_OutOfPlace_100000) {
+  device_test(100000, 128, /*inplace=*/false);
+}
+
+TEST(Device_OutOfPlace_200) {
+  device_test(200, 128, /*inplace=*/false);
+}
+
+void total_test(int n, int wx, Scan::algorithm alg=Scan::RECURSIVE) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, wx, /*capacity_hint=*/0, alg);
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  int expected = result[n-1] + x[n-1];
+  cl_mem d_in = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_total = clw.dev_malloc(sizeof(int));
+  clw.memcpy_to_dev(d_in, sizeof(int)*n, x);
+  // device buffer forms
+  int total = 0;
+  s->scan(d_in, d_in, n, d_total);
+  clw.memcpy_from_dev(d_total, sizeof(int), &total);
+  CHECK_EQUAL(expected, total);
+  clw.memcpy_to_dev(d_in, sizeof(int)*n, x);
+  total = 0;
+  s->scan(d_in, d_in, n, &total);
+  CHECK_EQUAL(expected, total);
+  // host form
+  total = 0;
+  s->scan(x, n, &total);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  CHECK_EQUAL(expected, total);
+  clw.dev_free(d_in);
+  clw.dev_free(d_total);
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Total_200) {
+  total_test(200, 128);
+}
+
+TEST(Total_1048576) {
+  total_test(1048576, 128);
+}
+
+TEST(Total_Lookback_1000001) {
+  total_test(1000001, 128, Scan::LOOKBACK);
+}
+
+TEST(Total_Float_Max_100000) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicScan<float, Max<float> > s(clw, 128);
+  int n = 100000;
+  float *x = new float[n];
+  for (int i=0; i<n; i++) {
+    x[i] = (float) rand_int(n) - (float) (n/2);
+  }
+  x[n/3] = (float) n;
+  float total = 0;
+  s.scan(x, n, &total);
+  CHECK_EQUAL((float) n, total);
+  delete[] x;
+}
+
+/*
+ * Arrays of random length (including empty and multi-subarray arrays).
+ */
+void batch_test(int narrays, int wx, int items=2, bool conflict_free=false) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, wx, /*capacity_hint=*/0, Scan::RECURSIVE, items, conflict_free);
+  int *offsets = new int[narrays];
+  int n = 0;
+  for (int a=0; a<narrays; a++) {
+    offsets[a] = n;
+    n += (a % 7 == 3) ? 0 : 1 + rand_int(3000);
+  }
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  for (int a=0; a<narrays; a++) {
+    int end = (a+1 < narrays) ? offsets[a+1] : n;
+    exclusive_scan_host(&result[offsets[a]], &x[offsets[a]], end - offsets[a]);
+  }
+  s->scan_batch(x, n, offsets, narrays);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] offsets;
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Batch_1000) {
+  batch_test(1000, 128);
+}
+
+TEST(Batch_Items8_ConflictFree_1000) {
+  batch_test(1000, 64, /*items=*/8, /*conflict_free=*/true);
+}
+
+TEST(Batch_Uniform_300x10000) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, 128);
+  int length = 300;
+  int narrays = 10000;
+  int n = length * narrays;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  for (int a=0; a<narrays; a++) {
+    exclusive_scan_host(&result[a*length], &x[a*length], length);
+  }
+  s->scan_batch(x, length, narrays);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+}
+
+/*
+ * Two chained async scans: the second scans the result of the first.
+ */
+void async_test(int n, int wx, Scan::algorithm alg=Scan::RECURSIVE) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, wx, /*capacity_hint=*/0, alg);
+  int *x = new int[n];
+  int *y = new int[n];
+  int *result = new int[n];
+  // sparse ones so that the scan of the scan does not overflow
+  for (int i=0; i<n; i++) {
+    x[i] = (rand_int(1000) == 0);
+  }
+  exclusive_scan_host(y, x, n);
+  exclusive_scan_host(result, y, n);
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_x, sizeof(int)*n, x);
+  cl_event e0 = s->scan_async(d_x, d_x, n);
+  cl_event e1 = s->scan_async(d_x, d_x, n, e0);
+  clWaitForEvents(1, &e1);
+  clw.memcpy_from_dev(d_x, sizeof(int)*n, y);
+  CHECK_ARRAY_EQUAL(result, y, n);
+  clReleaseEvent(e0);
+  clReleaseEvent(e1);
+  // host form
+  exclusive_scan_host(result, x, n);
+  cl_event e2 = s->scan_async(x, n);
+  clWaitForEvents(1, &e2);
+  clReleaseEvent(e2);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  map<string,float> timings;
+  s->get_timers(timings);
+  CHECK(timings["SCAN1. data_memcpy_to_dev"] > 0);
+  clw.dev_free(d_x);
+  delete[] x;
+  delete[] y;
+  delete[] result;
+}
+
+TEST(Async_200) {
+  async_test(200, 128);
+}
+
+TEST(Async_1048576) {
+  async_test(1048576, 128);
+}
+
+TEST(Async_Lookback_1000001) {
+  async_test(1000001, 128, Scan::LOOKBACK);
+}
+
+void stream_test(int n, int wx, int chunk, int nbuffers) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, wx);
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  exclusive_scan_host(result, x, n);
+  s->scan_stream(x, (int64_t) n, chunk, nbuffers);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Stream_1000001) {
+  stream_test(1000001, 128, /*chunk=*/100000, /*nbuffers=*/3);
+}
+
+TEST(Stream_DoubleBuffered_10007) {
+  stream_test(10007, 128, /*chunk=*/1000, /*nbuffers=*/2);
+}
+
+TEST(Stream_SingleChunk_5000) {
+  stream_test(5000, 128, /*chunk=*/1<<22, /*nbuffers=*/3);
+}
+
+/*
+ * A stream enqueued while a scan_async is still in flight must not take its buffers
+ *   (the stream uploads on its own queue).
+ */
+TEST(Async_ThenStream) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan s(clw, /*wx=*/128);
+  int n = 100000;
+  int *x = new int[n];
+  int *y = new int[n];
+  int *xresult = new int[n];
+  int *yresult = new int[n];
+  fill_random_data(x, n, 1000);
+  fill_random_data(y, n, 1000);
+  exclusive_scan_host(xresult, x, n);
+  exclusive_scan_host(yresult, y, n);
+  cl_event e = s.scan_async(x, n);
+  s.scan_stream(y, (int64_t) n, /*chunk=*/n, /*nbuffers=*/1);
+  clWaitForEvents(1, &e);
+  clReleaseEvent(e);
+  CHECK_ARRAY_EQUAL(xresult, x, n);
+  CHECK_ARRAY_EQUAL(yresult, y, n);
+  delete[] x;
+  delete[] y;
+  delete[] xresult;
+  delete[] yresult;
+}
+
+int count_files(const char *dir) {
+  int count = 0;
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (e->d_name[0] != '.') count++;
+  }
+  closedir(d);
+  return count;
+}
+
+TEST(ProgramBinaryCache) {
+  TemporaryKernelCache cache;
+  CHECK(!cache.dir().empty());
+  // the first process-wide compile writes the binary, the second builds from it
+  for (int run=0; run<2; run++) {
+    random_test(1000, 128);
+    CHECK_EQUAL(1, count_files(cache.dir().c_str()));
+  }
+}
+
+/*
+ * Zero-copy scans of an aligned array, and of a misaligned one (copied instead).
+ */
+void zero_copy_test(int n, int misalign) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, /*wx=*/128);
+  s->set_zero_copy(true);
+  CHECK(s->has_zero_copy());
+  void *mem = NULL;
+  int rc = posix_memalign(&mem, 4096, sizeof(int)*(n+1));
+  CHECK_EQUAL(0, rc);
+  if (rc != 0) {
+    delete s;
+    return;
+  }
+  int *x = (int *) mem + misalign;
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  s->scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  free(mem);
+  delete[] result;
+  delete s;
+}
+
+TEST(ZeroCopy_Aligned_100001) {
+  zero_copy_test(100001, /*misalign=*/0);
+}
+
+TEST(ZeroCopy_Unaligned_100001) {
+  zero_copy_test(100001, /*misalign=*/1);
+}
+
+TEST(ZeroCopy_Batch) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, /*wx=*/64);
+  s->set_zero_copy(true);
+  int length = 1000, narrays = 30, n = length * narrays;
+  void *mem = NULL;
+  int rc = posix_memalign(&mem, 4096, sizeof(int)*n);
+  CHECK_EQUAL(0, rc);
+  if (rc != 0) {
+    delete s;
+    return;
+  }
+  int *x = (int *) mem;
+  int *result = new int[n];
+  fill_random_data(x, n, 100);
+  for (int i=0; i<narrays; i++) {
+    exclusive_scan_host(&result[i*length], &x[i*length], length);
+  }
+  s->scan_batch(x, length, narrays);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  free(mem);
+  delete[] result;
+  delete s;
+}
+
+TEST(AddCarry_1000) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, 128);
+  int n = 1000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 100);
+  for (int i=0; i<n; i++) {
+    result[i] = 50 + x[i];
+  }
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_x, sizeof(int)*n, x);
+  s->add_carry(d_x, n, 50);
+  clw.memcpy_from_dev(d_x, sizeof(int)*n, x);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  clw.dev_free(d_x);
+  delete[] x;
+  delete[] result;
+  delete s;
+}
+
+TEST(Trace_Levels) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, /*wx=*/64);
+  s->set_zero_copy(false);
+  Trace trace;
+  s->set_trace(&trace);
+  int n = 100000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  exclusive_scan_host(result, x, n);
+  s->scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+
+  // m = 128: 782 subarrays, then 7, then a single one
+  const char *names[] = { "memcpy_to_dev", "scan_subarrays", "scan_subarrays", "scan_pad_to_pow2",
+                          "scan_inc_subarrays", "scan_inc_subarrays", "memcpy_from_dev" };
+  int depths[] = { 0, 0, 1, 2, 1, 0, 0 };
+  int lengths[] = { n, n, 782, 7, 782, n, n };
+  size_t groups[] = { 0, 782, 7, 1, 7, 782, 0 };
+  CHECK_EQUAL(7, (int) trace.size());
+  for (int i=0; i<7 && i<(int) trace.size(); i++) {
+    const trace_record &r = trace.at(i);
+    CHECK_EQUAL(names[i], r.name);
+    CHECK_EQUAL(depths[i], r.depth);
+    CHECK_EQUAL(lengths[i], r.n);
+    CHECK_EQUAL(groups[i], r.groups);
+    CHECK_EQUAL(0, r.call);
+    CHECK(r.end >= r.start);
+  }
+
+  s->scan(x, 1000);
+  CHECK_EQUAL(7 + 5, (int) trace.size());
+  CHECK_EQUAL(1, trace.at(trace.size()-1).call);
+  CHECK(trace.chrome_json().find("\"name\":\"scan_subarrays\"") != string::npos);
+  CHECK(trace.level_summary().find("scan_pad_to_pow2") != string::npos);
+
+  s->set_trace(NULL);
+  s->scan(x, n);
+  CHECK_EQUAL(7 + 5, (int) trace.size());
+  delete[] x;
+  delete[] result;
+  delete s;
+}
+
+TEST(Trace_Async) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  Scan *s = new Scan(clw, /*wx=*/64);
+  Trace trace;
+  s->set_trace(&trace);
+  int n = 100000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  exclusive_scan_host(result, x, n);
+  cl_event e = s->scan_async(x, n);
+  ASSERT_NO_CL_ERROR(clWaitForEvents(1, &e));
+  ASSERT_NO_CL_ERROR(clReleaseEvent(e));
+  CHECK_ARRAY_EQUAL(result, x, n);
+  CHECK_EQUAL(7, (int) trace.size());
+  CHECK_EQUAL(2, trace.at(3).depth);
+  delete[] x;
+  delete[] result;
+  delete s;
+}
+
 int main() {
+  TemporaryKernelCache cache;
   return UnitTest::RunAllTests();
 }
@@ -1,14 +1,17 @@
 /*
  * Sequential versions of the upsweep/downsweep phases of a scan.
+ * Templated on element type [T] and associative operator [Op] like BasicScan (see scanop.h).
  */
 
 #ifndef SEQ_SCAN_H
 #define SEQ_SCAN_H
 
 #include "log.h"
+#include "scanop.h"
 #include "utils.h"
 
 #include <cmath>
+#include <algorithm>
 #include <cstring>
 
 #define PARANOID             false
@@ -16,19 +19,22 @@
 #define DOWNSWEEP_POW2_PRINT false
 #define SCAN_ARB_PRINT       false
 
-void inline upsweep_inner(int *x, int n, int d) {
-  for (int k=0; k<n; k+=(int)pow((float)2,d+1)) {
+template <typename T, class Op>
+void inline upsweep_inner(T *x, int n, int d) {
+  int stride = 1 << (d+1);
+  for (int k=0; k<n; k+=stride) {
     //printf("d %d k %d\n", d, k);
-    int ai = k + (int)pow((float)2, d   ) - 1;
-    int bi = k + (int)pow((float)2,(d+1)) -1;
-    x[bi] = x[ai] + x[bi];
+    int ai = k + (1 << d) - 1;
+    int bi = k + stride - 1;
+    x[bi] = Op::apply(x[ai], x[bi]);
   }
 }
 
-void upsweep_pow2(int *x, int n) {
+template <typename T, class Op>
+void upsweep_pow2(T *x, int n) {
   int log2n = (int)log2(n);
   for (int d=0; d<log2n; d++) {
-    upsweep_inner(x, n, d);
+    upsweep_inner<T,Op>(x, n, d);
 #if UPSWEEP_POW2_PRINT
     std::stringstream ss;
     ss << "UPSWEEP" << d;
@@ -37,24 +43,27 @@ void upsweep_pow2(int *x, int n) {
   }
 }
 
-void inline downsweep_inner(int *x, int n, int d) {
-  for (int k=0; k<n; k+=(int)pow((float)2,d+1)) {
-    int ai = k + (int)pow((float)2, d   ) - 1;
-    int bi = k + (int)pow((float)2,(d+1)) -1;
-    int tmp = x[ai];
-              x[ai] = x[bi];
-                      x[bi] += tmp;
+template <typename T, class Op>
+void inline downsweep_inner(T *x, int n, int d) {
+  int stride = 1 << (d+1);
+  for (int k=0; k<n; k+=stride) {
+    int ai = k + (1 << d) - 1;
+    int bi = k + stride - 1;
+    T tmp = x[ai];
+            x[ai] = x[bi];
+                    x[bi] = Op::apply(x[bi], tmp);
   }
 }
 
-void downsweep_pow2(int *x, int n) {
-  x[(n-1)] = 0;
+template <typename T, class Op>
+void downsweep_pow2(T *x, int n) {
+  x[(n-1)] = Op::identity();
 #if DOWNSWEEP_POW2_PRINT
   file << atos(x, n, "CLEAR");
 #endif
   int log2n = (int)log2(n) - 1;
   for (int d=log2n; d>-1; d--) {
-    downsweep_inner(x, n, d);
+    downsweep_inner<T,Op>(x, n, d);
 #if DOWNSWEEP_POW2_PRINT
     std::stringstream ss;
     ss << "DOWNSWEEP" << d;
@@ -63,75 +72,82 @@ void downsweep_pow2(int *x, int n) {
   }
 }
 
-void scan_pow2(int *x, int n) {
-  upsweep_pow2(x, n);
-  downsweep_pow2(x, n);
+template <typename T, class Op>
+void scan_pow2(T *x, int n) {
+  upsweep_pow2<T,Op>(x, n);
+  downsweep_pow2<T,Op>(x, n);
 }
 
-void scan_pad_to_pow2(int *x, int n, int m) {
-  int *xext = new int[m];
-  memcpy(xext, x, sizeof(int)*n);
-  memset(&xext[n], 0, sizeof(int)*(m-n));
+template <typename T, class Op>
+void scan_pad_to_pow2(T *x, int n, int m) {
+  T *xext = new T[m];
+  memcpy(xext, x, sizeof(T)*n);
+  std::fill(&xext[n], &xext[m], Op::identity());
 #if PARANOID
   for (int i=0; i<m; i++) {
     if (i < n) assert(xext[i] == x[i]);
-    else       assert(xext[i] == 0   );
+    else       assert(xext[i] == Op::identity());
   }
 #endif
-  upsweep_pow2(xext, m);
-  downsweep_pow2(xext, m);
-  memcpy(x, xext, sizeof(int)*n);
+  upsweep_pow2<T,Op>(xext, m);
+  downsweep_pow2<T,Op>(xext, m);
+  memcpy(x, xext, sizeof(T)*n);
   delete[] xext;
 }
 
-inline void upsweep_subarrays(int *x, int k, int m) {
+template <typename T, class Op>
+inline void upsweep_subarrays(T *x, int k, int m) {
   for (int i=0; i<k; i++) {
-    upsweep_pow2(&x[i*m], m);
+    upsweep_pow2<T,Op>(&x[i*m], m);
   }
 }
 
-inline void get_partials(int *x, int *partials, int k, int m) {
+template <typename T>
+inline void get_partials(T *x, T *partials, int k, int m) {
   for (int i=0; i<k; i++) {
     partials[i] = x[(i*m)+(m-1)];
   }
 }
 
-inline void downsweep_subarrays(int *x, int k, int m) {
+template <typename T, class Op>
+inline void downsweep_subarrays(T *x, int k, int m) {
   for (int i=0; i<k; i++) {
-    downsweep_pow2(&x[i*m], m);
+    downsweep_pow2<T,Op>(&x[i*m], m);
   }
 }
 
-inline void add_partials(int *x, int *partials, int k, int m) {
+template <typename T, class Op>
+inline void add_partials(T *x, T *partials, int k, int m) {
   for (int i=0; i<k; i++) {
     for (int j=0; j<m; j++) {
-      x[(i*m)+j] += partials[i];
+      x[(i*m)+j] = Op::apply(partials[i], x[(i*m)+j]);
     }
   }
 }
 
-void recursive_scan_arb(int *data, int n, int m, int callnum) {
+template <typename T, class Op>
+void recursive_scan_arb(T *data, int n, int m, int callnum) {
   int k = (int) ceil((float)n/(float)m);
   if (k == 1) {
-    scan_pad_to_pow2(data, n, m);
+    scan_pad_to_pow2<T,Op>(data, n, m);
   } else {
     // extended array is composed of k subarrays
-    int *x = new int[k*m];
-    memcpy(x, data, sizeof(int)*n);
-    memset(&x[n], 0, sizeof(int)*((k*m)-n));
+    T *x = new T[k*m];
+    memcpy(x, data, sizeof(T)*n);
+    std::fill(&x[n], &x[k*m], Op::identity());
 #if PARANOID
     for (int i=0; i<k*m; i++) {
       if (i < n) assert(x[i] == data[i]);
-      else       assert(x[i] == 0      );
+      else       assert(x[i] == Op::identity());
     }
 #endif
 
     // partials array of length k
-    int *partials = new int[k];
-    memset(partials, 0, sizeof(int)*k);
+    T *partials = new T[k];
+    std::fill(partials, &partials[k], Op::identity());
 
     // do subarray-wise scan
-    upsweep_subarrays(x, k, m);
+    upsweep_subarrays<T,Op>(x, k, m);
 #if SCAN_ARB_PRINT
     file << atos(x, k*m, "SUBARRAY_UPSWEEP");
 #endif
@@ -141,21 +157,25 @@ void recursive_scan_arb(int *data, int n, int m, int callnum) {
   file << atos(partials, k, "PARTIALS");
 #endif
 
-    downsweep_subarrays(x, k, m);
+    downsweep_subarrays<T,Op>(x, k, m);
 #if SCAN_ARB_PRINT
   file << atos(xext, k*m, "SUBARRAY_DOWNSWEEP");
 #endif
 
     // do partials scan
-    recursive_scan_arb(partials, k, m, callnum+1);
+    recursive_scan_arb<T,Op>(partials, k, m, callnum+1);
 
     // fold partial scan results back
-    add_partials(x, partials, k, m);
+    add_partials<T,Op>(x, partials, k, m);
 
     // copy result back and cleanup
-    memcpy(data, x, sizeof(int)*n);
+    memcpy(data, x, sizeof(T)*n);
     delete[] x;
     delete[] partials;
   }
 }
+
+void recursive_scan_arb(int *data, int n, int m, int callnum) {
+  recursive_scan_arb<int, Add<int> >(data, n, m, callnum);
+}
 #endif
@@ -0,0 +1,222 @@
+#include "hetero.h"
+#include "tuning.h"
+
+#include <sys/time.h>
+
+static float elapsed_ms(struct timeval &start) {
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+}
+
+static double event_ms(cl_event from, cl_event to) {
+  cl_ulong start, end;
+  ASSERT_NO_CL_ERROR(
+    clGetEventProfilingInfo(from, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL));
+  ASSERT_NO_CL_ERROR(
+    clGetEventProfilingInfo(to, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL));
+  return (end - start) * 1.0e-6;
+}
+
+void HeteroScan::scan(int *data, int n) {
+  if (n < 1) {
+    return;
+  }
+  double fraction = 0;
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  last = choose(n, /*on_device=*/false, fraction);
+  if (last == HOST) {
+    scan_host(data, n);
+    t0 += elapsed_ms(start);
+  } else if (last == DEVICE) {
+    scan_device(data, n);
+    t1 += elapsed_ms(start);
+  } else {
+    scan_split(data, n, fraction);
+    t2 += elapsed_ms(start);
+  }
+  last_fraction = (last == SPLIT) ? fraction : (last == HOST ? 1.0 : 0.0);
+}
+
+/*
+ * Device data is only split if we would copy it anyway, so we never split it.
+ */
+void HeteroScan::scan(cl_mem data, int n) {
+  if (n < 1) {
+    return;
+  }
+  double fraction = 0;
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  last = choose(n, /*on_device=*/true, fraction);
+  if (last == HOST) {
+    int *x = new int[n];
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    clw.memcpy_from_dev(data, sizeof(int)*n, x);
+    double copy = elapsed_ms(t);
+    gettimeofday(&t, NULL);
+    host.scan(x, n);
+    learn(host_ms, n, elapsed_ms(t));
+    gettimeofday(&t, NULL);
+    clw.memcpy_to_dev(data, sizeof(int)*n, x);
+    learn(copy_ms, n, copy + elapsed_ms(t));
+    delete[] x;
+    t0 += elapsed_ms(start);
+    last_fraction = 1.0;
+  } else {
+    dev.scan(data, n);
+    float t = elapsed_ms(start);
+    learn(device_ms, n, t);
+    t1 += t;
+    last_fraction = 0.0;
+  }
+}
+
+void HeteroScan::scan_host(int *data, int n) {
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  host.scan(data, n);
+  learn(host_ms, n, elapsed_ms(start));
+}
+
+void HeteroScan::scan_device(int *data, int n) {
+  cl_mem d_data = pool.acquire(sizeof(int)*n);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  clw.memcpy_to_dev(d_data, sizeof(int)*n, data);
+  double copy = elapsed_ms(start);
+  gettimeofday(&start, NULL);
+  dev.scan(d_data, n);
+  learn(device_ms, n, elapsed_ms(start));
+  gettimeofday(&start, NULL);
+  clw.memcpy_from_dev(d_data, sizeof(int)*n, data);
+  learn(copy_ms, n, copy + elapsed_ms(start));
+  pool.release(d_data);
+}
+
+/*
+ * The host scans [0,h) while the device copies in and scans [h,n).
+ * The host's scan returns the reduction of its prefix, which the device then adds
+ *   to its part (the only fix-up) before copying it back.
+ */
+void HeteroScan::scan_split(int *data, int n, double fraction) {
+  int h = (int) (n * fraction);
+  h = max(1, min(n-1, h));
+  int d = n - h;
+  cl_mem d_data = pool.acquire(sizeof(int)*d);
+  cl_command_queue queue = clw.get_command_queue();
+  cl_event uploaded;
+  ASSERT_NO_CL_ERROR(
+    clEnqueueWriteBuffer(queue, d_data, CL_FALSE, 0, sizeof(int)*d, &data[h], 0, NULL, &uploaded));
+  cl_event scanned = dev.scan_async(d_data, d_data, d, uploaded);
+  ASSERT_NO_CL_ERROR(clFlush(queue));
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  int offset = host.scan(data, h);
+  learn(host_ms, h, elapsed_ms(start));
+
+  ASSERT_NO_CL_ERROR(clWaitForEvents(1, &scanned));
+  gettimeofday(&start, NULL);
+  dev.add_carry(d_data, d, offset);
+  clw.memcpy_from_dev(d_data, sizeof(int)*d, &data[h]);
+  double fixup = elapsed_ms(start);
+  // without profiling we cannot tell how long the device part took while the host was busy
+  if (clw.has_profiling()) {
+    double upload = event_ms(uploaded, uploaded);
+    learn(device_ms, d, event_ms(uploaded, scanned) - upload);
+    learn(copy_ms, d, upload + fixup);
+  }
+  ASSERT_NO_CL_ERROR(clReleaseEvent(uploaded));
+  ASSERT_NO_CL_ERROR(clReleaseEvent(scanned));
+  pool.release(d_data);
+}
+
+/*
+ * Estimated time (ms) for [n] elements from the running average of its bucket, or -1.
+ */
+double HeteroScan::estimate(vector<double> &ms, int n) {
+  double per_element = ms[tuning_bucket(n)];
+  return per_element < 0 ? -1 : per_element * n;
+}
+
+/*
+ * Fold a measured time [t] (ms) for [n] elements into the average of its bucket.
+ * We average the time per element so that any [n] in the bucket counts alike.
+ */
+void HeteroScan::learn(vector<double> &ms, int n, double t) {
+  if (n < 1) {
+    return;
+  }
+  double &avg = ms[tuning_bucket(n)];
+  double per_element = t / n;
+  avg = (avg < 0) ? per_element : 0.75*avg + 0.25*per_element;
+}
+
+/*
+ * If the host takes [th] and the device (with copies) [td], then splitting at host share
+ *   f = td/(th+td) finishes both at once, in th*td/(th+td).
+ * This ignores the fixed costs of the device (launches, the fix-up), so we only split
+ *   when it is predicted to save at least 20% (ie, neither side is 4x faster).
+ */
+HeteroScan::placement HeteroScan::choose(int n, bool on_device, double &fraction) {
+  if (policy != AUTO) {
+    if (policy == SPLIT && (on_device || n < 2)) {
+      return on_device ? DEVICE : HOST;
+    }
+    fraction = 0.5;
+    if (policy == SPLIT) {
+      double th = estimate(host_ms, n);
+      double td = estimate(device_ms, n) + estimate(copy_ms, n);
+      if (th > 0 && estimate(device_ms, n) > 0 && estimate(copy_ms, n) > 0) {
+        fraction = td / (th + td);
+      }
+    }
+    return policy;
+  }
+  double th = estimate(host_ms, n);
+  double td = estimate(device_ms, n);
+  double tc = estimate(copy_ms, n);
+  // try each engine once per bucket
+  if (th < 0) {
+    return HOST;
+  }
+  if (td < 0 || tc < 0) {
+    return DEVICE;
+  }
+  if (on_device) {
+    return (th + tc < td) ? HOST : DEVICE;
+  }
+  td += tc;
+  if (n >= min_split) {
+    double split = th * td / (th + td);
+    if (split < 0.8 * min(th, td)) {
+      fraction = td / (th + td);
+      return SPLIT;
+    }
+  }
+  return (th <= td) ? HOST : DEVICE;
+}
+
+HeteroScan::HeteroScan(CLWrapper &clw, size_t wx, int nthreads, int min_split) : clw(clw),
+  dev(clw, wx), host(nthreads), pool(clw),
+  policy(AUTO), last(AUTO), last_fraction(0), min_split(min_split),
+  host_ms(31, -1.0), device_ms(31, -1.0), copy_ms(31, -1.0),
+  t0(0), t1(0), t2(0) {
+}
+
+void HeteroScan::reset_timers() {
+  t0 = t1 = t2 = 0;
+  dev.reset_timers();
+  host.reset_timers();
+}
+
+void HeteroScan::get_timers(map<string,float> &timings) {
+  timings.insert(make_pair("HETERO1. host  ", t0));
+  timings.insert(make_pair("HETERO2. device", t1));
+  timings.insert(make_pair("HETERO3. split ", t2));
+  dev.get_timers(timings);
+  host.get_timers(timings);
+}
@@ -0,0 +1,72 @@
+#ifndef HETERO_H
+#define HETERO_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "parscan.h"
+#include "scan.h"
+
+/*
+ * Exclusive scan of int that picks the host, the device or both for each call.
+ *
+ * The host engine is ParallelScan (parallel_cpu) and the device engine is Scan (harris).
+ * For each size bucket (n in [2^b, 2^(b+1))) we keep a running average of the time of
+ *   each engine, including the copies to or from the device where the data is not
+ *   where the engine needs it. The first calls of a bucket try each engine once;
+ *   after that we take the faster engine, or split host data when both are close:
+ *   the host scans a prefix while the device scans the rest, in proportion to their
+ *   measured throughput, and the device adds the host's total to its part (one fix-up)
+ *   before copying it back.
+ * Split runs refine the averages too (the device part from event profiling, if enabled).
+ */
+class HeteroScan {
+  public:
+    enum placement {
+      AUTO,    // choose from the measured times (only as a policy)
+      HOST,    // ParallelScan on the host
+      DEVICE,  // Scan on the device
+      SPLIT    // host prefix and device suffix concurrently
+    };
+
+  private:
+    CLWrapper &clw;
+    Scan dev;
+    ParallelScan host;
+    BufferPool pool;
+    placement policy;      // AUTO or a forced placement
+    placement last;        // placement of the last scan
+    double last_fraction;  // host share of the last split
+    int min_split;         // smallest n we split
+
+    // running averages (ms) per size bucket; negative until measured
+    vector<double> host_ms;   // host engine on host data
+    vector<double> device_ms; // device engine on device data
+    vector<double> copy_ms;   // copying n elements to and from the device
+
+    //timings
+    float t0; float t1; float t2; //host, device, split
+
+    double estimate(vector<double> &ms, int n);
+    void learn(vector<double> &ms, int n, double t);
+    placement choose(int n, bool on_device, double &fraction);
+    void scan_host(int *data, int n);
+    void scan_device(int *data, int n);
+    void scan_split(int *data, int n, double fraction);
+
+  public:
+    HeteroScan(CLWrapper &clw, size_t wx=256, int nthreads=0, int min_split=1<<18);
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    // force a placement for every call (AUTO to choose again)
+    void set_policy(placement p) { policy = p; }
+    placement last_placement() { return last; }
+    double last_host_fraction() { return last_fraction; }
+
+    // inplace scan of host [data]
+    void scan(int *data, int n);
+    // inplace scan of device buffer [data] (the split is only for host data)
+    void scan(cl_mem data, int n);
+};
+
+#endif
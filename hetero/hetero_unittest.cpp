@@ -0,0 +1,81 @@
+#include "clwrapper.h"
+#include "hetero.h"
+#include "programcache.h"
+#include "scanref.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+void check_scan(HeteroScan &s, int n) {
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 100);
+  exclusive_scan_host(result, x, n);
+  s.scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+}
+
+TEST(ForcedPlacements) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  HeteroScan s(clw, /*wx=*/128);
+  HeteroScan::placement p[] = { HeteroScan::HOST, HeteroScan::DEVICE, HeteroScan::SPLIT };
+  for (int i=0; i<3; i++) {
+    s.set_policy(p[i]);
+    check_scan(s, 10001);
+    CHECK_EQUAL(p[i], s.last_placement());
+  }
+}
+
+TEST(Split_Shares) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  HeteroScan s(clw, /*wx=*/128);
+  s.set_policy(HeteroScan::SPLIT);
+  for (int n=2; n<5000; n=n*3+1) {
+    check_scan(s, n);
+    CHECK(s.last_host_fraction() > 0 && s.last_host_fraction() < 1);
+  }
+}
+
+/*
+ * The first scans of a size try each engine; after that every choice must still be correct.
+ */
+TEST(Auto_Learns) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  HeteroScan s(clw, /*wx=*/128, /*nthreads=*/0, /*min_split=*/1024);
+  check_scan(s, 20000);
+  CHECK_EQUAL(HeteroScan::HOST, s.last_placement());
+  check_scan(s, 20000);
+  CHECK_EQUAL(HeteroScan::DEVICE, s.last_placement());
+  for (int i=0; i<4; i++) {
+    check_scan(s, 20000);
+    CHECK(s.last_placement() != HeteroScan::AUTO);
+  }
+}
+
+TEST(DeviceData) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  HeteroScan s(clw, /*wx=*/128);
+  int n = 30000;
+  int *x = new int[n];
+  int *result = new int[n];
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*n);
+  for (int run=0; run<4; run++) {
+    fill_random_data(x, n, 100);
+    exclusive_scan_host(result, x, n);
+    clw.memcpy_to_dev(d_x, sizeof(int)*n, x);
+    s.scan(d_x, n);
+    CHECK(s.last_placement() != HeteroScan::SPLIT);
+    clw.memcpy_from_dev(d_x, sizeof(int)*n, x);
+    CHECK_ARRAY_EQUAL(result, x, n);
+  }
+  clw.dev_free(d_x);
+  delete[] x;
+  delete[] result;
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
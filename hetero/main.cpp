@@ -0,0 +1,37 @@
+#include "clwrapper.h"
+#include "framework.h"
+#include "hetero.h"
+
+#include <cstring>
+
+using namespace std;
+
+/*
+ * -a 0 chooses the placement of each scan, -a 1 forces the host, -a 2 the device
+ *   and -a 3 the split.
+ */
+void run(int *data, int n, int num_iter, map<string,float> &timings) {
+  // PLATFORM AND DEVICE INFO
+  if (opt.verbose) {
+    cout << clinfo();
+  }
+
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  HeteroScan *s = new HeteroScan(clw, opt.wx, opt.nthreads);
+  s->set_policy((HeteroScan::placement) opt.variant);
+
+  const char *names[] = { "auto", "host", "device", "split" };
+  int *x = new int[n];
+  for (int run=0; run<num_iter; run++) {
+    memcpy(x, data, n*sizeof(int));
+    s->scan(x, n);
+    if (opt.debug) {
+      printf("# run %d: %s (host share %.3f)\n", run, names[s->last_placement()], s->last_host_fraction());
+    }
+  }
+  memcpy(data, x, n*sizeof(int));
+  delete[] x;
+
+  s->get_timers(timings);
+  delete s;
+}
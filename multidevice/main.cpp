@@ -0,0 +1,33 @@
+#include "clwrapper.h"
+#include "framework.h"
+#include "multiscan.h"
+
+#include <cstring>
+
+using namespace std;
+
+/*
+ * Scan across every OpenCL device of every platform.
+ */
+void run(int *data, int n, int num_iter, map<string,float> &timings) {
+  vector<CLWrapper *> devices = open_all_devices(/*profiling=*/true);
+  if (opt.verbose) {
+    cout << clinfo();
+    cout << "# Devices: " << devices.size() << endl;
+  }
+  MultiScan *s = new MultiScan(devices, opt.wx);
+
+  int *x = new int[n];
+  for (int run=0; run<num_iter; run++) {
+    memcpy(x, data, n*sizeof(int));
+    s->scan(x, n);
+  }
+  memcpy(data, x, n*sizeof(int));
+  delete[] x;
+
+  s->get_timers(timings);
+  delete s;
+  for (size_t i=0; i<devices.size(); i++) {
+    delete devices[i];
+  }
+}
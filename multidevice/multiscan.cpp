@@ -0,0 +1,186 @@
+#include "multiscan.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+
+static float elapsed_ms(struct timeval &start) {
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+}
+
+/*
+ * Run [fn] over [parts] with one thread per partition.
+ * The caller runs partition 0 itself rather than idling in pthread_join.
+ */
+static void fork_join(void *(*fn)(void *), void **parts, int nparts) {
+  if (nparts < 1) return;
+  vector<pthread_t> threads(nparts);
+  for (int i=1; i<nparts; i++) {
+    pthread_create(&threads[i], NULL, fn, parts[i]);
+  }
+  fn(parts[0]);
+  for (int i=1; i<nparts; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/*
+ * Phase 1: copy in and scan the partition, keeping the result on the device.
+ * A partition may be empty if its device has a tiny weight.
+ */
+template <typename T, class Op>
+void *BasicMultiScan<T,Op>::scan_partition(void *arg) {
+  partition *p = (partition *) arg;
+  BasicMultiScan *self = p->self;
+  CLWrapper &clw = *self->devices[p->device];
+  int len = p->hi - p->lo;
+  if (len == 0) {
+    return NULL;
+  }
+  p->d_data = self->pools[p->device]->acquire(sizeof(T)*len);
+  clw.memcpy_to_dev(p->d_data, sizeof(T)*len, &p->data[p->lo]);
+  self->scans[p->device]->scan(p->d_data, p->d_data, len, &p->total);
+  return NULL;
+}
+
+/*
+ * Phase 3: combine the offset into the partition and copy it back.
+ * The first partition has nothing before it.
+ */
+template <typename T, class Op>
+void *BasicMultiScan<T,Op>::offset_partition(void *arg) {
+  partition *p = (partition *) arg;
+  BasicMultiScan *self = p->self;
+  CLWrapper &clw = *self->devices[p->device];
+  int len = p->hi - p->lo;
+  if (len == 0) {
+    return NULL;
+  }
+  if (p->lo > 0) {
+    self->scans[p->device]->add_carry(p->d_data, len, p->offset);
+  }
+  clw.memcpy_from_dev(p->d_data, sizeof(T)*len, &p->data[p->lo]);
+  self->pools[p->device]->release(p->d_data);
+  return NULL;
+}
+
+template <typename T, class Op>
+void BasicMultiScan<T,Op>::scan(T *data, int n) {
+  if (n < 1) {
+    return;
+  }
+  // use fewer devices than we have if each would get less than [min_partition] elements
+  int nparts = max(1, min(num_devices(), n / max(min_partition, 1)));
+  double sum = 0;
+  for (int i=0; i<nparts; i++) {
+    sum += weights[i];
+  }
+  vector<partition> parts(nparts);
+  vector<void *> args(nparts);
+  double acc = 0;
+  for (int i=0; i<nparts; i++) {
+    partition &p = parts[i];
+    p.self = this;
+    p.device = i;
+    p.data = data;
+    p.lo = (i == 0) ? 0 : parts[i-1].hi;
+    acc += weights[i];
+    p.hi = (i == nparts-1) ? n : max(p.lo, (int) (n * (acc / sum)));
+    p.total = Op::identity();
+    p.offset = Op::identity();
+    args[i] = &p;
+  }
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  fork_join(scan_partition, &args[0], nparts);
+  t0 += elapsed_ms(start);
+
+  gettimeofday(&start, NULL);
+  T acc_total = Op::identity();
+  for (int i=0; i<nparts; i++) {
+    parts[i].offset = acc_total;
+    acc_total = Op::apply(acc_total, parts[i].total);
+  }
+  t1 += elapsed_ms(start);
+
+  gettimeofday(&start, NULL);
+  fork_join(offset_partition, &args[0], nparts);
+  t2 += elapsed_ms(start);
+}
+
+template <typename T, class Op>
+void BasicMultiScan<T,Op>::set_weights(const vector<double> &w) {
+  for (int i=0; i<num_devices(); i++) {
+    weights[i] = (i < (int) w.size() && w[i] > 0) ? w[i] : 1.0;
+  }
+}
+
+template <typename T, class Op>
+BasicMultiScan<T,Op>::BasicMultiScan(vector<CLWrapper *> &devices, size_t wx, int min_partition) :
+  devices(devices), weights(devices.size(), 1.0), min_partition(min_partition),
+  t0(0), t1(0), t2(0) {
+  for (size_t i=0; i<devices.size(); i++) {
+    CLWrapper &clw = *devices[i];
+    scans.push_back(new BasicScan<T,Op>(clw, wx));
+    pools.push_back(new BufferPool(clw));
+  }
+}
+
+template <typename T, class Op>
+BasicMultiScan<T,Op>::~BasicMultiScan() {
+  for (size_t i=0; i<devices.size(); i++) {
+    delete pools[i];
+    delete scans[i];
+  }
+}
+
+template <typename T, class Op>
+void BasicMultiScan<T,Op>::reset_timers() {
+  t0 = t1 = t2 = 0;
+}
+
+template <typename T, class Op>
+void BasicMultiScan<T,Op>::get_timers(map<string,float> &timings) {
+  timings.insert(make_pair("MULTI1. scan_partitions  ", t0));
+  timings.insert(make_pair("MULTI2. scan_totals      ", t1));
+  timings.insert(make_pair("MULTI3. offset_partitions", t2));
+}
+
+vector<CLWrapper *> open_all_devices(bool profiling) {
+  vector<CLWrapper *> devices;
+  cl_uint nplatforms = 0;
+  if (clGetPlatformIDs(0, NULL, &nplatforms) != CL_SUCCESS || nplatforms == 0) {
+    return devices;
+  }
+  vector<cl_platform_id> platforms(nplatforms);
+  ASSERT_NO_CL_ERROR(clGetPlatformIDs(nplatforms, &platforms[0], NULL));
+  for (cl_uint p=0; p<nplatforms; p++) {
+    cl_uint ndevices = 0;
+    if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &ndevices) != CL_SUCCESS) {
+      continue;
+    }
+    for (cl_uint d=0; d<ndevices; d++) {
+      devices.push_back(new CLWrapper(p, d, profiling));
+    }
+  }
+  return devices;
+}
+
+template class BasicMultiScan<int,     Add<int> >;
+template class BasicMultiScan<int,     Max<int> >;
+template class BasicMultiScan<int,     Min<int> >;
+template class BasicMultiScan<int,     And<int> >;
+template class BasicMultiScan<int,     Or<int> >;
+template class BasicMultiScan<int64_t, Add<int64_t> >;
+template class BasicMultiScan<int64_t, Max<int64_t> >;
+template class BasicMultiScan<int64_t, Min<int64_t> >;
+template class BasicMultiScan<int64_t, And<int64_t> >;
+template class BasicMultiScan<int64_t, Or<int64_t> >;
+template class BasicMultiScan<float,   Add<float> >;
+template class BasicMultiScan<float,   Max<float> >;
+template class BasicMultiScan<float,   Min<float> >;
+template class BasicMultiScan<double,  Add<double> >;
+template class BasicMultiScan<double,  Max<double> >;
+template class BasicMultiScan<double,  Min<double> >;
@@ -0,0 +1,77 @@
+#ifndef MULTISCAN_H
+#define MULTISCAN_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "scan.h"
+
+#include <vector>
+
+/*
+ * Exclusive scan of one array split across several OpenCL devices.
+ *
+ * The array is cut into one contiguous partition per device (in proportion to the
+ *   device weights) and scanned in three phases:
+ *   1. each device copies in and scans its partition (with its own Scan) and returns its total,
+ *   2. the host scans the partition totals (there are only as many as devices),
+ *   3. each device combines the total of the preceding partitions into its partition
+ *      and copies it back.
+ * Each device is driven by its own thread so the phases run concurrently on all devices.
+ *
+ * [devices] are CLWrappers of different devices (see open_all_devices);
+ *   they must outlive the MultiScan. Partitions are never shorter than [min_partition]
+ *   elements, so small arrays use fewer devices.
+ * Instantiated for the same specializations as BasicScan.
+ */
+template <typename T, class Op=Add<T> >
+class BasicMultiScan {
+  private:
+    struct partition {
+      BasicMultiScan *self;
+      int device;
+      T *data;
+      int lo;       // first element of partition
+      int hi;       // one past last element of partition
+      T total;      // reduction of the partition (phase 1)
+      T offset;     // reduction of the preceding partitions (phase 3)
+      cl_mem d_data;
+    };
+
+    vector<CLWrapper *> devices;
+    vector<BasicScan<T,Op> *> scans;
+    vector<BufferPool *> pools;
+    vector<double> weights;
+    int min_partition;
+
+    //timings
+    float t0; float t1; float t2; //scan partitions, scan totals, offset partitions
+
+    static void *scan_partition(void *arg);
+    static void *offset_partition(void *arg);
+
+  public:
+    BasicMultiScan(vector<CLWrapper *> &devices, size_t wx=256, int min_partition=1<<16);
+    ~BasicMultiScan();
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    int num_devices() { return (int) devices.size(); }
+
+    /*
+     * Relative throughput of each device (default: all equal),
+     *   eg, to give a discrete GPU a bigger share than an integrated one.
+     */
+    void set_weights(const vector<double> &w);
+
+    void scan(T *data, int n);
+};
+
+typedef BasicMultiScan<int, Add<int> > MultiScan;
+
+/*
+ * A CLWrapper for every device of every platform (caller deletes them).
+ * Sub-devices are only included if the runtime lists them as devices.
+ */
+vector<CLWrapper *> open_all_devices(bool profiling=false);
+
+#endif
@@ -0,0 +1,71 @@
+#include "clwrapper.h"
+#include "multiscan.h"
+#include "programcache.h"
+#include "scanref.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+/*
+ * Several CLWrappers of the same device stand in for several devices.
+ */
+template <typename T, class Op>
+void multi_test(int n, int ndevices, int min_partition, const vector<double> &weights) {
+  vector<CLWrapper *> devices;
+  for (int i=0; i<ndevices; i++) {
+    devices.push_back(new CLWrapper(/*platform=*/0,/*device=*/0,/*profiling=*/true));
+  }
+  BasicMultiScan<T,Op> *s = new BasicMultiScan<T,Op>(devices, /*wx=*/128, min_partition);
+  s->set_weights(weights);
+  T *x = new T[n];
+  T *result = new T[n];
+  for (int i=0; i<n; i++) {
+    x[i] = (T) rand_int(n);
+  }
+  exclusive_scan_host<T,Op>(result, x, n);
+  s->scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete s;
+  for (int i=0; i<ndevices; i++) {
+    delete devices[i];
+  }
+  delete[] x;
+  delete[] result;
+}
+
+TEST(TwoDevices_100000) {
+  multi_test<int, Add<int> >(100000, 2, /*min_partition=*/1024, vector<double>());
+}
+
+TEST(ThreeDevices_Weighted_100001) {
+  vector<double> w;
+  w.push_back(1);
+  w.push_back(3);
+  w.push_back(0.5);
+  multi_test<int, Add<int> >(100001, 3, /*min_partition=*/1024, w);
+}
+
+TEST(EmptyPartition) {
+  vector<double> w;
+  w.push_back(1);
+  w.push_back(1e-9);
+  w.push_back(1);
+  multi_test<int, Add<int> >(5000, 3, /*min_partition=*/1, w);
+}
+
+TEST(FewerPartitionsThanDevices) {
+  multi_test<int, Add<int> >(3000, 4, /*min_partition=*/1024, vector<double>());
+}
+
+TEST(Int64_Max_50000) {
+  multi_test<int64_t, Max<int64_t> >(50000, 2, /*min_partition=*/1024, vector<double>());
+}
+
+TEST(Tiny) {
+  multi_test<int, Add<int> >(1, 2, /*min_partition=*/1, vector<double>());
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
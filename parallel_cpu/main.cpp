@@ -0,0 +1,21 @@
+#include "framework.h"
+#include "parscan.h"
+
+#include <cstring>
+
+using namespace std;
+
+void run(int *data, int n, int num_iter, map<string,float> &timings) {
+  ParallelScan *s = new ParallelScan(opt.nthreads);
+
+  int *x = new int[n];
+  for (int run=0; run<num_iter; run++) {
+    memcpy(x, data, n*sizeof(int));
+    s->scan(x, n);
+  }
+  memcpy(data, x, n*sizeof(int));
+  delete[] x;
+
+  s->get_timers(timings);
+  delete s;
+}
@@ -0,0 +1,190 @@
+#include "parscan.h"
+#include "simdscan.h"
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct block {
+  int *data;
+  int lo;    // first element of block
+  int hi;    // one past last element of block
+  int total; // reduction of the block (phase 1) or exclusive prefix of the block (phase 3)
+  int next;  // exclusive prefix of the following block (phase 3)
+};
+
+static void *reduce_block(void *arg) {
+  block *b = (block *)arg;
+  b->total = reduce_simd(&b->data[b->lo], b->hi - b->lo);
+  return NULL;
+}
+
+static void *scan_block(void *arg) {
+  block *b = (block *)arg;
+  b->next = exclusive_scan_simd(&b->data[b->lo], &b->data[b->lo], b->hi - b->lo, b->total);
+  return NULL;
+}
+
+/*
+ * Wait for each phase and run our block of it, until told to quit.
+ */
+void *ParallelScan::worker_main(void *arg) {
+  worker *w = (worker *)arg;
+  ParallelScan *s = w->owner;
+  int seen = 0;
+  pthread_mutex_lock(&s->lock);
+  while (true) {
+    while (s->generation == seen && !s->quit) {
+      pthread_cond_wait(&s->phase_start, &s->lock);
+    }
+    if (s->quit) break;
+    seen = s->generation;
+    int i = w->index + 1;
+    if (i < s->job_nblocks) {
+      void *(*fn)(void *) = s->job;
+      block *b = &s->job_blocks[i];
+      pthread_mutex_unlock(&s->lock);
+      fn(b);
+      pthread_mutex_lock(&s->lock);
+      if (--s->pending == 0) {
+        pthread_cond_signal(&s->phase_done);
+      }
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+void ParallelScan::start_workers() {
+  nworkers = nthreads - 1;
+  threads = new pthread_t[nworkers];
+  workers = new worker[nworkers];
+  for (int i=0; i<nworkers; i++) {
+    workers[i].owner = this;
+    workers[i].index = i;
+    pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+  }
+}
+
+/*
+ * Run [fn] over blocks [0, nblocks) with one thread per block.
+ * The caller runs block 0 itself and then waits at the barrier for the workers.
+ */
+void ParallelScan::fork_join(void *(*fn)(void *), block *blocks, int nblocks) {
+  if (nblocks < 1) return;
+  if (nblocks > 1) {
+    if (nworkers == 0) {
+      start_workers();
+    }
+    pthread_mutex_lock(&lock);
+    job = fn;
+    job_blocks = blocks;
+    job_nblocks = nblocks;
+    pending = nblocks - 1;
+    generation++;
+    pthread_cond_broadcast(&phase_start);
+    pthread_mutex_unlock(&lock);
+  }
+  fn(&blocks[0]);
+  if (nblocks > 1) {
+    pthread_mutex_lock(&lock);
+    while (pending > 0) {
+      pthread_cond_wait(&phase_done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+static float elapsed_ms(struct timeval &start) {
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+}
+
+int ParallelScan::scan(int *data, int n, int carry) {
+  // use fewer threads than requested if each would get less than [grain] elements
+  int nblocks = (n + grain - 1) / grain;
+  if (nblocks > nthreads) nblocks = nthreads;
+  if (nblocks < 1)        nblocks = 1;
+
+  block *blocks = new block[nblocks];
+  // in 64 bits, since (i+1)*len can pass INT_MAX when n is close to it
+  int64_t len = ((int64_t) n + nblocks - 1) / nblocks;
+  for (int i=0; i<nblocks; i++) {
+    int64_t lo = i*len;
+    int64_t hi = (i+1)*len;
+    blocks[i].data = data;
+    blocks[i].lo = (int) (lo < n ? lo : n);
+    blocks[i].hi = (int) (hi < n ? hi : n);
+    blocks[i].total = 0;
+    blocks[i].next = 0;
+  }
+
+  struct timeval start;
+  // the last block's total is never needed
+  gettimeofday(&start, NULL);
+  fork_join(reduce_block, blocks, nblocks-1);
+  t0 += elapsed_ms(start);
+
+  gettimeofday(&start, NULL);
+  int sum = carry;
+  for (int i=0; i<nblocks; i++) {
+    int tmp = blocks[i].total;
+              blocks[i].total = sum;
+                                sum += tmp;
+  }
+  t1 += elapsed_ms(start);
+
+  gettimeofday(&start, NULL);
+  fork_join(scan_block, blocks, nblocks);
+  t2 += elapsed_ms(start);
+
+  int next = blocks[nblocks-1].next;
+  delete[] blocks;
+  return next;
+}
+
+ParallelScan::ParallelScan(int nthreads, int grain) : nthreads(nthreads), grain(grain),
+  threads(NULL), workers(NULL), nworkers(0), generation(0), pending(0), quit(false),
+  job(NULL), job_blocks(NULL), job_nblocks(0),
+  t0(0), t1(0), t2(0) {
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&phase_start, NULL);
+  pthread_cond_init(&phase_done, NULL);
+  if (this->nthreads < 1) {
+    this->nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (this->nthreads < 1) {
+    this->nthreads = 1;
+  }
+  if (this->grain < 1) {
+    this->grain = 1;
+  }
+  // pick the vector instruction set now rather than racing on it from the workers
+  simd_isa();
+}
+
+ParallelScan::~ParallelScan() {
+  pthread_mutex_lock(&lock);
+  quit = true;
+  pthread_cond_broadcast(&phase_start);
+  pthread_mutex_unlock(&lock);
+  for (int i=0; i<nworkers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  delete[] threads;
+  delete[] workers;
+  pthread_cond_destroy(&phase_done);
+  pthread_cond_destroy(&phase_start);
+  pthread_mutex_destroy(&lock);
+}
+
+void ParallelScan::reset_timers() {
+  t0 = t1 = t2 = 0;
+}
+
+void ParallelScan::get_timers(map<string,float> &timings) {
+  timings.insert(make_pair("PARSCAN1. reduce_blocks", t0));
+  timings.insert(make_pair("PARSCAN2. scan_totals  ", t1));
+  timings.insert(make_pair("PARSCAN3. scan_blocks  ", t2));
+}
@@ -0,0 +1,72 @@
+#ifndef PARSCAN_H
+#define PARSCAN_H
+
+#include <map>
+#include <pthread.h>
+#include <string>
+
+using namespace std;
+
+struct block;
+
+/*
+ * Multithreaded exclusive scan for the host.
+ *
+ * The array is split into one contiguous block per thread and scanned in three phases:
+ *   1. each thread reduces its block to a single total,
+ *   2. the block totals are scanned (sequentially, there are only [nthreads] of them),
+ *   3. each thread scans its block, seeded with the scanned total of the preceding blocks.
+ * Each element is read twice and written once, so large arrays run close to memory bandwidth.
+ *
+ * The [nthreads]-1 worker threads are started on the first scan that needs them and kept
+ *   until the ParallelScan is destroyed; each phase wakes them and waits for them at a barrier.
+ * So one ParallelScan must not be used by several threads at once.
+ */
+class ParallelScan {
+  private:
+    int nthreads; // number of worker threads (including the caller)
+    int grain;    // minimum number of elements per thread
+
+    // persistent workers; worker i runs block i+1 of each phase (the caller runs block 0)
+    struct worker {
+      ParallelScan *owner;
+      int index;
+    };
+    pthread_t *threads;
+    worker *workers;
+    int nworkers;                 // started so far (0 or nthreads-1)
+    pthread_mutex_t lock;
+    pthread_cond_t phase_start;   // a new phase (or quit) is posted
+    pthread_cond_t phase_done;    // the last worker of the phase finished
+    int generation;               // phases posted so far
+    int pending;                  // workers still running the current phase
+    bool quit;
+    void *(*job)(void *);         // the current phase
+    block *job_blocks;
+    int job_nblocks;
+
+    static void *worker_main(void *arg);
+    void start_workers();
+    void fork_join(void *(*fn)(void *), block *blocks, int nblocks);
+
+    // not copyable (owns threads)
+    ParallelScan(const ParallelScan &);
+    ParallelScan &operator=(const ParallelScan &);
+
+    //timings
+    float t0; float t1; float t2; //reduce, scan totals, scan blocks
+
+  public:
+    ParallelScan(int nthreads=0, int grain=16384);
+    ~ParallelScan();
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    /*
+     * Inplace scan where every output is offset by [carry].
+     * Returns the reduction of [data] plus [carry] (ie, the carry for a following chunk).
+     */
+    int scan(int *data, int n, int carry=0);
+};
+
+#endif
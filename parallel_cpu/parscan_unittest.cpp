@@ -0,0 +1,111 @@
+#include "parscan.h"
+#include "scanref.h"
+#include "simdscan.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#define N 8
+
+TEST(Simple) {
+  ParallelScan *s = new ParallelScan(/*nthreads=*/4, /*grain=*/1);
+  int x[N]            = { 3, 1, 7,  0,  4,  1,  6,  3 };
+  const int result[N] = { 0, 3, 4, 11, 11, 15, 16, 22 };
+  s->scan(x, N);
+  CHECK_ARRAY_EQUAL(result, x, N);
+  delete s;
+}
+
+void random_test(int n, int nthreads, int grain) {
+  ParallelScan *s = new ParallelScan(nthreads, grain);
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, n);
+  exclusive_scan_host(result, x, n);
+  s->scan(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+  delete s;
+}
+
+TEST(Random_1) {
+  random_test(1, 4, 1);
+}
+
+TEST(Random_1023_UnevenBlocks) {
+  random_test(1023, 7, 1);
+}
+
+TEST(Random_1048576) {
+  random_test(1048576, 8, 16384);
+}
+
+TEST(Chunks_CarryAcross) {
+  // scanning in chunks and passing the carry on matches a single scan
+  ParallelScan *s = new ParallelScan(/*nthreads=*/4, /*grain=*/1000);
+  int n = 100003;
+  int chunk = 30000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 100);
+  exclusive_scan_host(result, x, n);
+  int last = x[n-1];
+  int carry = 0;
+  for (int lo=0; lo<n; lo+=chunk) {
+    carry = s->scan(&x[lo], (lo+chunk < n) ? chunk : n-lo, carry);
+  }
+  CHECK_ARRAY_EQUAL(result, x, n);
+  CHECK_EQUAL(result[n-1] + last, carry);
+  delete[] x;
+  delete[] result;
+  delete s;
+}
+
+TEST(Reuse_VaryingBlocks) {
+  // the workers persist across scans that use all, some or none of them
+  ParallelScan *s = new ParallelScan(/*nthreads=*/6, /*grain=*/1000);
+  int sizes[] = { 100000, 2500, 10, 6000, 100000, 1 };
+  for (int t=0; t<6; t++) {
+    int n = sizes[t];
+    int *x = new int[n];
+    int *result = new int[n];
+    fill_random_data(x, n, 100);
+    exclusive_scan_host(result, x, n);
+    s->scan(x, n);
+    CHECK_ARRAY_EQUAL(result, x, n);
+    delete[] x;
+    delete[] result;
+  }
+  delete s;
+}
+
+TEST(Simd_OddLengths) {
+  // every vector width and tail length, checked against a plain loop,
+  // for every instruction set the cpu supports (not only the dispatched one)
+  const simd_impl *impls;
+  int nimpls = simd_impls(&impls);
+  CHECK(nimpls >= 1);
+  CHECK_EQUAL(simd_isa(), impls[0].isa);
+  for (int k=0; k<nimpls; k++) {
+    for (int n=0; n<70; n++) {
+      int *x = new int[n+1];
+      int *y = new int[n+1];
+      fill_random_data(x, n+1, 100);
+      int sum = 5;
+      for (int i=0; i<n; i++) {
+        y[i] = sum;
+        sum += x[i];
+      }
+      CHECK_EQUAL(sum-5, impls[k].reduce(x, n));
+      CHECK_EQUAL(sum, impls[k].exclusive_scan(x, x, n, /*carry=*/5));
+      CHECK_ARRAY_EQUAL(y, x, n);
+      delete[] x;
+      delete[] y;
+    }
+  }
+}
+
+int main() {
+  return UnitTest::RunAllTests();
+}
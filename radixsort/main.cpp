@@ -0,0 +1,42 @@
+#include "clwrapper.h"
+#define SORTED true
+#include "framework.h"
+#include "radixsort.h"
+
+#include <cstring>
+
+using namespace std;
+
+/*
+ * -a 0 sorts keys only and -a 1 sorts key-value pairs (with the original index as value).
+ */
+void run(int *data, int n, int num_iter, map<string,float> &timings) {
+  // PLATFORM AND DEVICE INFO
+  if (opt.verbose) {
+    cout << clinfo();
+  }
+
+  // BUILD PROGRAM AND KERNELS
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  RadixSort *s = new RadixSort(clw, opt.wx);
+
+  int *x = new int[n];
+  int *v = new int[n];
+  for (int run=0; run<num_iter; run++) {
+    memcpy(x, data, n*sizeof(int));
+    if (opt.variant == 1) {
+      for (int i=0; i<n; i++) {
+        v[i] = i;
+      }
+      s->sort(x, v, n);
+    } else {
+      s->sort(x, n);
+    }
+  }
+  memcpy(data, x, n*sizeof(int));
+  delete[] x;
+  delete[] v;
+
+  // INSERT TIMINGS
+  s->get_timers(timings);
+}
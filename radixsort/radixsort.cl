@@ -0,0 +1,179 @@
+/*
+ * Least-significant-digit radix sort built on a scan
+ *   ("Designing Efficient Sorting Algorithms for Manycore GPUs" (SATISH ET AL)
+ *    and the radix sort application in HARRIS Section 39.3.3).
+ *
+ * K is the key type (int or long, set by the RadixSort constructor).
+ * Keys are signed so we flip the sign bit when extracting digits.
+ * Values (if any) are int and move with their keys.
+ *
+ * Each pass sorts on one RADIX_BITS digit:
+ *   [sort_tiles] sorts each tile of m = 2*wx keys by the digit in local memory
+ *     (RADIX_BITS one-bit splits, each an exclusive scan in local memory) and writes
+ *     the per-tile digit counts into [hist] in digit-major order (hist[d*k + tile]),
+ *   the host scans [hist] (see Scan) so hist[d*k + tile] is where digit d of tile
+ *     starts in the output, and
+ *   [scatter_tiles] moves each locally sorted run of digit d to its place.
+ * Every step is stable so successive passes sort on the whole key.
+ * The split scans are the upsweep_pow2/sweepdown_pow2 of common/localscan.cl on int.
+ */
+#ifndef K
+#define K int
+#endif
+
+#if KEY_BITS == 64
+#define UK ulong
+#else
+#define UK uint
+#endif
+
+#ifndef RADIX_BITS
+#define RADIX_BITS 4
+#endif
+#define RADIX (1 << RADIX_BITS)
+
+#define SCAN_T int
+#include "localscan.cl"
+
+/*
+ * Digit of [key] at bit [shift] as if keys were unsigned (sign bit flipped).
+ */
+inline int digit(K key, int shift) {
+  UK u = ((UK) key) ^ (((UK) 1) << (8*sizeof(UK) - 1));
+  return (int) ((u >> shift) & (RADIX-1));
+}
+
+/*
+ * Sort the tile starting at [base] by the digit at [shift] and write it
+ *   (still in tile order) to [keys_out]/[vals_out].
+ * Elements >= n are padded with the largest key so they stay at the end of the tile
+ *   and are never counted or written.
+ */
+__kernel void sort_tiles(
+  __global K   *keys_in,   //length [n]
+  __global int *vals_in,   //length [n] (if with_values)
+  __global K   *keys_out,  //length [n]
+  __global int *vals_out,  //length [n] (if with_values)
+  __global int *hist,      //length [RADIX*k]
+  __global int *tile_start,//length [k*RADIX]
+  __local  int *x,         //length [m]
+  __local  K   *lkeys,     //length [m]
+  __local  int *lvals,     //length [m]
+           int shift,
+           int with_values,
+           int n
+) {
+  __local int start[RADIX];
+  __local int end[RADIX];
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int k = get_num_groups(0);
+  int m = 2*wx;
+  int base = grpid*m;
+  int valid = min(m, n-base);
+
+  // each workitem keeps its two elements in registers between splits
+  K key[2];
+  int val[2];
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    key[i] = (l < valid) ? keys_in[base+l] : (K) (((UK) 1 << (8*sizeof(UK) - 1)) - 1);
+    val[i] = (with_values && l < valid) ? vals_in[base+l] : 0;
+  }
+  if (lid < RADIX) {
+    start[lid] = 0;
+    end[lid] = 0;
+  }
+
+  // one stable split per bit of the digit (HARRIS Section 39.3.3)
+  for (int b=0; b<RADIX_BITS; b++) {
+    int e[2];
+    for (int i=0; i<2; i++) {
+      int l = (i*wx) + lid;
+      e[i] = ((digit(key[i], shift) >> b) & 1) == 0;
+      x[l] = e[i];
+    }
+    upsweep_pow2(x, m);
+    // every workitem needs the number of zeros before the root is cleared
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int total_false = x[m-1];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0) {
+      x[m-1] = 0;
+    }
+    sweepdown_pow2(x, m);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i=0; i<2; i++) {
+      int l = (i*wx) + lid;
+      int dest = e[i] ? x[l] : (total_false + l - x[l]);
+      lkeys[dest] = key[i];
+      lvals[dest] = val[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i=0; i<2; i++) {
+      int l = (i*wx) + lid;
+      key[i] = lkeys[l];
+      val[i] = lvals[l];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  // the tile is now sorted by digit; find where each digit starts and ends
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    if (l < valid) {
+      int d = digit(key[i], shift);
+      if (l == 0 || digit(lkeys[l-1], shift) != d) {
+        start[d] = l;
+      }
+      if (l == valid-1 || digit(lkeys[l+1], shift) != d) {
+        end[d] = l+1;
+      }
+      keys_out[base+l] = key[i];
+      if (with_values) {
+        vals_out[base+l] = val[i];
+      }
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if (lid < RADIX) {
+    hist[(lid*k) + grpid] = end[lid] - start[lid];
+    tile_start[(grpid*RADIX) + lid] = start[lid];
+  }
+}
+
+/*
+ * Move each element of the locally sorted tiles to its place in the output.
+ * [hist] is the exclusive scan of the digit-major tile counts.
+ */
+__kernel void scatter_tiles(
+  __global K   *keys_in,   //length [n]
+  __global int *vals_in,   //length [n] (if with_values)
+  __global K   *keys_out,  //length [n]
+  __global int *vals_out,  //length [n] (if with_values)
+  __global int *hist,      //length [RADIX*k]
+  __global int *tile_start,//length [k*RADIX]
+           int shift,
+           int with_values,
+           int n
+) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int k = get_num_groups(0);
+  int m = 2*wx;
+  int base = grpid*m;
+  for (int i=0; i<2; i++) {
+    int l = (i*wx) + lid;
+    if (base+l < n) {
+      K key = keys_in[base+l];
+      int d = digit(key, shift);
+      int dest = hist[(d*k) + grpid] + (l - tile_start[(grpid*RADIX) + d]);
+      keys_out[dest] = key;
+      if (with_values) {
+        vals_out[dest] = vals_in[base+l];
+      }
+    }
+  }
+}
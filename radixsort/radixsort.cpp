@@ -0,0 +1,146 @@
+#include "radixsort.h"
+#include "programcache.h"
+#include "scanop.h"
+
+#include <sstream>
+
+/*
+ * Source of radixsort.cl, or NULL to compile it from the working directory.
+ */
+#if EMBED_CL
+#include "radixsort.cl.h"
+static const char *radixsort_source = (const char *)&radixsort_cl;
+#else
+static const char *radixsort_source = NULL;
+#endif
+
+/*
+ * Bits sorted per pass; must agree with RADIX_BITS in radixsort.cl.
+ */
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+
+template <typename K>
+void BasicRadixSort<K>::sort(K *keys, int n) {
+  cl_mem d_keys = pool.acquire(sizeof(K)*n);
+  m0 += clw.memcpy_to_dev(d_keys, sizeof(K)*n, keys);
+  radix_sort(d_keys, NULL, n);
+  m1 += clw.memcpy_from_dev(d_keys, sizeof(K)*n, keys);
+  pool.release(d_keys);
+}
+
+template <typename K>
+void BasicRadixSort<K>::sort(K *keys, int *values, int n) {
+  cl_mem d_keys = pool.acquire(sizeof(K)*n);
+  cl_mem d_values = pool.acquire(sizeof(int)*n);
+  m0 += clw.memcpy_to_dev(d_keys, sizeof(K)*n, keys);
+  m0 += clw.memcpy_to_dev(d_values, sizeof(int)*n, values);
+  radix_sort(d_keys, d_values, n);
+  m1 += clw.memcpy_from_dev(d_keys, sizeof(K)*n, keys);
+  m1 += clw.memcpy_from_dev(d_values, sizeof(int)*n, values);
+  pool.release(d_keys);
+  pool.release(d_values);
+}
+
+template <typename K>
+void BasicRadixSort<K>::sort(cl_mem keys, int n) {
+  radix_sort(keys, NULL, n);
+}
+
+template <typename K>
+void BasicRadixSort<K>::sort(cl_mem keys, cl_mem values, int n) {
+  radix_sort(keys, values, n);
+}
+
+/*
+ * Sort [keys] (and [values] if not NULL) inplace.
+ * Each pass reads from one buffer and scatters into the other; there is an even
+ *   number of passes so the result ends up back in the caller's buffers.
+ * Without values we pass the key buffers in their place; the kernels never touch them.
+ */
+template <typename K>
+void BasicRadixSort<K>::radix_sort(cl_mem keys, cl_mem values, int n) {
+  if (n < 2) {
+    return;
+  }
+  int k = (n + m-1) / m;
+  size_t gx = k * wx;
+  int with_values = (values != NULL);
+  cl_mem d_keys[2] = { keys, pool.acquire(sizeof(K)*n) };
+  cl_mem d_tile_keys = pool.acquire(sizeof(K)*n);
+  cl_mem d_values[2] = { d_keys[0], d_keys[1] };
+  cl_mem d_tile_values = d_tile_keys;
+  if (with_values) {
+    d_values[0] = values;
+    d_values[1] = pool.acquire(sizeof(int)*n);
+    d_tile_values = pool.acquire(sizeof(int)*n);
+  }
+  cl_mem d_hist = pool.acquire(sizeof(int)*RADIX*k);
+  cl_mem d_tile_start = pool.acquire(sizeof(int)*RADIX*k);
+
+  int passes = (8*sizeof(K)) / RADIX_BITS;
+  for (int p=0; p<passes; p++) {
+    int shift = p * RADIX_BITS;
+    int src = p & 1;
+    int dst = src ^ 1;
+    clw.kernel_arg(sort_tiles,
+      d_keys[src], d_values[src], d_tile_keys, d_tile_values, d_hist, d_tile_start,
+      sizeof(int)*m, sizeof(K)*m, sizeof(int)*m, shift, with_values, n);
+    k0 += clw.run_kernel_with_timing(sort_tiles, /*dim=*/1, &gx, &wx);
+    scan.scan(d_hist, RADIX*k);
+    clw.kernel_arg(scatter_tiles,
+      d_tile_keys, d_tile_values, d_keys[dst], d_values[dst], d_hist, d_tile_start,
+      shift, with_values, n);
+    k1 += clw.run_kernel_with_timing(scatter_tiles, /*dim=*/1, &gx, &wx);
+  }
+
+  pool.release(d_keys[1]);
+  pool.release(d_tile_keys);
+  if (with_values) {
+    pool.release(d_values[1]);
+    pool.release(d_tile_values);
+  }
+  pool.release(d_hist);
+  pool.release(d_tile_start);
+}
+
+template <typename K>
+BasicRadixSort<K>::BasicRadixSort(CLWrapper &clw, size_t wx) : clw(clw), scan(clw, wx),
+  wx(wx), pool(clw),
+  m0(0), m1(0), k0(0), k1(0) {
+  m = wx * 2;
+  stringstream flags;
+  flags << "-D K=" << cl_type<K>::name() << " -D KEY_BITS=" << (8*sizeof(K))
+        << " -D RADIX_BITS=" << RADIX_BITS;
+  cl_program program = cached_program(clw, "radixsort.cl", radixsort_source, flags.str());
+  sort_tiles = create_kernel(program, "sort_tiles");
+  scatter_tiles = create_kernel(program, "scatter_tiles");
+}
+
+template <typename K>
+BasicRadixSort<K>::~BasicRadixSort() {
+  clReleaseKernel(sort_tiles);
+  clReleaseKernel(scatter_tiles);
+  release_cached_programs(clw);
+}
+
+template <typename K>
+void BasicRadixSort<K>::reset_timers() {
+  m0 = m1 = 0;
+  k0 = k1 = 0;
+  scan.reset_timers();
+}
+
+template <typename K>
+void BasicRadixSort<K>::get_timers(map<string,float> &timings) {
+  if (clw.has_profiling()) {
+    timings.insert(make_pair("SORT1. keys_memcpy_to_dev  ",   m0));
+    timings.insert(make_pair("SORT2. sort_tiles          ",   k0));
+    timings.insert(make_pair("SORT3. scatter_tiles       ",   k1));
+    timings.insert(make_pair("SORT4. keys_memcpy_from_dev",   m1));
+  }
+  scan.get_timers(timings);
+}
+
+template class BasicRadixSort<int>;
+template class BasicRadixSort<int64_t>;
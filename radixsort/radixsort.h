@@ -0,0 +1,52 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "scan.h"
+
+/*
+ * Least-significant-digit radix sort of keys (and optionally int values) on the device.
+ *
+ * Each pass sorts on 4 bits: every subarray of 2*wx keys is sorted in local memory
+ *   by repeated one-bit splits, Scan scans the digit-major per-subarray histograms,
+ *   and each locally sorted run is then scattered to its place.
+ * The sort is stable and keys never leave the device.
+ *
+ * Keys of type [K] are signed and sorted ascending; instantiated for int and int64_t.
+ * NB: the workgroup size [wx] must be a power of two and at least 16.
+ */
+template <typename K>
+class BasicRadixSort {
+  private:
+    CLWrapper &clw;
+    Scan scan;   // scans the per-subarray digit histograms
+    cl_kernel sort_tiles;
+    cl_kernel scatter_tiles;
+    size_t wx;   // workgroup size
+    int m;       // length of each subarray ( = wx*2 )
+    BufferPool pool;
+
+    //timings
+    float m0; float m1;           //memcpy buffers
+    float k0; float k1;           //kernels
+
+    void radix_sort(cl_mem keys, cl_mem values, int n);
+
+  public:
+    BasicRadixSort(CLWrapper &clw, size_t wx=256);
+    ~BasicRadixSort();
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    void sort(K *keys, int n);
+    void sort(K *keys, int *values, int n);
+
+    // inplace sort of device buffers of length [n]
+    void sort(cl_mem keys, int n);
+    void sort(cl_mem keys, cl_mem values, int n);
+};
+
+typedef BasicRadixSort<int> RadixSort;
+
+#endif
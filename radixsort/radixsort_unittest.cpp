@@ -0,0 +1,105 @@
+#include "clwrapper.h"
+#include "programcache.h"
+#include "radixsort.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#include <algorithm>
+#include <utility>
+
+#define N 8
+
+TEST(Simple) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  RadixSort s(clw, /*wx=*/16);
+  int x[N]            = { 3, 1, 7, 0, 4, 1, 6, 3 };
+  const int result[N] = { 0, 1, 1, 3, 3, 4, 6, 7 };
+  s.sort(x, N);
+  CHECK_ARRAY_EQUAL(result, x, N);
+}
+
+template <typename K>
+void keys_test(int n, int wx, bool with_negatives) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicRadixSort<K> s(clw, wx);
+  K *x = new K[n];
+  K *result = new K[n];
+  for (int i=0; i<n; i++) {
+    x[i] = (K) rand_int(n);
+    if (sizeof(K) > 4) {
+      x[i] = (x[i] << 32) | (K) rand_int(n);
+    }
+    if (with_negatives && rand_int(2)) {
+      x[i] = -x[i];
+    }
+  }
+  std::copy(x, x+n, result);
+  std::sort(result, result+n);
+  s.sort(x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Keys_1000) {
+  keys_test<int>(1000, 128, /*with_negatives=*/false);
+}
+
+TEST(Keys_1000001) {
+  keys_test<int>(1000001, 128, /*with_negatives=*/false);
+}
+
+TEST(Keys_Negative_100000) {
+  keys_test<int>(100000, 256, /*with_negatives=*/true);
+}
+
+TEST(Int64_Keys_Negative_100000) {
+  keys_test<int64_t>(100000, 128, /*with_negatives=*/true);
+}
+
+/*
+ * Values are the original indices so stability means equal keys keep ascending values.
+ */
+void pairs_test(int n, int wx) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  RadixSort s(clw, wx);
+  int *x = new int[n];
+  int *v = new int[n];
+  std::pair<int,int> *result = new std::pair<int,int>[n];
+  fill_random_data(x, n, 100);
+  for (int i=0; i<n; i++) {
+    v[i] = i;
+    result[i] = std::make_pair(x[i], i);
+  }
+  std::sort(result, result+n);
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_v = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_x, sizeof(int)*n, x);
+  clw.memcpy_to_dev(d_v, sizeof(int)*n, v);
+  s.sort(d_x, d_v, n);
+  clw.memcpy_from_dev(d_x, sizeof(int)*n, x);
+  clw.memcpy_from_dev(d_v, sizeof(int)*n, v);
+  for (int i=0; i<n; i++) {
+    CHECK_EQUAL(result[i].first, x[i]);
+    CHECK_EQUAL(result[i].second, v[i]);
+  }
+  clw.dev_free(d_x);
+  clw.dev_free(d_v);
+  delete[] x;
+  delete[] v;
+  delete[] result;
+}
+
+TEST(Pairs_1000) {
+  pairs_test(1000, 128);
+}
+
+TEST(Pairs_300000) {
+  pairs_test(300000, 128);
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
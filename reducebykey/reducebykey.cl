@@ -0,0 +1,52 @@
+/*
+ * Reduce-by-key and run-length encoding (set by the ReduceByKey constructor).
+ *
+ * T is the element type of the values, SCAN_OP the associative operator (one of OP_*)
+ *   as in segscan.cl. Keys are always int.
+ *
+ * A run is a maximal sequence of equal consecutive keys.
+ * The segmented scan itself is SegmentedScan::scan_by_key; the kernels here only
+ *   mark the last element (tail) or first element (head) of each run
+ *   so that Compact can gather one output per run.
+ */
+#include "scanop.cl"
+
+/*
+ * [agg] holds the exclusive segmented scan of [values];
+ *   make it inclusive and flag the tail of each run, where it is the run's aggregate.
+ */
+__kernel void run_tails(
+    __global int *keys, __global T *values, __global T *agg, __global int *tail,
+    int n) {
+  int gid = get_global_id(0);
+  if (gid < n) {
+    tail[gid] = (gid == n-1) || (keys[gid] != keys[gid+1]);
+    agg[gid] = OP(agg[gid], values[gid]);
+  }
+}
+
+/*
+ * Flag the head of each run and write each element's index (to compact into run starts).
+ */
+__kernel void run_heads(
+    __global int *in, __global int *head, __global int *index,
+    int n) {
+  int gid = get_global_id(0);
+  if (gid < n) {
+    head[gid] = (gid == 0) || (in[gid] != in[gid-1]);
+    index[gid] = gid;
+  }
+}
+
+/*
+ * Length of each run from the compacted run [starts].
+ */
+__kernel void run_lengths(
+    __global int *starts, __global int *counts,
+    int nruns, int n) {
+  int gid = get_global_id(0);
+  if (gid < nruns) {
+    int end = (gid+1 < nruns) ? starts[gid+1] : n;
+    counts[gid] = end - starts[gid];
+  }
+}
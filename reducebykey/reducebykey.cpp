@@ -0,0 +1,168 @@
+#include "reducebykey.h"
+#include "programcache.h"
+#include "scanop.h"
+
+#include <sstream>
+
+/*
+ * Source of reducebykey.cl, or NULL to compile it from the working directory.
+ */
+#if EMBED_CL
+#include "reducebykey.cl.h"
+static const char *reducebykey_source = (const char *)&reducebykey_cl;
+#else
+static const char *reducebykey_source = NULL;
+#endif
+
+template <typename T, class Op>
+int BasicReduceByKey<T,Op>::reduce_by_key(int *keys, T *values, int *keys_out, T *values_out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  cl_mem d_keys = pool.acquire(sizeof(int)*n);
+  cl_mem d_values = pool.acquire(sizeof(T)*n);
+  cl_mem d_keys_out = pool.acquire(sizeof(int)*n);
+  cl_mem d_values_out = pool.acquire(sizeof(T)*n);
+  m0 += clw.memcpy_to_dev(d_keys, sizeof(int)*n, keys);
+  m0 += clw.memcpy_to_dev(d_values, sizeof(T)*n, values);
+  int nruns = reduce_by_key(d_keys, d_values, d_keys_out, d_values_out, n);
+  m1 += clw.memcpy_from_dev(d_keys_out, sizeof(int)*nruns, keys_out);
+  m1 += clw.memcpy_from_dev(d_values_out, sizeof(T)*nruns, values_out);
+  pool.release(d_keys);
+  pool.release(d_values);
+  pool.release(d_keys_out);
+  pool.release(d_values_out);
+  return nruns;
+}
+
+/*
+ * [values] is left unchanged; we scan a copy.
+ */
+template <typename T, class Op>
+int BasicReduceByKey<T,Op>::reduce_by_key(cl_mem keys, cl_mem values, cl_mem keys_out, cl_mem values_out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  size_t gx = ((n + wx-1) / wx) * wx;
+  cl_mem d_agg = pool.acquire(sizeof(T)*n);
+  cl_mem d_tail = pool.acquire(sizeof(int)*n);
+  clw.copy_buffer(values, d_agg, sizeof(T)*n);
+  segscan.scan_by_key(d_agg, keys, n);
+  clw.kernel_arg(run_tails,
+    keys, values, d_agg, d_tail, n);
+  k0 += clw.run_kernel_with_timing(run_tails, /*dim=*/1, &gx, &wx);
+  int nruns = compact_values.compact_pairs(d_agg, keys, d_tail, values_out, keys_out, n);
+  pool.release(d_agg);
+  pool.release(d_tail);
+  return nruns;
+}
+
+template <typename T, class Op>
+int BasicReduceByKey<T,Op>::run_length_encode(int *in, int *values_out, int *counts_out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  cl_mem d_in = pool.acquire(sizeof(int)*n);
+  cl_mem d_values_out = pool.acquire(sizeof(int)*n);
+  cl_mem d_counts_out = pool.acquire(sizeof(int)*n);
+  m0 += clw.memcpy_to_dev(d_in, sizeof(int)*n, in);
+  int nruns = run_length_encode(d_in, d_values_out, d_counts_out, n);
+  m1 += clw.memcpy_from_dev(d_values_out, sizeof(int)*nruns, values_out);
+  m1 += clw.memcpy_from_dev(d_counts_out, sizeof(int)*nruns, counts_out);
+  pool.release(d_in);
+  pool.release(d_values_out);
+  pool.release(d_counts_out);
+  return nruns;
+}
+
+template <typename T, class Op>
+int BasicReduceByKey<T,Op>::run_length_encode(cl_mem in, cl_mem values_out, cl_mem counts_out, int n) {
+  if (n < 1) {
+    return 0;
+  }
+  size_t gx = ((n + wx-1) / wx) * wx;
+  cl_mem d_head = pool.acquire(sizeof(int)*n);
+  cl_mem d_index = pool.acquire(sizeof(int)*n);
+  cl_mem d_starts = pool.acquire(sizeof(int)*n);
+  clw.kernel_arg(run_heads,
+    in, d_head, d_index, n);
+  k1 += clw.run_kernel_with_timing(run_heads, /*dim=*/1, &gx, &wx);
+  int nruns = compact_keys.compact_pairs(in, d_index, d_head, values_out, d_starts, n);
+  size_t gx_runs = ((nruns + wx-1) / wx) * wx;
+  clw.kernel_arg(run_lengths,
+    d_starts, counts_out, nruns, n);
+  k1 += clw.run_kernel_with_timing(run_lengths, /*dim=*/1, &gx_runs, &wx);
+  pool.release(d_head);
+  pool.release(d_index);
+  pool.release(d_starts);
+  return nruns;
+}
+
+template <typename T, class Op>
+BasicReduceByKey<T,Op>::BasicReduceByKey(CLWrapper &clw, size_t wx) : clw(clw),
+  segscan(clw, wx), compact_values(clw, wx), compact_keys(clw, wx),
+  wx(wx), pool(clw),
+  m0(0), m1(0), k0(0), k1(0) {
+  stringstream flags;
+  flags << "-D T=" << cl_type<T>::name() << " -D SCAN_OP=" << Op::cl_id()
+        << cl_type<T>::options();
+  cl_program program = cached_program(clw, "reducebykey.cl", reducebykey_source, flags.str());
+  run_tails = create_kernel(program, "run_tails");
+  run_heads = create_kernel(program, "run_heads");
+  run_lengths = create_kernel(program, "run_lengths");
+}
+
+template <typename T, class Op>
+BasicReduceByKey<T,Op>::~BasicReduceByKey() {
+  clReleaseKernel(run_tails);
+  clReleaseKernel(run_heads);
+  clReleaseKernel(run_lengths);
+  release_cached_programs(clw);
+}
+
+template <typename T, class Op>
+void BasicReduceByKey<T,Op>::reset_timers() {
+  m0 = m1 = 0;
+  k0 = k1 = 0;
+  segscan.reset_timers();
+  compact_values.reset_timers();
+  compact_keys.reset_timers();
+}
+
+/*
+ * The two compactions report under the same names, so we add them up.
+ */
+template <typename T, class Op>
+void BasicReduceByKey<T,Op>::get_timers(map<string,float> &timings) {
+  if (clw.has_profiling()) {
+    timings.insert(make_pair("RBK1. data_memcpy_to_dev  ",   m0));
+    timings.insert(make_pair("RBK2. run_tails           ",   k0));
+    timings.insert(make_pair("RBK3. run_heads_lengths   ",   k1));
+    timings.insert(make_pair("RBK4. data_memcpy_from_dev",   m1));
+  }
+  segscan.get_timers(timings);
+  map<string,float> compactions, rle;
+  compact_values.get_timers(compactions);
+  compact_keys.get_timers(rle);
+  for (map<string,float>::iterator i = rle.begin(); i != rle.end(); i++) {
+    compactions[i->first] += i->second;
+  }
+  timings.insert(compactions.begin(), compactions.end());
+}
+
+template class BasicReduceByKey<int,     Add<int> >;
+template class BasicReduceByKey<int,     Max<int> >;
+template class BasicReduceByKey<int,     Min<int> >;
+template class BasicReduceByKey<int,     And<int> >;
+template class BasicReduceByKey<int,     Or<int> >;
+template class BasicReduceByKey<int64_t, Add<int64_t> >;
+template class BasicReduceByKey<int64_t, Max<int64_t> >;
+template class BasicReduceByKey<int64_t, Min<int64_t> >;
+template class BasicReduceByKey<int64_t, And<int64_t> >;
+template class BasicReduceByKey<int64_t, Or<int64_t> >;
+template class BasicReduceByKey<float,   Add<float> >;
+template class BasicReduceByKey<float,   Max<float> >;
+template class BasicReduceByKey<float,   Min<float> >;
+template class BasicReduceByKey<double,  Add<double> >;
+template class BasicReduceByKey<double,  Max<double> >;
+template class BasicReduceByKey<double,  Min<double> >;
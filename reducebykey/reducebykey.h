@@ -0,0 +1,66 @@
+#ifndef REDUCEBYKEY_H
+#define REDUCEBYKEY_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "compact.h"
+#include "segscan.h"
+
+/*
+ * Reduce-by-key and run-length encoding built on SegmentedScan and Compact.
+ *
+ * A run is a maximal sequence of equal consecutive keys (so group-by needs sorted keys).
+ * reduce_by_key is SegmentedScan::scan_by_key (head flags are derived from key changes
+ *   on-device) followed by one compaction of the key and reduction of the last element
+ *   of each run (Compact::compact_pairs).
+ * run_length_encode only needs the heads of the runs so it skips the segmented scan
+ *   and compacts the heads with their indices in the same way;
+ *   lengths are differences of successive starts.
+ * Each is one count pass, one scan of the tile counts and one readback (the number of runs).
+ *
+ * Values of type [T] under the associative operator [Op] (see scanop.h); keys are int.
+ * Instantiated for the same specializations as BasicSegmentedScan.
+ */
+template <typename T, class Op=Add<T> >
+class BasicReduceByKey {
+  private:
+    CLWrapper &clw;
+    BasicSegmentedScan<T,Op> segscan;
+    BasicCompact<T> compact_values; // keys and values of reduce_by_key
+    Compact compact_keys;           // heads and their indices of run_length_encode
+    cl_kernel run_tails;
+    cl_kernel run_heads;
+    cl_kernel run_lengths;
+    size_t wx;   // workgroup size
+    BufferPool pool;
+
+    //timings
+    float m0; float m1;           //memcpy buffers
+    float k0; float k1;           //kernels
+
+  public:
+    BasicReduceByKey(CLWrapper &clw, size_t wx=256);
+    ~BasicReduceByKey();
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+
+    /*
+     * Write each distinct run of [keys] and the reduction of its [values] to the
+     *   front of [keys_out] and [values_out]. Returns the number of runs.
+     * The outputs must have room for [n] elements.
+     */
+    int reduce_by_key(int *keys, T *values, int *keys_out, T *values_out, int n);
+    int reduce_by_key(cl_mem keys, cl_mem values, cl_mem keys_out, cl_mem values_out, int n);
+
+    /*
+     * Write the value and length of each run of [in] to the front of
+     *   [values_out] and [counts_out]. Returns the number of runs.
+     * The outputs must have room for [n] elements.
+     */
+    int run_length_encode(int *in, int *values_out, int *counts_out, int n);
+    int run_length_encode(cl_mem in, cl_mem values_out, cl_mem counts_out, int n);
+};
+
+typedef BasicReduceByKey<int, Add<int> > ReduceByKey;
+
+#endif
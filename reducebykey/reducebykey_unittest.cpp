@@ -0,0 +1,141 @@
+#include "clwrapper.h"
+#include "programcache.h"
+#include "reducebykey.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#define N 8
+
+TEST(Simple) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  ReduceByKey r(clw, /*wx=*/4);
+  int k[N]              = { 1, 1, 2, 2, 2, 5, 1, 1 };
+  int v[N]              = { 3, 1, 7, 0, 4, 1, 6, 3 };
+  const int keys[4]     = { 1, 2, 5, 1 };
+  const int sums[4]     = { 4, 11, 1, 9 };
+  const int counts[4]   = { 2, 3, 1, 2 };
+  int y[N];
+  int z[N];
+  int nruns = r.reduce_by_key(k, v, y, z, N);
+  CHECK_EQUAL(4, nruns);
+  CHECK_ARRAY_EQUAL(keys, y, nruns);
+  CHECK_ARRAY_EQUAL(sums, z, nruns);
+  nruns = r.run_length_encode(k, y, z, N);
+  CHECK_EQUAL(4, nruns);
+  CHECK_ARRAY_EQUAL(keys, y, nruns);
+  CHECK_ARRAY_EQUAL(counts, z, nruns);
+}
+
+/*
+ * Runs of random length (mostly short, some long) with random keys.
+ */
+void fill_runs(int *keys, int n) {
+  int key = 0;
+  for (int i=0; i<n; ) {
+    int len = rand_int(4) ? 1 + rand_int(5) : 1 + rand_int(3000);
+    key += 1 + rand_int(3);
+    for (int j=0; j<len && i<n; j++, i++) {
+      keys[i] = key;
+    }
+  }
+}
+
+template <typename T, class Op>
+void reduce_test(int n, int wx) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicReduceByKey<T,Op> r(clw, wx);
+  int *k = new int[n];
+  T *v = new T[n];
+  int *y = new int[n];
+  T *z = new T[n];
+  int *keys = new int[n];
+  T *aggs = new T[n];
+  fill_runs(k, n);
+  for (int i=0; i<n; i++) {
+    v[i] = (T) rand_int(1000);
+  }
+  int expected = 0;
+  for (int i=0; i<n; i++) {
+    if (i == 0 || k[i] != k[i-1]) {
+      keys[expected] = k[i];
+      aggs[expected] = v[i];
+      expected++;
+    } else {
+      aggs[expected-1] = Op::apply(aggs[expected-1], v[i]);
+    }
+  }
+  int nruns = r.reduce_by_key(k, v, y, z, n);
+  CHECK_EQUAL(expected, nruns);
+  CHECK_ARRAY_EQUAL(keys, y, nruns);
+  CHECK_ARRAY_EQUAL(aggs, z, nruns);
+  delete[] k;
+  delete[] v;
+  delete[] y;
+  delete[] z;
+  delete[] keys;
+  delete[] aggs;
+}
+
+TEST(Reduce_1000) {
+  reduce_test<int, Add<int> >(1000, 128);
+}
+
+TEST(Reduce_1000001) {
+  reduce_test<int, Add<int> >(1000001, 128);
+}
+
+TEST(Reduce_Double_Max_100000) {
+  reduce_test<double, Max<double> >(100000, 128);
+}
+
+void rle_test(int n, int wx) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  ReduceByKey r(clw, wx);
+  int *x = new int[n];
+  int *y = new int[n];
+  int *z = new int[n];
+  int *values = new int[n];
+  int *counts = new int[n];
+  fill_runs(x, n);
+  int expected = 0;
+  for (int i=0; i<n; i++) {
+    if (i == 0 || x[i] != x[i-1]) {
+      values[expected] = x[i];
+      counts[expected] = 0;
+      expected++;
+    }
+    counts[expected-1]++;
+  }
+  cl_mem d_x = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_y = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_z = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_x, sizeof(int)*n, x);
+  int nruns = r.run_length_encode(d_x, d_y, d_z, n);
+  CHECK_EQUAL(expected, nruns);
+  clw.memcpy_from_dev(d_y, sizeof(int)*nruns, y);
+  clw.memcpy_from_dev(d_z, sizeof(int)*nruns, z);
+  CHECK_ARRAY_EQUAL(values, y, nruns);
+  CHECK_ARRAY_EQUAL(counts, z, nruns);
+  clw.dev_free(d_x);
+  clw.dev_free(d_y);
+  clw.dev_free(d_z);
+  delete[] x;
+  delete[] y;
+  delete[] z;
+  delete[] values;
+  delete[] counts;
+}
+
+TEST(RunLength_1000) {
+  rle_test(1000, 128);
+}
+
+TEST(RunLength_1000001) {
+  rle_test(1000001, 128);
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
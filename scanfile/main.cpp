@@ -0,0 +1,104 @@
+#include "clwrapper.h"
+#include "scanfile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+void print_usage(string progname) {
+  printf("Usage: %s [options] input [output]\n", progname.c_str());
+  printf("Exclusive scan of a raw binary file of int32 (or int64) elements.\n");
+  printf("Without [output] the input file is scanned inplace.\n");
+  printf("Options:\n");
+  printf("   -v         be verbose\n");
+  printf("   -e arg     engine: cpu or opencl (default: cpu)\n");
+  printf("   -8         elements are int64\n");
+  printf("   -c arg     elements per chunk (default: 4194304)\n");
+  printf("   -t arg     number of threads for the cpu engine (default: all cores)\n");
+  printf("   -w arg     size of workgroup for the opencl engine\n");
+}
+
+int main(int argc, char **argv) {
+  string progname(argv[0]);
+  scanfile_options opt;
+  bool verbose = false;
+
+  int c;
+  while ((c = getopt (argc, argv, "hv8e:c:t:w:")) != -1) {
+    switch (c) {
+      case 'h':
+        print_usage(progname);
+        return 1;
+      case 'v':
+        verbose = true;
+        break;
+      case '8':
+        opt.element_size = 8;
+        break;
+      case 'e':
+        if (strcmp(optarg, "opencl") == 0) {
+          opt.eng = scanfile_options::OPENCL;
+        } else if (strcmp(optarg, "cpu") == 0) {
+          opt.eng = scanfile_options::CPU;
+        } else {
+          fprintf(stderr, "Unknown engine `%s'.\n", optarg);
+          return 1;
+        }
+        break;
+      case 'c':
+        opt.chunk = atoi(optarg);
+        break;
+      case 't':
+        opt.nthreads = atoi(optarg);
+        break;
+      case 'w':
+        opt.wx = atoi(optarg);
+        break;
+      case '?':
+        if (optopt == 'e' || optopt == 'c' || optopt == 't' || optopt == 'w')
+          fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint (optopt))
+          fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf (stderr,
+              "Unknown option character `\\x%x'.\n",
+              optopt);
+        return 1;
+      default:
+        abort ();
+    }
+  }
+  if (optind >= argc || opt.chunk < 1) {
+    print_usage(progname);
+    return 1;
+  }
+  string in(argv[optind]);
+  string out = (optind+1 < argc) ? string(argv[optind+1]) : string();
+
+  CLWrapper *clw = NULL;
+  if (opt.eng == scanfile_options::OPENCL) {
+    if (verbose) {
+      cout << clinfo();
+    }
+    clw = new CLWrapper(/*platform=*/0,/*device=*/0,/*profiling=*/false);
+  }
+
+  float ms = scan_file(in, out, opt, clw);
+  if (ms < 0) {
+    return 1;
+  }
+
+  struct stat st;
+  long bytes = (stat(in.c_str(), &st) == 0) ? (long) st.st_size : 0;
+  printf("# FILE %s (%ld elements)\n", in.c_str(), bytes / opt.element_size);
+  printf("# TIME (ms) %.3f\n", ms);
+  printf("# GB/s      %.3f\n", ms > 0 ? (bytes / 1.0e6) / ms : 0.0);
+
+  delete clw;
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "scanfile.h"
+#include "parscan.h"
+#include "scan.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*
+ * A file mapped into memory (shared, so writes go back to the file).
+ */
+struct mapping {
+  int fd;
+  void *ptr;
+  size_t size;
+  mapping() : fd(-1), ptr(MAP_FAILED), size(0) {}
+};
+
+static bool fail(const std::string &what, const std::string &path) {
+  fprintf(stderr, "scan_file: %s %s: %s\n", what.c_str(), path.c_str(), strerror(errno));
+  return false;
+}
+
+/*
+ * Map an existing file, read-only unless [writable].
+ */
+static bool map_input(const std::string &path, bool writable, mapping &m) {
+  m.fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (m.fd < 0) return fail("cannot open", path);
+  struct stat st;
+  if (fstat(m.fd, &st) < 0) return fail("cannot stat", path);
+  m.size = st.st_size;
+  if (m.size == 0) return true;
+  int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  m.ptr = mmap(NULL, m.size, prot, MAP_SHARED, m.fd, 0);
+  if (m.ptr == MAP_FAILED) return fail("cannot map", path);
+  madvise(m.ptr, m.size, MADV_SEQUENTIAL);
+  return true;
+}
+
+/*
+ * Create (or truncate) [path] with [size] bytes and map it writable.
+ */
+static bool map_output(const std::string &path, size_t size, mapping &m) {
+  m.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m.fd < 0) return fail("cannot create", path);
+  if (ftruncate(m.fd, size) < 0) return fail("cannot resize", path);
+  m.size = size;
+  if (m.size == 0) return true;
+  m.ptr = mmap(NULL, m.size, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+  if (m.ptr == MAP_FAILED) return fail("cannot map", path);
+  madvise(m.ptr, m.size, MADV_SEQUENTIAL);
+  return true;
+}
+
+static void unmap(mapping &m) {
+  if (m.ptr != MAP_FAILED) munmap(m.ptr, m.size);
+  if (m.fd >= 0) close(m.fd);
+}
+
+/*
+ * Ask for the chunk after [lo] to be read ahead while we scan this one.
+ */
+static void readahead_chunk(const char *base, size_t size, size_t lo, size_t chunk_bytes) {
+  long page = sysconf(_SC_PAGESIZE);
+  size_t next = lo + chunk_bytes;
+  if (next < size) {
+    size_t start = next & ~(page-1);
+    size_t len = ((next + chunk_bytes < size) ? next + chunk_bytes : size) - start;
+    madvise((void *) &base[start], len, MADV_WILLNEED);
+  }
+}
+
+/*
+ * CPU engine: copy each chunk to the output (unless inplace) and scan it there.
+ */
+static void scan_cpu_int32(const int *in, int *out, int64_t n, const scanfile_options &opt) {
+  ParallelScan s(opt.nthreads);
+  int carry = 0;
+  for (int64_t lo=0; lo<n; lo+=opt.chunk) {
+    int len = (int) ((lo + opt.chunk < n) ? opt.chunk : n - lo);
+    readahead_chunk((const char *) in, sizeof(int)*n, sizeof(int)*lo, sizeof(int)*opt.chunk);
+    if (in != out) {
+      memcpy(&out[lo], &in[lo], sizeof(int)*len);
+    }
+    carry = s.scan(&out[lo], len, carry);
+  }
+}
+
+static void scan_cpu_int64(const int64_t *in, int64_t *out, int64_t n, const scanfile_options &opt) {
+  int64_t carry = 0;
+  for (int64_t lo=0; lo<n; lo+=opt.chunk) {
+    int64_t hi = (lo + opt.chunk < n) ? lo + opt.chunk : n;
+    readahead_chunk((const char *) in, sizeof(int64_t)*n, sizeof(int64_t)*lo, sizeof(int64_t)*opt.chunk);
+    for (int64_t i=lo; i<hi; i++) {
+      int64_t tmp = in[i];
+                    out[i] = carry;
+                             carry += tmp;
+    }
+  }
+}
+
+float scan_file(const std::string &in, const std::string &out,
+                const scanfile_options &opt, CLWrapper *clw) {
+  bool inplace = out.empty();
+  mapping mi, mo;
+  if (!map_input(in, /*writable=*/inplace, mi)) {
+    unmap(mi);
+    return -1.0f;
+  }
+  // rather than silently leave (or drop, in a new output) a partial element
+  if (mi.size % opt.element_size != 0) {
+    fprintf(stderr, "scan_file: %s: size %lu is not a multiple of %d bytes\n",
+      in.c_str(), (unsigned long) mi.size, opt.element_size);
+    unmap(mi);
+    return -1.0f;
+  }
+  if (!inplace && !map_output(out, mi.size, mo)) {
+    unmap(mi);
+    unmap(mo);
+    return -1.0f;
+  }
+  int64_t n = mi.size / opt.element_size;
+  const void *src = mi.ptr;
+  void *dst = inplace ? mi.ptr : mo.ptr;
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  if (n > 0) {
+    if (opt.eng == scanfile_options::OPENCL && opt.element_size == 8) {
+      BasicScan<int64_t> s(*clw, opt.wx);
+      s.scan_stream((const int64_t *) src, (int64_t *) dst, n, opt.chunk);
+    } else if (opt.eng == scanfile_options::OPENCL) {
+      Scan s(*clw, opt.wx);
+      s.scan_stream((const int *) src, (int *) dst, n, opt.chunk);
+    } else if (opt.element_size == 8) {
+      scan_cpu_int64((const int64_t *) src, (int64_t *) dst, n, opt);
+    } else {
+      scan_cpu_int32((const int *) src, (int *) dst, n, opt);
+    }
+  }
+  gettimeofday(&end, NULL);
+
+  unmap(mi);
+  unmap(mo);
+  return (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+}
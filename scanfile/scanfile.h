@@ -0,0 +1,44 @@
+#ifndef SCANFILE_H
+#define SCANFILE_H
+
+#include "clwrapper.h"
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Exclusive scan of raw binary files of int32 or int64 elements (native byte order).
+ *
+ * Files are memory-mapped rather than read into heap buffers:
+ *   the input is mapped read-only and the output is created at the same size
+ *   (or the input is mapped writable and scanned inplace if no output is given).
+ * We hint sequential access to the kernel and ask for each chunk ahead of time.
+ *
+ * Engines:
+ *   - CPU scans each chunk with ParallelScan (or a sequential loop for int64),
+ *     carrying the running total from chunk to chunk;
+ *   - OPENCL streams the mapped arrays through the device with Scan::scan_stream,
+ *     so the copies of successive chunks overlap with the scans.
+ */
+struct scanfile_options {
+  enum engine { CPU, OPENCL };
+  engine eng;
+  int element_size; // 4 (int32) or 8 (int64)
+  int chunk;        // elements per chunk
+  int nthreads;     // CPU engine threads (0: all cores)
+  int wx;           // OPENCL engine workgroup size
+
+  scanfile_options() : eng(CPU), element_size(4), chunk(1<<22), nthreads(0), wx(256) {}
+};
+
+/*
+ * Scan file [in] into file [out] (or inplace if [out] is empty).
+ * Returns the elapsed time in ms (excluding mapping the files), or a negative value
+ *   (after printing the reason to stderr) if the files cannot be opened or mapped,
+ *   or if the size of [in] is not a multiple of the element size ([out] is then not created).
+ * [clw] is only used by the OPENCL engine and may be NULL otherwise.
+ */
+float scan_file(const std::string &in, const std::string &out,
+                const scanfile_options &opt, CLWrapper *clw=NULL);
+
+#endif
@@ -0,0 +1,122 @@
+#include "clwrapper.h"
+#include "programcache.h"
+#include "scanfile.h"
+#include "scanop.h"
+#include "scanref.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+/*
+ * Write [n] elements of [data] to a new temporary file and return its name.
+ */
+template <typename T>
+std::string write_temp(T *data, int n) {
+  char name[] = "/tmp/scanfile_unittest_XXXXXX";
+  int fd = mkstemp(name);
+  FILE *f = fdopen(fd, "wb");
+  fwrite(data, sizeof(T), n, f);
+  fclose(f);
+  return std::string(name);
+}
+
+template <typename T>
+void read_file(const std::string &name, T *data, int n) {
+  FILE *f = fopen(name.c_str(), "rb");
+  CHECK_EQUAL((size_t) n, fread(data, sizeof(T), n, f));
+  fclose(f);
+}
+
+void int32_test(int n, scanfile_options::engine eng, bool inplace) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/false);
+  scanfile_options opt;
+  opt.eng = eng;
+  opt.chunk = 100000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  exclusive_scan_host(result, x, n);
+  std::string in = write_temp(x, n);
+  std::string out = inplace ? std::string() : in + ".out";
+  CHECK(scan_file(in, out, opt, &clw) >= 0);
+  read_file(inplace ? in : out, x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  unlink(in.c_str());
+  if (!inplace) unlink(out.c_str());
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Cpu_1000001) {
+  int32_test(1000001, scanfile_options::CPU, /*inplace=*/false);
+}
+
+TEST(Cpu_Inplace_1000001) {
+  int32_test(1000001, scanfile_options::CPU, /*inplace=*/true);
+}
+
+TEST(OpenCL_1000001) {
+  int32_test(1000001, scanfile_options::OPENCL, /*inplace=*/false);
+}
+
+void int64_test(int n, scanfile_options::engine eng) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/false);
+  scanfile_options opt;
+  opt.eng = eng;
+  opt.element_size = 8;
+  opt.chunk = 65536;
+  int64_t *x = new int64_t[n];
+  int64_t *result = new int64_t[n];
+  for (int i=0; i<n; i++) {
+    x[i] = ((int64_t) rand_int(1000)) << 32;
+  }
+  exclusive_scan_host<int64_t, Add<int64_t> >(result, x, n);
+  std::string in = write_temp(x, n);
+  CHECK(scan_file(in, std::string(), opt, &clw) >= 0);
+  read_file(in, x, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  unlink(in.c_str());
+  delete[] x;
+  delete[] result;
+}
+
+TEST(Cpu_Int64_300000) {
+  int64_test(300000, scanfile_options::CPU);
+}
+
+TEST(OpenCL_Int64_300000) {
+  int64_test(300000, scanfile_options::OPENCL);
+}
+
+TEST(TrailingBytes) {
+  // 10 int32 elements and half of another
+  short x[21];
+  for (int i=0; i<21; i++) {
+    x[i] = (short) i;
+  }
+  std::string in = write_temp(x, 21);
+  std::string out = in + ".out";
+  scanfile_options opt;
+  CHECK(scan_file(in, out, opt) < 0);
+  CHECK(access(out.c_str(), F_OK) != 0);
+  // the input is untouched by a rejected inplace scan
+  CHECK(scan_file(in, std::string(), opt) < 0);
+  short y[21];
+  read_file(in, y, 21);
+  CHECK_ARRAY_EQUAL(x, y, 21);
+  unlink(in.c_str());
+}
+
+TEST(MissingFile) {
+  scanfile_options opt;
+  CHECK(scan_file("/nonexistent/scanfile_input", std::string(), opt) < 0);
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}
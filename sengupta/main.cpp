@@ -16,17 +16,35 @@ void run(int *data, int *flag, int n, int num_iter, map<string,float> &timings)
 
   // BUILD PROGRAM AND KERNELS
   CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
-  SegmentedScan *ss = new SegmentedScan(clw, opt.wx);
+  SegmentedScan *ss = new SegmentedScan(clw, opt.wx, /*capacity_hint=*/n);
+  Trace trace;
+  if (opt.trace) {
+    ss->set_trace(&trace);
+  }
 
-  // RUN TEST
+  // RUN TEST (-a 1 uses packed flags)
+  bool packed = (opt.variant == 1);
+  cl_uint *flagbits = new cl_uint[packed_flags_length(n)];
+  pack_flags(flagbits, flag, n);
   int *x = new int[n];
   for (int run=0; run<num_iter; run++) {
     memcpy(x, data, n*sizeof(int));
-    ss->scan(x, flag, n);
+    if (packed) {
+      ss->scan_packed(x, flagbits, n);
+    } else {
+      ss->scan(x, flag, n);
+    }
   }
   memcpy(data, x, n*sizeof(int));
   delete[] x;
+  delete[] flagbits;
 
   // INSERT TIMINGS
   ss->get_timers(timings);
+  if (opt.trace) {
+    trace.write_chrome_json(opt.trace);
+    if (opt.verbose) {
+      cout << trace.level_summary();
+    }
+  }
 }
@@ -1,9 +1,19 @@
+/*
+ * Compile-time specialization (set by the SegmentedScan constructor).
+ *
+ * T is the element type of [data], SCAN_OP the associative operator (one of OP_*)
+ *   and IDENTITY its identity element for T (see common/scanop.cl).
+ * The partial [part] and flag [flag] arrays are always int in global memory
+ *   (or packed bits, see the *_packed kernels) and uchar in local memory.
+ */
+#include "scanop.cl"
+
 /*
  * Inplace upsweep (reduce) on local array [x] with partial [p].
  * [x] and [p] are of length [m].
  * NB: m must be a power of two.
  */
-inline void upsweep_pow2(__local int *x, __local int *p, int m) {
+inline void upsweep_pow2(__local T *x, __local uchar *p, int m) {
   int lid = get_local_id(0);
   int bi = (lid*2)+1;
 
@@ -15,7 +25,7 @@ inline void upsweep_pow2(__local int *x, __local int *p, int m) {
       int offset = (0x1 << d);
       int ai = bi - offset;
       if (!p[bi]) {
-        x[bi] += x[ai];
+        x[bi] = OP(x[ai], x[bi]);
       }
       p[bi] = p[bi] | p[ai];
     }
@@ -27,7 +37,7 @@ inline void upsweep_pow2(__local int *x, __local int *p, int m) {
  * [x], [p] and [f] are of length [m].
  * NB: m must be a power of two.
  */
-inline void sweepdown_pow2(__local int *x, __local int *p, __local int *f, int m) {
+inline void sweepdown_pow2(__local T *x, __local uchar *p, __local uchar *f, int m) {
   int lid = get_local_id(0);
   int bi = (lid*2)+1;
 
@@ -38,14 +48,14 @@ inline void sweepdown_pow2(__local int *x, __local int *p, __local int *f, int m
     if ((lid & mask) == mask) {
       int offset = (0x1 << d);
       int ai = bi - offset;
-      int tmp = x[ai];
-                x[ai] = x[bi];
+      T tmp = x[ai];
+              x[ai] = x[bi];
       if (f[ai+1]) {
-        x[bi] = 0;
+        x[bi] = IDENTITY;
       } else if (p[ai]) {
         x[bi] = tmp;
       } else {
-        x[bi] += tmp;
+        x[bi] = OP(x[bi], tmp);
       }
       p[ai] = 0;
     }
@@ -57,12 +67,12 @@ inline void sweepdown_pow2(__local int *x, __local int *p, __local int *f, int m
  * [x], [p] and [f] are of length [m].
  * NB: m must be a power of two.
  */
-inline void scan_pow2(__local int *x, __local int *p, __local int *f, int m) {
+inline void scan_pow2(__local T *x, __local uchar *p, __local uchar *f, int m) {
   int lid = get_local_id(0);
   int lane1 = (lid*2)+1;
   upsweep_pow2(x, p, m);
   if (lane1 == (m-1)) {
-    x[lane1] = 0;
+    x[lane1] = IDENTITY;
   }
   sweepdown_pow2(x, p, f, m);
 }
@@ -76,8 +86,8 @@ inline void scan_pow2(__local int *x, __local int *p, __local int *f, int m) {
  *     there must be exactly one workgroup of size m/2
  */
 __kernel void segscan_pow2_wrapper(
-    __global int *data, __global int *part, __global int *flag,
-    __local  int *x,    __local  int *p,     __local int *f,
+    __global T *data, __global int *part, __global int *flag,
+    __local  T *x,    __local  uchar *p,   __local uchar *f,
     int m) {
   int gid = get_global_id(0);
   int lane0 = (gid*2);
@@ -86,10 +96,10 @@ __kernel void segscan_pow2_wrapper(
   // load data into local arrays
   x[lane0] = data[lane0];
   x[lane1] = data[lane1];
-  p[lane0] = part[lane0];
-  p[lane1] = part[lane1];
-  f[lane0] = flag[lane0];
-  f[lane1] = flag[lane1];
+  p[lane0] = (part[lane0] != 0);
+  p[lane1] = (part[lane1] != 0);
+  f[lane0] = (flag[lane0] != 0);
+  f[lane1] = (flag[lane1] != 0);
 
   // inplace local scan
   scan_pow2(x, p, f, m);
@@ -109,8 +119,8 @@ __kernel void segscan_pow2_wrapper(
  *     there must be exactly one workgroup of size m/2
  */
 __kernel void segscan_pad_to_pow2(
-    __global int *data, __global int *part, __global int *flag,
-    __local  int *x,    __local  int *p,     __local int *f,
+    __global T *data, __global int *part, __global int *flag,
+    __local  T *x,    __local  uchar *p,   __local uchar *f,
     int n) {
   int gid = get_global_id(0);
   int lane0 = (gid*2);
@@ -118,12 +128,12 @@ __kernel void segscan_pad_to_pow2(
   int m = 2*get_local_size(0);
 
   // load data into local arrays, padding with identity element
-  x[lane0] = lane0 < n ? data[lane0] : 0;
-  x[lane1] = lane1 < n ? data[lane1] : 0;
-  p[lane0] = lane0 < n ? part[lane0] : 0;
-  p[lane1] = lane1 < n ? part[lane1] : 0;
-  f[lane0] = lane0 < n ? flag[lane0] : 0;
-  f[lane1] = lane1 < n ? flag[lane1] : 0;
+  x[lane0] = lane0 < n ? data[lane0] : IDENTITY;
+  x[lane1] = lane1 < n ? data[lane1] : IDENTITY;
+  p[lane0] = lane0 < n ? (part[lane0] != 0) : 0;
+  p[lane1] = lane1 < n ? (part[lane1] != 0) : 0;
+  f[lane0] = lane0 < n ? (flag[lane0] != 0) : 0;
+  f[lane1] = lane1 < n ? (flag[lane1] != 0) : 0;
 
   // inplace local scan
   scan_pow2(x, p, f, m);
@@ -155,9 +165,9 @@ __kernel void segscan_pad_to_pow2(
  * We writeback [data] and [part] for the second stage [downsweep_subarrays].
  */
 __kernel void upsweep_subarrays(
-    __global int *data,  __global int *part,  __global int *flag,
-    __global int *data2, __global int *part2, __global int *flag2,
-    __local  int *x,     __local  int *p,     __local  int *f,
+    __global T *data,  __global int *part,  __global int *flag,
+    __global T *data2, __global int *part2, __global int *flag2,
+    __local  T *x,     __local  uchar *p,   __local  uchar *f,
     int n) {
   // workgroup size
   int wx = get_local_size(0);
@@ -175,12 +185,12 @@ __kernel void upsweep_subarrays(
   int k = get_num_groups(0);
 
   // load into local data padding elements >= n with identity
-  x[local_lane0] = (lane0 < n) ? data[lane0] : 0;
-  x[local_lane1] = (lane1 < n) ? data[lane1] : 0;
-  p[local_lane0] = (lane0 < n) ? part[lane0] : 0;
-  p[local_lane1] = (lane1 < n) ? part[lane1] : 0;
-  f[local_lane0] = (lane0 < n) ? flag[lane0] : 0;
-  f[local_lane1] = (lane1 < n) ? flag[lane1] : 0;
+  x[local_lane0] = (lane0 < n) ? data[lane0] : IDENTITY;
+  x[local_lane1] = (lane1 < n) ? data[lane1] : IDENTITY;
+  p[local_lane0] = (lane0 < n) ? (part[lane0] != 0) : 0;
+  p[local_lane1] = (lane1 < n) ? (part[lane1] != 0) : 0;
+  f[local_lane0] = (lane0 < n) ? (flag[lane0] != 0) : 0;
+  f[local_lane1] = (lane1 < n) ? (flag[lane1] != 0) : 0;
 
   // upsweep on each subarray
   upsweep_pow2(x, p, m);
@@ -220,9 +230,9 @@ __kernel void upsweep_subarrays(
  * We fold in results from [data2] and perform a local downsweep.
  */
 __kernel void downsweep_subarrays(
-    __global int *data,  __global int *part,  __global int *flag,
-    __global int *data2, __global int *part2, __global int *flag2,
-    __local  int *x,     __local  int *p,     __local  int *f,
+    __global T *data,  __global int *part,  __global int *flag,
+    __global T *data2, __global int *part2, __global int *flag2,
+    __local  T *x,     __local  uchar *p,   __local  uchar *f,
     int n) {
   // workgroup size
   int wx = get_local_size(0);
@@ -242,10 +252,10 @@ __kernel void downsweep_subarrays(
   // load into local data
   x[local_lane0] = data[lane0];
   x[local_lane1] = data[lane1];
-  p[local_lane0] = part[lane0];
-  p[local_lane1] = part[lane1];
-  f[local_lane0] = flag[lane0];
-  f[local_lane1] = flag[lane1];
+  p[local_lane0] = (part[lane0] != 0);
+  p[local_lane1] = (part[lane1] != 0);
+  f[local_lane0] = (flag[lane0] != 0);
+  f[local_lane1] = (flag[lane1] != 0);
 
   // fold partial results back
   if (lid == (wx-1)) {
@@ -262,3 +272,224 @@ __kernel void downsweep_subarrays(
   if (lane1 < n)
     data[lane1] = x[local_lane1];
 }
+
+/*
+ * Packed flags.
+ *
+ * The head flag of element i is bit (i%32) of word [flagbits][i/32].
+ * The partial flags start out equal to the head flags so we derive them on-device
+ *   instead of uploading a second array.
+ * The first stage only writes the per-subarray results ([data2], [part2], [flag2]);
+ *   the second stage reloads [data] and [flagbits] and redoes the local upsweep,
+ *   so we never write the intermediate [data] and [part] back to global memory.
+ * [data] is of length [n] (no padding to [k*m] is needed).
+ * The second-level scan over [data2], [part2], [flag2] uses the kernels above.
+ */
+inline void load_packed(
+    __global T *data, __global uint *flagbits,
+    __local  T *x,    __local  uchar *p,   __local  uchar *f,
+    int base, int n) {
+  int lid = get_local_id(0);
+  for (int i=0; i<2; i++) {
+    int l = (2*lid)+i;
+    int g = base + l;
+    if (g < n) {
+      x[l] = data[g];
+      f[l] = (flagbits[g >> 5] >> (g & 31)) & 1;
+    } else {
+      x[l] = IDENTITY;
+      f[l] = 0;
+    }
+    p[l] = f[l];
+  }
+}
+
+inline void store_packed(__global T *data, __local T *x, int base, int n) {
+  int lid = get_local_id(0);
+  for (int i=0; i<2; i++) {
+    int l = (2*lid)+i;
+    if (base+l < n) {
+      data[base+l] = x[l];
+    }
+  }
+}
+
+/*
+ * Single workgroup segmented scan of [data] with packed flags [flagbits].
+ * NB: We assume n <= m, and
+ *     there must be exactly one workgroup of size m/2
+ */
+__kernel void segscan_pad_to_pow2_packed(
+    __global T *data, __global uint *flagbits,
+    __local  T *x,    __local  uchar *p,   __local  uchar *f,
+    int n) {
+  int m = 2*get_local_size(0);
+  load_packed(data, flagbits, x, p, f, 0, n);
+  scan_pow2(x, p, f, m);
+  store_packed(data, x, 0, n);
+}
+
+/*
+ * First stage of a multiblock segmented scan with packed flags.
+ * Like [upsweep_subarrays] but only the last element ([data2], [part2])
+ *   and first flag ([flag2]) of each subarray are written out.
+ */
+__kernel void upsweep_subarrays_packed(
+    __global T *data,  __global uint *flagbits,
+    __global T *data2, __global int *part2, __global int *flag2,
+    __local  T *x,     __local  uchar *p,   __local  uchar *f,
+    int n) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = wx * 2;
+
+  load_packed(data, flagbits, x, p, f, grpid*m, n);
+  upsweep_pow2(x, p, m);
+
+  if (lid == (wx-1)) {
+    data2[grpid] = x[m-1];
+    part2[grpid] = p[m-1];
+  }
+  if (lid == 0) {
+    flag2[grpid] = f[0];
+  }
+}
+
+/*
+ * Second stage of a multiblock segmented scan with packed flags.
+ * We redo the local upsweep of [upsweep_subarrays_packed],
+ *   fold in the scanned [data2] and perform a local downsweep.
+ */
+__kernel void downsweep_subarrays_packed(
+    __global T *data,  __global uint *flagbits,
+    __global T *data2,
+    __local  T *x,     __local  uchar *p,   __local  uchar *f,
+    int n) {
+  int wx = get_local_size(0);
+  int lid = get_local_id(0);
+  int grpid = get_group_id(0);
+  int m = wx * 2;
+
+  load_packed(data, flagbits, x, p, f, grpid*m, n);
+  upsweep_pow2(x, p, m);
+
+  if (lid == (wx-1)) {
+    x[m-1] = data2[grpid];
+  }
+  sweepdown_pow2(x, p, f, m);
+
+  store_packed(data, x, grpid*m, n);
+}
+
+/*
+ * Build packed flags [flagbits] for [n] elements from the start offsets of
+ *   [nsegments] segments ([flags_clear] first). Offsets >= n are ignored.
+ */
+__kernel void flags_clear(__global uint *flagbits, int nwords) {
+  int gid = get_global_id(0);
+  if (gid < nwords) {
+    flagbits[gid] = 0;
+  }
+}
+
+__kernel void flags_from_offsets(
+    __global uint *flagbits, __global int *offsets,
+    int nsegments, int n) {
+  int gid = get_global_id(0);
+  if (gid < nsegments) {
+    int i = offsets[gid];
+    if (0 <= i && i < n) {
+      atomic_or(&flagbits[i >> 5], 1u << (i & 31));
+    }
+  }
+}
+
+/*
+ * Build packed flags [flagbits] for [n] elements from per-element segment [keys].
+ * Element i starts a segment if its key differs from element i-1.
+ * Each workitem builds one word so no atomics are needed.
+ */
+__kernel void flags_from_keys(
+    __global uint *flagbits, __global int *keys,
+    int n) {
+  int gid = get_global_id(0);
+  int base = gid * 32;
+  if (base < n) {
+    uint word = 0;
+    int prev = (base == 0) ? keys[0] : keys[base-1];
+    for (int b=0; b<32 && base+b<n; b++) {
+      int key = keys[base+b];
+      if (key != prev) {
+        word |= (1u << b);
+      }
+      prev = key;
+    }
+    flagbits[gid] = word;
+  }
+}
+
+/*
+ * Per-segment totals for segments given by start [offsets] (see flags_from_offsets).
+ * Segment s covers elements offsets[s] up to (but excluding) offsets[s+1], or n for the last.
+ * [segment_last] saves the last element of each segment into [totals] before the inplace scan;
+ *   [segment_totals] then combines it with the scanned (exclusive) value.
+ * Empty segments get IDENTITY.
+ */
+inline int last_of_segment(__global int *offsets, int s, int nsegments, int n) {
+  int start = offsets[s];
+  int end = (s+1 < nsegments) ? offsets[s+1] : n;
+  end = min(end, n);
+  return (0 <= start && start < end) ? end-1 : -1;
+}
+
+__kernel void segment_last(
+    __global T *data, __global int *offsets, __global T *totals,
+    int nsegments, int n) {
+  int gid = get_global_id(0);
+  if (gid < nsegments) {
+    int last = last_of_segment(offsets, gid, nsegments, n);
+    totals[gid] = (last < 0) ? IDENTITY : data[last];
+  }
+}
+
+__kernel void segment_totals(
+    __global T *data, __global int *offsets, __global T *totals,
+    int nsegments, int n) {
+  int gid = get_global_id(0);
+  if (gid < nsegments) {
+    int last = last_of_segment(offsets, gid, nsegments, n);
+    if (last >= 0) {
+      totals[gid] = OP(data[last], totals[gid]);
+    }
+  }
+}
+
+/*
+ * Per-segment totals for segments given by head flags, or by [keys] when [by_key] is set.
+ * Element i is the tail of its segment if element i+1 starts a new segment, or i == n-1.
+ * As above [tail_last] saves each tail element into [totals] before the inplace scan
+ *   and [tail_totals] combines it with the scanned value; non-tail elements get IDENTITY.
+ */
+inline bool is_tail(__global int *heads, int i, int by_key, int n) {
+  if (i == n-1) return true;
+  return by_key ? (heads[i+1] != heads[i]) : (heads[i+1] != 0);
+}
+
+__kernel void tail_last(
+    __global T *data, __global int *heads, __global T *totals,
+    int by_key, int n) {
+  int gid = get_global_id(0);
+  if (gid < n) {
+    totals[gid] = is_tail(heads, gid, by_key, n) ? data[gid] : IDENTITY;
+  }
+}
+
+__kernel void tail_totals(
+    __global T *data, __global int *heads, __global T *totals,
+    int by_key, int n) {
+  int gid = get_global_id(0);
+  if (gid < n && is_tail(heads, gid, by_key, n)) {
+    totals[gid] = OP(data[gid], totals[gid]);
+  }
+}
@@ -1,98 +1,462 @@
 #include "segscan.h"
+#include "programcache.h"
+#include "tuning.h"
 
-#include <cmath>
+#include <cstring>
+#include <sstream>
 
-void SegmentedScan::scan(int *data, int *flag, int n) {
-  int k = (int) ceil((float)n/(float)m);
-  cl_mem d_data = clw.dev_malloc(sizeof(int)*k*m);
-  cl_mem d_part = clw.dev_malloc(sizeof(int)*k*m);
-  cl_mem d_flag = clw.dev_malloc(sizeof(int)*k*m);
-  m0 += clw.memcpy_to_dev(d_data, sizeof(int)*n, data);
-  m1 += clw.memcpy_to_dev(d_part, sizeof(int)*n, flag);
-  m2 += clw.memcpy_to_dev(d_flag, sizeof(int)*n, flag);
+/*
+ * Source of segscan.cl, or NULL to compile it from the working directory.
+ */
+#if EMBED_CL
+#include "segscan.cl.h"
+static const char *segscan_source = (const char *)&segscan_cl;
+#else
+static const char *segscan_source = NULL;
+#endif
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan(T *data, int *flag, int n) {
+  TraceCall call(trace);
+  int k = (n + m-1) / m;
+  cl_mem d_data = pool.acquire(sizeof(T)*k*m);
+  cl_mem d_part = pool.acquire(sizeof(int)*k*m);
+  cl_mem d_flag = pool.acquire(sizeof(int)*k*m);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_part, sizeof(int)*n, flag, n, m1);
+  upload(d_flag, sizeof(int)*n, flag, n, m2);
   recursive_scan(d_data, d_part, d_flag, n);
-  m3 += clw.memcpy_from_dev(d_data, sizeof(int)*n, data);
-  clw.dev_free(d_data);
-  clw.dev_free(d_part);
-  clw.dev_free(d_flag);
-}
-
-void SegmentedScan::scan(cl_mem data, cl_mem flag, int n) {
-  int k = (int) ceil((float)n/(float)m);
-  cl_mem d_data = clw.dev_malloc(sizeof(int)*k*m);
-  cl_mem d_part = clw.dev_malloc(sizeof(int)*k*m);
-  cl_mem d_flag = clw.dev_malloc(sizeof(int)*k*m);
-  clw.copy_buffer(data, d_data, sizeof(int)*n);
-  clw.copy_buffer(flag, d_part, sizeof(int)*n);
-  clw.copy_buffer(flag, d_flag, sizeof(int)*n);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  pool.release(d_data);
+  pool.release(d_part);
+  pool.release(d_flag);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan(cl_mem data, cl_mem flag, int n) {
+  TraceCall call(trace);
+  int k = (n + m-1) / m;
+  cl_mem d_data = pool.acquire(sizeof(T)*k*m);
+  cl_mem d_part = pool.acquire(sizeof(int)*k*m);
+  cl_mem d_flag = pool.acquire(sizeof(int)*k*m);
+  copy(data, d_data, sizeof(T)*n, n);
+  copy(flag, d_part, sizeof(int)*n, n);
+  copy(flag, d_flag, sizeof(int)*n, n);
   recursive_scan(d_data, d_part, d_flag, n);
-  clw.copy_buffer(d_data, data, sizeof(int)*n);
-  clw.dev_free(d_data);
-  clw.dev_free(d_part);
-  clw.dev_free(d_flag);
+  copy(d_data, data, sizeof(T)*n, n);
+  pool.release(d_data);
+  pool.release(d_part);
+  pool.release(d_flag);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan(T *data, int *flag, int n, T *totals) {
+  TraceCall call(trace);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_flag = pool.acquire(sizeof(int)*n);
+  cl_mem d_totals = pool.acquire(sizeof(T)*n);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_flag, sizeof(int)*n, flag, n, m2);
+  scan(d_data, d_flag, n, d_totals);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  download(d_totals, sizeof(T)*n, totals, n, m3);
+  pool.release(d_data);
+  pool.release(d_flag);
+  pool.release(d_totals);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan(cl_mem data, cl_mem flag, int n, cl_mem totals) {
+  TraceCall call(trace);
+  tail_scan(data, flag, /*by_key=*/0, n, totals);
 }
 
-void SegmentedScan::recursive_scan(cl_mem d_data, cl_mem d_part, cl_mem d_flag, int n) {
-  int k = (int) ceil((float)n/(float)m);
+/*
+ * Scan [data] by flags, or by keys if [by_key], bracketed by the tail kernels (see tail_last).
+ * Like the offsets totals these are elementwise passes with no extra scan.
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::tail_scan(cl_mem data, cl_mem heads, int by_key, int n, cl_mem totals) {
+  size_t gx = ((n + wx-1) / wx) * wx;
+  level = 0;
+  level_n = n;
+  clw.kernel_arg(tail_last,
+    data, heads, totals, by_key, n);
+  run_kernel(tail_last, &gx, k3);
+  if (by_key) {
+    scan_by_key(data, heads, n);
+  } else {
+    scan(data, heads, n);
+  }
+  level = 0;
+  level_n = n;
+  clw.kernel_arg(tail_totals,
+    data, heads, totals, by_key, n);
+  run_kernel(tail_totals, &gx, k3);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::recursive_scan(cl_mem d_data, cl_mem d_part, cl_mem d_flag, int n, int depth) {
+  level = depth;
+  level_n = n;
+  int k = (n + m-1) / m;
   //size of each subarray stored in local memory
-  size_t bufsize = sizeof(int)*m;
+  size_t databufsize = sizeof(T)*m;
+  size_t bufsize = sizeof(cl_uchar)*m;
   if (k == 1) {
     clw.kernel_arg(scan_pad_to_pow2,
       d_data,  d_part,  d_flag,
-      bufsize, bufsize, bufsize,
+      databufsize, bufsize, bufsize,
       n);
-    k0 += clw.run_kernel_with_timing(scan_pad_to_pow2, /*dim=*/1, &wx, &wx);
+    run_kernel(scan_pad_to_pow2, &wx, k0);
 
   } else {
     size_t gx = k * wx;
-    cl_mem d_data2 = clw.dev_malloc(sizeof(int)*k);
-    cl_mem d_part2 = clw.dev_malloc(sizeof(int)*k);
-    cl_mem d_flag2 = clw.dev_malloc(sizeof(int)*k);
+    cl_mem d_data2 = pool.acquire(sizeof(T)*k);
+    cl_mem d_part2 = pool.acquire(sizeof(int)*k);
+    cl_mem d_flag2 = pool.acquire(sizeof(int)*k);
     clw.kernel_arg(upsweep_subarrays,
       d_data,  d_part,  d_flag,
       d_data2, d_part2, d_flag2,
-      bufsize, bufsize, bufsize,
+      databufsize, bufsize, bufsize,
       n);
-    k1 += clw.run_kernel_with_timing(upsweep_subarrays, /*dim=*/1, &gx, &wx);
+    run_kernel(upsweep_subarrays, &gx, k1);
 
-    recursive_scan(d_data2, d_part2, d_flag2, k);
+    recursive_scan(d_data2, d_part2, d_flag2, k, depth+1);
+    level = depth;
+    level_n = n;
 
     clw.kernel_arg(downsweep_subarrays,
       d_data,  d_part,  d_flag,
       d_data2, d_part2, d_flag2,
-      bufsize, bufsize, bufsize,
+      databufsize, bufsize, bufsize,
+      n);
+    run_kernel(downsweep_subarrays, &gx, k2);
+
+    pool.release(d_data2);
+    pool.release(d_part2);
+    pool.release(d_flag2);
+  }
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_packed(T *data, cl_uint *flagbits, int n) {
+  TraceCall call(trace);
+  int nwords = packed_flags_length(n);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_flagbits = pool.acquire(sizeof(cl_uint)*nwords);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_flagbits, sizeof(cl_uint)*nwords, flagbits, nwords, m2);
+  packed_scan(d_data, d_flagbits, n);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  pool.release(d_data);
+  pool.release(d_flagbits);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_packed(cl_mem data, cl_mem flagbits, int n) {
+  TraceCall call(trace);
+  packed_scan(data, flagbits, n);
+}
+
+/*
+ * The top level reads [d_data] and [d_flagbits] directly and only writes [d_data];
+ *   the per-subarray results are scanned by the unpacked recursive_scan.
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::packed_scan(cl_mem d_data, cl_mem d_flagbits, int n) {
+  level = 0;
+  level_n = n;
+  int k = (n + m-1) / m;
+  //size of each subarray stored in local memory
+  size_t databufsize = sizeof(T)*m;
+  size_t bufsize = sizeof(cl_uchar)*m;
+  if (k == 1) {
+    clw.kernel_arg(scan_pad_to_pow2_packed,
+      d_data, d_flagbits,
+      databufsize, bufsize, bufsize,
+      n);
+    run_kernel(scan_pad_to_pow2_packed, &wx, k0);
+
+  } else {
+    size_t gx = k * wx;
+    cl_mem d_data2 = pool.acquire(sizeof(T)*k);
+    cl_mem d_part2 = pool.acquire(sizeof(int)*k);
+    cl_mem d_flag2 = pool.acquire(sizeof(int)*k);
+    clw.kernel_arg(upsweep_subarrays_packed,
+      d_data,  d_flagbits,
+      d_data2, d_part2, d_flag2,
+      databufsize, bufsize, bufsize,
       n);
-    k2 += clw.run_kernel_with_timing(downsweep_subarrays, /*dim=*/1, &gx, &wx);
+    run_kernel(upsweep_subarrays_packed, &gx, k1);
 
-    clw.dev_free(d_data2);
-    clw.dev_free(d_part2);
-    clw.dev_free(d_flag2);
+    recursive_scan(d_data2, d_part2, d_flag2, k, 1);
+    level = 0;
+    level_n = n;
+
+    clw.kernel_arg(downsweep_subarrays_packed,
+      d_data,  d_flagbits,
+      d_data2,
+      databufsize, bufsize, bufsize,
+      n);
+    run_kernel(downsweep_subarrays_packed, &gx, k2);
+
+    pool.release(d_data2);
+    pool.release(d_part2);
+    pool.release(d_flag2);
   }
 }
 
-SegmentedScan::SegmentedScan(CLWrapper &clw, size_t wx) : clw(clw), wx(wx),
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_offsets(T *data, int n, int *offsets, int nsegments) {
+  TraceCall call(trace);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_offsets = pool.acquire(sizeof(int)*nsegments);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_offsets, sizeof(int)*nsegments, offsets, nsegments, m4);
+  scan_by_offsets(d_data, n, d_offsets, nsegments);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  pool.release(d_data);
+  pool.release(d_offsets);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_offsets(cl_mem data, int n, cl_mem offsets, int nsegments) {
+  TraceCall call(trace);
+  int nwords = packed_flags_length(n);
+  cl_mem d_flagbits = pool.acquire(sizeof(cl_uint)*nwords);
+  size_t gx = ((nwords + wx-1) / wx) * wx;
+  level = 0;
+  level_n = n;
+  clw.kernel_arg(flags_clear,
+    d_flagbits, nwords);
+  run_kernel(flags_clear, &gx, k3);
+  gx = ((nsegments + wx-1) / wx) * wx;
+  clw.kernel_arg(flags_from_offsets,
+    d_flagbits, offsets, nsegments, n);
+  run_kernel(flags_from_offsets, &gx, k3);
+  packed_scan(data, d_flagbits, n);
+  pool.release(d_flagbits);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_offsets(T *data, int n, int *offsets, int nsegments, T *totals) {
+  TraceCall call(trace);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_offsets = pool.acquire(sizeof(int)*nsegments);
+  cl_mem d_totals = pool.acquire(sizeof(T)*nsegments);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_offsets, sizeof(int)*nsegments, offsets, nsegments, m4);
+  scan_by_offsets(d_data, n, d_offsets, nsegments, d_totals);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  download(d_totals, sizeof(T)*nsegments, totals, nsegments, m3);
+  pool.release(d_data);
+  pool.release(d_offsets);
+  pool.release(d_totals);
+}
+
+/*
+ * The totals only touch the last element of each segment,
+ *   so they cost two launches of [nsegments] workitems and no extra pass over [data].
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_offsets(cl_mem data, int n, cl_mem offsets, int nsegments, cl_mem totals) {
+  TraceCall call(trace);
+  size_t gx = ((nsegments + wx-1) / wx) * wx;
+  level = 0;
+  level_n = n;
+  clw.kernel_arg(segment_last,
+    data, offsets, totals, nsegments, n);
+  run_kernel(segment_last, &gx, k3);
+  scan_by_offsets(data, n, offsets, nsegments);
+  clw.kernel_arg(segment_totals,
+    data, offsets, totals, nsegments, n);
+  run_kernel(segment_totals, &gx, k3);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_key(T *data, int *keys, int n) {
+  TraceCall call(trace);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_keys = pool.acquire(sizeof(int)*n);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_keys, sizeof(int)*n, keys, n, m4);
+  scan_by_key(d_data, d_keys, n);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  pool.release(d_data);
+  pool.release(d_keys);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_key(cl_mem data, cl_mem keys, int n) {
+  TraceCall call(trace);
+  int nwords = packed_flags_length(n);
+  cl_mem d_flagbits = pool.acquire(sizeof(cl_uint)*nwords);
+  size_t gx = ((nwords + wx-1) / wx) * wx;
+  level = 0;
+  level_n = n;
+  clw.kernel_arg(flags_from_keys,
+    d_flagbits, keys, n);
+  run_kernel(flags_from_keys, &gx, k3);
+  packed_scan(data, d_flagbits, n);
+  pool.release(d_flagbits);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_key(T *data, int *keys, int n, T *totals) {
+  TraceCall call(trace);
+  cl_mem d_data = pool.acquire(sizeof(T)*n);
+  cl_mem d_keys = pool.acquire(sizeof(int)*n);
+  cl_mem d_totals = pool.acquire(sizeof(T)*n);
+  upload(d_data, sizeof(T)*n, data, n, m0);
+  upload(d_keys, sizeof(int)*n, keys, n, m4);
+  scan_by_key(d_data, d_keys, n, d_totals);
+  download(d_data, sizeof(T)*n, data, n, m3);
+  download(d_totals, sizeof(T)*n, totals, n, m3);
+  pool.release(d_data);
+  pool.release(d_keys);
+  pool.release(d_totals);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::scan_by_key(cl_mem data, cl_mem keys, int n, cl_mem totals) {
+  TraceCall call(trace);
+  tail_scan(data, keys, /*by_key=*/1, n, totals);
+}
+
+/*
+ * Run kernel [k] over [gx] workitems and add its time to [timer].
+ * Traced kernels are recorded at the current [level].
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::run_kernel(cl_kernel k, size_t *gx, float &timer) {
+  timer += trace ? trace->run_kernel(clw.get_command_queue(), k, gx, &wx, level, level_n)
+                 : clw.run_kernel_with_timing(k, /*dim=*/1, gx, &wx);
+}
+
+/*
+ * Blocking copies of [size] bytes ([n] elements), adding their time to [timer].
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::upload(cl_mem buffer, size_t size, const void *ptr, int n, float &timer) {
+  timer += trace ? trace->memcpy_to_dev(clw.get_command_queue(), buffer, size, ptr, n)
+                 : clw.memcpy_to_dev(buffer, size, ptr);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::download(cl_mem buffer, size_t size, void *ptr, int n, float &timer) {
+  timer += trace ? trace->memcpy_from_dev(clw.get_command_queue(), buffer, size, ptr, n)
+                 : clw.memcpy_from_dev(buffer, size, ptr);
+}
+
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::copy(cl_mem src, cl_mem dst, size_t size, int n) {
+  if (trace) {
+    trace->copy_buffer(clw.get_command_queue(), src, dst, size, n);
+  } else {
+    clw.copy_buffer(src, dst, size);
+  }
+}
+
+/*
+ * Make sure the pool holds every buffer needed to scan an array of length [n],
+ *   ie, three padded staging buffers and three partial buffers per recursion level.
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::reserve(int n) {
+  vector<cl_mem> buffers;
+  int k = (n + m-1) / m;
+  buffers.push_back(pool.acquire(sizeof(T)*k*m));
+  for (int i=0; i<2; i++) {
+    buffers.push_back(pool.acquire(sizeof(int)*k*m));
+  }
+  while (k > 1) {
+    buffers.push_back(pool.acquire(sizeof(T)*k));
+    for (int i=0; i<2; i++) {
+      buffers.push_back(pool.acquire(sizeof(int)*k));
+    }
+    k = (k + m-1) / m;
+  }
+  for (size_t i=0; i<buffers.size(); i++) {
+    pool.release(buffers[i]);
+  }
+}
+
+/*
+ * Free all pooled device buffers.
+ */
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::trim() {
+  pool.trim();
+}
+
+template <typename T, class Op>
+BasicSegmentedScan<T,Op>::BasicSegmentedScan(CLWrapper &clw, size_t wx, int capacity_hint) : clw(clw), wx(wx), pool(clw),
+  trace(NULL), level(0), level_n(0),
   m0(0), m1(0), m2(0), m3(0),
-  k0(0), k1(0), k2(0) {
-  m = wx * 2;
-#if EMBED_CL
-  #include "segscan.cl.h"
-  clw.create_all_kernels(clw.compile_from_string((char *)&segscan_cl));
-#else
-  clw.create_all_kernels(clw.compile("segscan.cl"));
-#endif
-  scan_pow2 = clw.kernel_of_name("segscan_pow2_wrapper");
-  scan_pad_to_pow2 = clw.kernel_of_name("segscan_pad_to_pow2");
-  upsweep_subarrays = clw.kernel_of_name("upsweep_subarrays");
-  downsweep_subarrays = clw.kernel_of_name("downsweep_subarrays");
+  k0(0), k1(0), k2(0), m4(0), k3(0) {
+  if (wx == 0) {
+    std::string kind = tuning_kind<T,Op>("segscan");
+    tuning t;
+    if (find_tuning(clw, kind, capacity_hint, t) || find_tuning(clw, kind, 0, t)) {
+      this->wx = t.wx;
+    } else {
+      this->wx = 256;
+    }
+  }
+  m = this->wx * 2;
+  stringstream flags;
+  flags << "-D T=" << cl_type<T>::name()
+        << " -D SCAN_OP=" << Op::cl_id() << " -D IDENTITY=" << Op::cl_identity()
+        << cl_type<T>::options();
+  cl_program program = cached_program(clw, "segscan.cl", segscan_source, flags.str());
+  scan_pow2 = create_kernel(program, "segscan_pow2_wrapper");
+  scan_pad_to_pow2 = create_kernel(program, "segscan_pad_to_pow2");
+  upsweep_subarrays = create_kernel(program, "upsweep_subarrays");
+  downsweep_subarrays = create_kernel(program, "downsweep_subarrays");
+  scan_pad_to_pow2_packed = create_kernel(program, "segscan_pad_to_pow2_packed");
+  upsweep_subarrays_packed = create_kernel(program, "upsweep_subarrays_packed");
+  downsweep_subarrays_packed = create_kernel(program, "downsweep_subarrays_packed");
+  flags_clear = create_kernel(program, "flags_clear");
+  flags_from_offsets = create_kernel(program, "flags_from_offsets");
+  flags_from_keys = create_kernel(program, "flags_from_keys");
+  segment_last = create_kernel(program, "segment_last");
+  segment_totals = create_kernel(program, "segment_totals");
+  tail_last = create_kernel(program, "tail_last");
+  tail_totals = create_kernel(program, "tail_totals");
   reset_timers();
+  if (capacity_hint > 0) {
+    reserve(capacity_hint);
+  }
+}
+
+template <typename T, class Op>
+BasicSegmentedScan<T,Op>::~BasicSegmentedScan() {
+  clReleaseKernel(scan_pow2);
+  clReleaseKernel(scan_pad_to_pow2);
+  clReleaseKernel(upsweep_subarrays);
+  clReleaseKernel(downsweep_subarrays);
+  clReleaseKernel(scan_pad_to_pow2_packed);
+  clReleaseKernel(upsweep_subarrays_packed);
+  clReleaseKernel(downsweep_subarrays_packed);
+  clReleaseKernel(flags_clear);
+  clReleaseKernel(flags_from_offsets);
+  clReleaseKernel(flags_from_keys);
+  clReleaseKernel(segment_last);
+  clReleaseKernel(segment_totals);
+  clReleaseKernel(tail_last);
+  clReleaseKernel(tail_totals);
+  release_cached_programs(clw);
 }
 
-void SegmentedScan::reset_timers() {
-  m0 = m1 = m2 = m3 = 0;
-  k0 = k1 = k2 = 0;
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::reset_timers() {
+  m0 = m1 = m2 = m3 = m4 = 0;
+  k0 = k1 = k2 = k3 = 0;
 }
 
-void SegmentedScan::get_timers(map<string,float> &timings) {
+template <typename T, class Op>
+void BasicSegmentedScan<T,Op>::get_timers(map<string,float> &timings) {
   timings.insert(make_pair("SEGSCAN1. data_memcpy_to_dev",   m0));
   timings.insert(make_pair("SEGSCAN2. part_memcpy_to_dev",   m1));
   timings.insert(make_pair("SEGSCAN3. flag_memcpy_to_dev",   m2));
@@ -100,4 +464,36 @@ void SegmentedScan::get_timers(map<string,float> &timings) {
   timings.insert(make_pair("SEGSCAN5. upsweep_subarrays",    k1));
   timings.insert(make_pair("SEGSCAN6. downsweep_subarrays",  k2));
   timings.insert(make_pair("SEGSCAN7. data_memcpy_from_dev", m3));
+  timings.insert(make_pair("SEGSCAN8. segs_memcpy_to_dev",   m4));
+  timings.insert(make_pair("SEGSCAN9. build_flags",          k3));
+}
+
+int packed_flags_length(int n) {
+  return (n+31)/32;
 }
+
+void pack_flags(cl_uint *flagbits, const int *flag, int n) {
+  memset(flagbits, 0, sizeof(cl_uint)*packed_flags_length(n));
+  for (int i=0; i<n; i++) {
+    if (flag[i]) {
+      flagbits[i >> 5] |= (1u << (i & 31));
+    }
+  }
+}
+
+template class BasicSegmentedScan<int,     Add<int> >;
+template class BasicSegmentedScan<int,     Max<int> >;
+template class BasicSegmentedScan<int,     Min<int> >;
+template class BasicSegmentedScan<int,     And<int> >;
+template class BasicSegmentedScan<int,     Or<int> >;
+template class BasicSegmentedScan<int64_t, Add<int64_t> >;
+template class BasicSegmentedScan<int64_t, Max<int64_t> >;
+template class BasicSegmentedScan<int64_t, Min<int64_t> >;
+template class BasicSegmentedScan<int64_t, And<int64_t> >;
+template class BasicSegmentedScan<int64_t, Or<int64_t> >;
+template class BasicSegmentedScan<float,   Add<float> >;
+template class BasicSegmentedScan<float,   Max<float> >;
+template class BasicSegmentedScan<float,   Min<float> >;
+template class BasicSegmentedScan<double,  Add<double> >;
+template class BasicSegmentedScan<double,  Max<double> >;
+template class BasicSegmentedScan<double,  Min<double> >;
@@ -1,31 +1,119 @@
 #ifndef SEGSCAN_H
 #define SEGSCAN_H
 
+#include "bufferpool.h"
 #include "clwrapper.h"
+#include "scanop.h"
+#include "trace.h"
 
-class SegmentedScan {
+/*
+ * Segmented exclusive scan of elements of type [T] under the associative operator [Op] (see scanop.h).
+ * Flags are always int. Instantiated for the same specializations as BasicScan.
+ */
+template <typename T, class Op=Add<T> >
+class BasicSegmentedScan {
   private:
     CLWrapper &clw;
     cl_kernel scan_pow2;
     cl_kernel scan_pad_to_pow2;
     cl_kernel upsweep_subarrays;
     cl_kernel downsweep_subarrays;
+    cl_kernel scan_pad_to_pow2_packed;
+    cl_kernel upsweep_subarrays_packed;
+    cl_kernel downsweep_subarrays_packed;
+    cl_kernel flags_clear;
+    cl_kernel flags_from_offsets;
+    cl_kernel flags_from_keys;
+    cl_kernel segment_last;
+    cl_kernel segment_totals;
+    cl_kernel tail_last;
+    cl_kernel tail_totals;
     size_t wx; // workgroup size
     int m;     // length of each subarray ( = wx*2 )
+    BufferPool pool; // staging and partial buffers reused across calls
+    Trace *trace;    // commands are recorded here if not NULL (see set_trace)
+    int level;       // recursion level and length of the commands being enqueued
+    int level_n;
 
     //timings
     float c0; float c1;
     float m0; float m1; float m2; float m3;
     float k0; float k1; float k2;
+    float m4; float k3; //segment offsets/keys
 
-    void recursive_scan(cl_mem d_data, cl_mem d_part, cl_mem d_flag, int n);
+    void recursive_scan(cl_mem d_data, cl_mem d_part, cl_mem d_flag, int n, int depth=0);
+    void packed_scan(cl_mem d_data, cl_mem d_flagbits, int n);
+    void tail_scan(cl_mem data, cl_mem heads, int by_key, int n, cl_mem totals);
+    void run_kernel(cl_kernel k, size_t *gx, float &timer);
+    void upload(cl_mem buffer, size_t size, const void *ptr, int n, float &timer);
+    void download(cl_mem buffer, size_t size, void *ptr, int n, float &timer);
+    void copy(cl_mem src, cl_mem dst, size_t size, int n);
 
   public:
-    SegmentedScan(CLWrapper &clw, size_t wx=256);
+    // with [wx] 0 the workgroup size comes from the tuning profile (see common/tuning.h)
+    BasicSegmentedScan(CLWrapper &clw, size_t wx=256, int capacity_hint=0);
+    ~BasicSegmentedScan();
     void reset_timers();
     void get_timers(map<string,float> &timings);
-    void scan(int *data, int *flag, int n);
+    void reserve(int n);
+    void trim();
+    size_t workgroup_size() { return wx; }
+
+    // record every kernel launch and transfer in [t], or stop if NULL (see BasicScan::set_trace)
+    void set_trace(Trace *t) { trace = t; }
+
+    void scan(T *data, int *flag, int n);
     void scan(cl_mem data, cl_mem flag, int n);
+
+    /*
+     * As above but also write the reduction of each segment to [totals] (length [n])
+     *   at the index of its last element, ie, wherever the next flag is set and at n-1.
+     * Every other element of [totals] is the identity of [Op].
+     */
+    void scan(T *data, int *flag, int n, T *totals);
+    void scan(cl_mem data, cl_mem flag, int n, cl_mem totals);
+
+    /*
+     * Segmented scan with head flags packed 32 to a word (see pack_flags).
+     * The device buffer overload scans [data] inplace.
+     */
+    void scan_packed(T *data, cl_uint *flagbits, int n);
+    void scan_packed(cl_mem data, cl_mem flagbits, int n);
+
+    /*
+     * Segmented scan where segment s starts at element [offsets][s] (eg, CSR row offsets).
+     * [offsets] must be ascending; offsets >= n are ignored.
+     * We build packed flags on-device so no flag array of length [n] is needed.
+     */
+    void scan_by_offsets(T *data, int n, int *offsets, int nsegments);
+    void scan_by_offsets(cl_mem data, int n, cl_mem offsets, int nsegments);
+
+    // as above but also write the reduction of each segment to [totals] (length [nsegments])
+    void scan_by_offsets(T *data, int n, int *offsets, int nsegments, T *totals);
+    void scan_by_offsets(cl_mem data, int n, cl_mem offsets, int nsegments, cl_mem totals);
+
+    /*
+     * Segmented scan where a segment starts wherever [keys][i] != [keys][i-1].
+     */
+    void scan_by_key(T *data, int *keys, int n);
+    void scan_by_key(cl_mem data, cl_mem keys, int n);
+
+    // as above with [totals] at the last element of each run of equal keys (see scan with totals)
+    void scan_by_key(T *data, int *keys, int n, T *totals);
+    void scan_by_key(cl_mem data, cl_mem keys, int n, cl_mem totals);
 };
 
+/*
+ * Number of words needed to pack [n] flags.
+ */
+int packed_flags_length(int n);
+
+/*
+ * Pack [flag] of length [n] into [flagbits] of length packed_flags_length(n).
+ * The flag of element i is bit (i%32) of word i/32.
+ */
+void pack_flags(cl_uint *flagbits, const int *flag, int n);
+
+typedef BasicSegmentedScan<int, Add<int> > SegmentedScan;
+
 #endif
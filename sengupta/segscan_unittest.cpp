@@ -1,10 +1,13 @@
 #include "clwrapper.h"
+#include "programcache.h"
 #include "scanref.h"
 #include "segscan.h"
 #include "utils.h"
 
 #include "UnitTest++.h"
 
+#include <cstring>
+
 #define N 8
 
 TEST(Simple) {
@@ -45,6 +48,323 @@ TEST(Random_1048576) {
   random_test(1048576, 128);
 }
 
+void packed_test(int n, int wx, bool device) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, wx);
+  int *x = new int[n];
+  int *f = new int[n];
+  int *result = new int[n];
+  cl_uint *flagbits = new cl_uint[packed_flags_length(n)];
+  fill_random_data(x, n, n);
+  fill_random_data(f, n, 2);
+  pack_flags(flagbits, f, n);
+  segmented_exclusive_scan_host(result, x, f, n);
+  if (device) {
+    cl_mem d_data = clw.dev_malloc(sizeof(int)*n);
+    cl_mem d_flagbits = clw.dev_malloc(sizeof(cl_uint)*packed_flags_length(n));
+    clw.memcpy_to_dev(d_data, sizeof(int)*n, x);
+    clw.memcpy_to_dev(d_flagbits, sizeof(cl_uint)*packed_flags_length(n), flagbits);
+    ss->scan_packed(d_data, d_flagbits, n);
+    clw.memcpy_from_dev(d_data, sizeof(int)*n, x);
+    clw.dev_free(d_data);
+    clw.dev_free(d_flagbits);
+  } else {
+    ss->scan_packed(x, flagbits, n);
+  }
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] f;
+  delete[] result;
+  delete[] flagbits;
+}
+
+TEST(Packed_Simple) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, /*wx=*/4);
+  int x[N]            = { 3, 1, 7, 0, 4, 1, 6, 3 };
+  cl_uint flagbits[1] = { 0x25 }; // { 1, 0, 1, 0, 0, 1, 0, 0 }
+  const int result[N] = { 0, 3, 0, 7, 7, 0, 1, 7 };
+  ss->scan_packed(x, flagbits, N);
+  CHECK_ARRAY_EQUAL(result, x, N);
+}
+
+TEST(Packed_Random_1000) {
+  packed_test(1000, 128, /*device=*/false);
+}
+
+TEST(Packed_Random_1048576) {
+  packed_test(1048576, 128, /*device=*/false);
+}
+
+TEST(Packed_Device_1000001) {
+  packed_test(1000001, 128, /*device=*/true);
+}
+
+void offsets_test(int n, int wx, int nsegments) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, wx);
+  int *x = new int[n];
+  int *f = new int[n];
+  int *offsets = new int[nsegments];
+  int *result = new int[n];
+  int *expected = new int[n];
+  fill_random_data(x, n, n);
+  // ascending offsets, including empty segments
+  for (int s=0; s<nsegments; s++) {
+    offsets[s] = (int) (((long) s * n) / nsegments) + (s % 3 == 2 ? 0 : rand_int(2));
+  }
+  memset(f, 0, sizeof(int)*n);
+  for (int s=0; s<nsegments; s++) {
+    if (offsets[s] < n) f[offsets[s]] = 1;
+  }
+  segmented_exclusive_scan_offsets_host(result, x, n, offsets, nsegments);
+  segmented_exclusive_scan_host(expected, x, f, n);
+  CHECK_ARRAY_EQUAL(expected, result, n);
+  ss->scan_by_offsets(x, n, offsets, nsegments);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] f;
+  delete[] offsets;
+  delete[] result;
+  delete[] expected;
+}
+
+TEST(Offsets_1000) {
+  offsets_test(1000, 128, 17);
+}
+
+TEST(Offsets_1048576) {
+  offsets_test(1048576, 128, 5000);
+}
+
+void offsets_totals_test(int n, int wx, int nsegments) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, wx);
+  int *x = new int[n];
+  int *offsets = new int[nsegments];
+  int *result = new int[n];
+  int *totals = new int[nsegments];
+  int *expected = new int[nsegments];
+  fill_random_data(x, n, n);
+  for (int s=0; s<nsegments; s++) {
+    offsets[s] = (int) (((long) s * n) / nsegments) + (s % 3 == 2 ? 0 : rand_int(2));
+  }
+  for (int s=0; s<nsegments; s++) {
+    int end = (s+1 < nsegments) ? offsets[s+1] : n;
+    expected[s] = 0;
+    for (int i=offsets[s]; i<end; i++) {
+      expected[s] += x[i];
+    }
+  }
+  segmented_exclusive_scan_offsets_host(result, x, n, offsets, nsegments);
+  ss->scan_by_offsets(x, n, offsets, nsegments, totals);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  CHECK_ARRAY_EQUAL(expected, totals, nsegments);
+  delete[] x;
+  delete[] offsets;
+  delete[] result;
+  delete[] totals;
+  delete[] expected;
+}
+
+TEST(OffsetsTotals_1000) {
+  offsets_totals_test(1000, 128, 17);
+}
+
+TEST(OffsetsTotals_1048576) {
+  offsets_totals_test(1048576, 128, 5000);
+}
+
+void keys_test(int n, int wx) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, wx);
+  int *x = new int[n];
+  int *f = new int[n];
+  int *keys = new int[n];
+  int *result = new int[n];
+  int *expected = new int[n];
+  fill_random_data(x, n, n);
+  fill_random_data(f, n, 20);
+  keys[0] = 7;
+  for (int i=1; i<n; i++) {
+    f[i] = (f[i] == 0);
+    keys[i] = f[i] ? keys[i-1] + 1 + rand_int(3) : keys[i-1];
+  }
+  segmented_exclusive_scan_keys_host(result, x, keys, n);
+  segmented_exclusive_scan_host(expected, x, f, n);
+  CHECK_ARRAY_EQUAL(expected, result, n);
+  ss->scan_by_key(x, keys, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] f;
+  delete[] keys;
+  delete[] result;
+  delete[] expected;
+}
+
+TEST(Keys_1000) {
+  keys_test(1000, 128);
+}
+
+TEST(Keys_1000001) {
+  keys_test(1000001, 128);
+}
+
+/*
+ * Totals at the tail of each segment, given by flags or by the equivalent keys
+ */
+void tails_totals_test(int n, int wx, bool by_key) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan ss(clw, wx);
+  int *x = new int[n];
+  int *f = new int[n];
+  int *keys = new int[n];
+  int *result = new int[n];
+  int *totals = new int[n];
+  int *expected = new int[n];
+  fill_random_data(x, n, n);
+  fill_random_data(f, n, 20);
+  keys[0] = 3;
+  f[0] = 1;
+  for (int i=1; i<n; i++) {
+    f[i] = (f[i] == 0);
+    keys[i] = f[i] ? keys[i-1] + 1 : keys[i-1];
+  }
+  int sum = 0;
+  for (int i=0; i<n; i++) {
+    sum = f[i] ? x[i] : sum + x[i];
+    expected[i] = (i == n-1 || f[i+1]) ? sum : 0;
+  }
+  segmented_exclusive_scan_host(result, x, f, n);
+  if (by_key) {
+    ss.scan_by_key(x, keys, n, totals);
+  } else {
+    ss.scan(x, f, n, totals);
+  }
+  CHECK_ARRAY_EQUAL(result, x, n);
+  CHECK_ARRAY_EQUAL(expected, totals, n);
+  delete[] x;
+  delete[] f;
+  delete[] keys;
+  delete[] result;
+  delete[] totals;
+  delete[] expected;
+}
+
+TEST(FlagsTotals_1000) {
+  tails_totals_test(1000, 128, /*by_key=*/false);
+}
+
+TEST(FlagsTotals_1000001) {
+  tails_totals_test(1000001, 128, /*by_key=*/false);
+}
+
+TEST(KeysTotals_1000001) {
+  tails_totals_test(1000001, 128, /*by_key=*/true);
+}
+
+/*
+ * Segmented scan of [n] random values drawn from ([0..max) * scale) + bias
+ */
+template <typename T, class Op>
+void typed_test(int n, int wx, int max, T scale, T bias) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  BasicSegmentedScan<T,Op> *ss = new BasicSegmentedScan<T,Op>(clw, wx);
+  T *x = new T[n];
+  int *f = new int[n];
+  T *result = new T[n];
+  for (int i=0; i<n; i++) {
+    x[i] = ((T) rand_int(max) * scale) + bias;
+  }
+  fill_random_data(f, n, 1000);
+  for (int i=0; i<n; i++) {
+    // long segments
+    f[i] = (f[i] == 0);
+  }
+  segmented_exclusive_scan_host<T,Op>(result, x, f, n);
+  ss->scan(x, f, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  delete[] x;
+  delete[] f;
+  delete[] result;
+}
+
+TEST(Int64_Add_1000000) {
+  // segment sums exceed 32 bits
+  typed_test<int64_t, Add<int64_t> >(1000000, 128, 1000000, /*scale=*/1<<16, /*bias=*/0);
+}
+
+TEST(Float_Add_100000) {
+  typed_test<float, Add<float> >(100000, 128, 16, /*scale=*/0.5f, /*bias=*/0.0f);
+}
+
+TEST(Double_Min_100000) {
+  typed_test<double, Min<double> >(100000, 128, 100000, /*scale=*/0.5, /*bias=*/-1000.0);
+}
+
+TEST(Int_Max_100000) {
+  typed_test<int, Max<int> >(100000, 128, 100000, /*scale=*/1, /*bias=*/-50000);
+}
+
+TEST(PooledBuffersAcrossSizes) {
+  // buffers handed back by the pool hold stale data from the previous call
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, /*wx=*/128, /*capacity_hint=*/65536);
+  int sizes[] = { 65536, 1000, 65536, 1, 300 };
+  for (int i=0; i<5; i++) {
+    int n = sizes[i];
+    int *x = new int[n];
+    int *f = new int[n];
+    int *result = new int[n];
+    fill_random_data(x, n, n);
+    fill_random_data(f, n, 2);
+    segmented_exclusive_scan_host(result, x, f, n);
+    ss->scan(x, f, n);
+    CHECK_ARRAY_EQUAL(result, x, n);
+    delete[] x;
+    delete[] f;
+    delete[] result;
+  }
+  ss->trim();
+}
+
+TEST(Trace_Levels) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  SegmentedScan *ss = new SegmentedScan(clw, /*wx=*/64);
+  Trace trace;
+  ss->set_trace(&trace);
+  int n = 20000;
+  int *x = new int[n];
+  int *f = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  fill_random_data(f, n, 2);
+  segmented_exclusive_scan_host(result, x, f, n);
+  ss->scan(x, f, n);
+  CHECK_ARRAY_EQUAL(result, x, n);
+
+  // three uploads, m = 128: 157 subarrays, then 2, then a single one, and the download
+  const char *names[] = { "upsweep_subarrays", "upsweep_subarrays", "segscan_pad_to_pow2",
+                          "downsweep_subarrays", "downsweep_subarrays" };
+  int depths[] = { 0, 1, 2, 1, 0 };
+  int lengths[] = { n, 157, 2, 157, n };
+  CHECK_EQUAL(9, (int) trace.size());
+  for (int i=0; i<5 && i+3<(int) trace.size(); i++) {
+    const trace_record &r = trace.at(i+3);
+    CHECK(r.kernel);
+    CHECK_EQUAL(names[i], r.name);
+    CHECK_EQUAL(depths[i], r.depth);
+    CHECK_EQUAL(lengths[i], r.n);
+  }
+  CHECK(!trace.at(8).kernel);
+  CHECK_EQUAL(sizeof(int)*n, trace.at(8).bytes);
+  delete[] x;
+  delete[] f;
+  delete[] result;
+  delete ss;
+}
+
 int main() {
+  TemporaryKernelCache cache;
   return UnitTest::RunAllTests();
 }
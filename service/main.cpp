@@ -0,0 +1,72 @@
+#include "clwrapper.h"
+#include "framework.h"
+#include "scanservice.h"
+
+#include <cstring>
+#include <pthread.h>
+#include <sys/time.h>
+
+using namespace std;
+
+struct caller {
+  ScanService *service;
+  const int *data;
+  int *x;
+  int n;
+  int num_iter;
+};
+
+static void *run_caller(void *arg) {
+  caller *c = (caller *) arg;
+  for (int run=0; run<c->num_iter; run++) {
+    memcpy(c->x, c->data, c->n*sizeof(int));
+    c->service->scan(c->x, c->n);
+  }
+  return NULL;
+}
+
+/*
+ * -t callers (default 4) each run [num_iter] scans of their own copy of the data
+ *   concurrently, through a service with as many lanes.
+ */
+void run(int *data, int n, int num_iter, map<string,float> &timings) {
+  // PLATFORM AND DEVICE INFO
+  if (opt.verbose) {
+    cout << clinfo();
+  }
+
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  int ncallers = opt.nthreads > 0 ? opt.nthreads : 4;
+  ScanService *s = new ScanService(clw, /*max_lanes=*/ncallers, opt.wx, /*capacity_hint=*/n);
+
+  vector<caller> callers(ncallers);
+  vector<pthread_t> threads(ncallers);
+  for (int i=0; i<ncallers; i++) {
+    caller c = { s, data, new int[n], n, num_iter };
+    callers[i] = c;
+  }
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  for (int i=1; i<ncallers; i++) {
+    pthread_create(&threads[i], NULL, run_caller, &callers[i]);
+  }
+  run_caller(&callers[0]);
+  for (int i=1; i<ncallers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  gettimeofday(&end, NULL);
+  float ms = (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+
+  memcpy(data, callers[0].x, n*sizeof(int));
+  for (int i=0; i<ncallers; i++) {
+    delete[] callers[i].x;
+  }
+  if (opt.verbose) {
+    printf("# Callers: %d Lanes: %d\n", ncallers, s->num_lanes());
+    printf("# Scans/s: %.1f\n", ncallers * num_iter / (ms / 1000.0f));
+  }
+
+  s->get_timers(timings);
+  timings.insert(make_pair("SERVICE. all_callers (wall)", ms));
+  delete s;
+}
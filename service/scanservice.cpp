@@ -0,0 +1,160 @@
+#include "scanservice.h"
+
+#include <algorithm>
+
+/*
+ * Take an idle lane, or create one if we have fewer than [max_lanes],
+ *   or wait for a lane to be released.
+ */
+template <typename T, class Op>
+int BasicScanService<T,Op>::acquire() {
+  pthread_mutex_lock(&lock);
+  while (idle.empty() && nlanes == max_lanes) {
+    pthread_cond_wait(&lane_free, &lock);
+  }
+  if (!idle.empty()) {
+    int lane = idle.back();
+    idle.pop_back();
+    pthread_mutex_unlock(&lock);
+    return lane;
+  }
+  int lane = nlanes++;
+  pthread_mutex_unlock(&lock);
+  // the new lane is ours until released, so nobody else reads it while we build it
+  create_lane(lane);
+  return lane;
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::release(int lane) {
+  pthread_mutex_lock(&lock);
+  idle.push_back(lane);
+  pthread_cond_signal(&lane_free);
+  pthread_mutex_unlock(&lock);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::create_lane(int lane) {
+  cl_int err;
+  cl_command_queue_properties props = clw.has_profiling() ? CL_QUEUE_PROFILING_ENABLE : 0;
+  queues[lane] = clCreateCommandQueue(clw.get_context(), clw.get_device(), props, &err);
+  ASSERT_NO_CL_ERROR(err);
+  lanes[lane] = new BasicScan<T,Op>(clw, queues[lane], pool, wx, capacity_hint);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan(T *data, int n) {
+  int lane = acquire();
+  lanes[lane]->scan(data, n);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan(T *data, int n, T *total) {
+  int lane = acquire();
+  lanes[lane]->scan(data, n, total);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan(cl_mem data, int n) {
+  int lane = acquire();
+  lanes[lane]->scan(data, n);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan(cl_mem in, cl_mem out, int n) {
+  int lane = acquire();
+  lanes[lane]->scan(in, out, n);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan(cl_mem in, cl_mem out, int n, T *total) {
+  int lane = acquire();
+  lanes[lane]->scan(in, out, n, total);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan_batch(T *data, int n, int *offsets, int narrays) {
+  int lane = acquire();
+  lanes[lane]->scan_batch(data, n, offsets, narrays);
+  release(lane);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::scan_batch(T *data, int length, int narrays) {
+  int lane = acquire();
+  lanes[lane]->scan_batch(data, length, narrays);
+  release(lane);
+}
+
+template <typename T, class Op>
+int BasicScanService<T,Op>::num_lanes() {
+  pthread_mutex_lock(&lock);
+  int n = nlanes;
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::trim() {
+  pool.trim();
+}
+
+template <typename T, class Op>
+BasicScanService<T,Op>::BasicScanService(CLWrapper &clw, int max_lanes, size_t wx, int capacity_hint) :
+  clw(clw), wx(wx), capacity_hint(capacity_hint), max_lanes(max(max_lanes, 1)), pool(clw),
+  lanes(this->max_lanes, (BasicScan<T,Op> *) NULL), queues(this->max_lanes, (cl_command_queue) NULL),
+  nlanes(0) {
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&lane_free, NULL);
+}
+
+template <typename T, class Op>
+BasicScanService<T,Op>::~BasicScanService() {
+  for (int i=0; i<nlanes; i++) {
+    delete lanes[i];
+    clReleaseCommandQueue(queues[i]);
+  }
+  pthread_cond_destroy(&lane_free);
+  pthread_mutex_destroy(&lock);
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::reset_timers() {
+  for (int i=0; i<nlanes; i++) {
+    lanes[i]->reset_timers();
+  }
+}
+
+template <typename T, class Op>
+void BasicScanService<T,Op>::get_timers(map<string,float> &timings) {
+  for (int i=0; i<nlanes; i++) {
+    map<string,float> lane_timings;
+    lanes[i]->get_timers(lane_timings);
+    map<string,float>::iterator t;
+    for (t = lane_timings.begin(); t != lane_timings.end(); t++) {
+      timings[t->first] += t->second;
+    }
+  }
+}
+
+template class BasicScanService<int,     Add<int> >;
+template class BasicScanService<int,     Max<int> >;
+template class BasicScanService<int,     Min<int> >;
+template class BasicScanService<int,     And<int> >;
+template class BasicScanService<int,     Or<int> >;
+template class BasicScanService<int64_t, Add<int64_t> >;
+template class BasicScanService<int64_t, Max<int64_t> >;
+template class BasicScanService<int64_t, Min<int64_t> >;
+template class BasicScanService<int64_t, And<int64_t> >;
+template class BasicScanService<int64_t, Or<int64_t> >;
+template class BasicScanService<float,   Add<float> >;
+template class BasicScanService<float,   Max<float> >;
+template class BasicScanService<float,   Min<float> >;
+template class BasicScanService<double,  Add<double> >;
+template class BasicScanService<double,  Max<double> >;
+template class BasicScanService<double,  Min<double> >;
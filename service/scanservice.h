@@ -0,0 +1,67 @@
+#ifndef SCANSERVICE_H
+#define SCANSERVICE_H
+
+#include "bufferpool.h"
+#include "clwrapper.h"
+#include "scan.h"
+
+#include <pthread.h>
+
+/*
+ * Exclusive scan for many concurrent callers on one device.
+ *
+ * A BasicScan sets the arguments of its kernels just before each launch and keeps its
+ *   own timers, so two threads cannot share one. The service keeps a set of lanes instead:
+ *   each lane is a BasicScan with its own kernels and command queue, all built from the
+ *   one compiled program (see common/programcache.h) and all taking buffers from one
+ *   shared pool.
+ * Each call takes an idle lane, scans on it and gives it back, so the lock is only held
+ *   to pick a lane and concurrent callers run side by side on the device.
+ * Lanes are created on first need, up to [max_lanes]; after that callers wait for one.
+ *
+ * Device buffers passed in must be ready (eg, written by a blocking copy),
+ *   since lanes enqueue on their own queues.
+ * Only the blocking scans are offered (see the shared pool form of BasicScan).
+ */
+template <typename T, class Op=Add<T> >
+class BasicScanService {
+  private:
+    CLWrapper &clw;
+    size_t wx;
+    int capacity_hint;
+    int max_lanes;
+    BufferPool pool;                    // shared by all lanes
+    vector<BasicScan<T,Op> *> lanes;    // [max_lanes], the first [nlanes] created
+    vector<cl_command_queue> queues;    // queue of each lane
+    int nlanes;
+    vector<int> idle;                   // created lanes not in use
+    pthread_mutex_t lock;               // guards nlanes and idle
+    pthread_cond_t lane_free;
+
+    int acquire();
+    void release(int lane);
+    void create_lane(int lane);
+
+  public:
+    BasicScanService(CLWrapper &clw, int max_lanes=8, size_t wx=256, int capacity_hint=0);
+    ~BasicScanService();
+
+    // only while no scans are running; timings are summed over all lanes
+    void reset_timers();
+    void get_timers(map<string,float> &timings);
+    void trim();
+
+    int num_lanes();
+
+    void scan(T *data, int n);
+    void scan(T *data, int n, T *total);
+    void scan(cl_mem data, int n);
+    void scan(cl_mem in, cl_mem out, int n);
+    void scan(cl_mem in, cl_mem out, int n, T *total);
+    void scan_batch(T *data, int n, int *offsets, int narrays);
+    void scan_batch(T *data, int length, int narrays);
+};
+
+typedef BasicScanService<int, Add<int> > ScanService;
+
+#endif
@@ -0,0 +1,116 @@
+#include "clwrapper.h"
+#include "programcache.h"
+#include "scanref.h"
+#include "scanservice.h"
+#include "utils.h"
+
+#include "UnitTest++.h"
+
+#include <pthread.h>
+
+struct caller {
+  ScanService *service;
+  int seed;        // also picks the length of each scan
+  int num_iter;
+  bool pass;
+};
+
+void *run_caller(void *arg) {
+  caller *c = (caller *) arg;
+  c->pass = true;
+  for (int run=0; run<c->num_iter; run++) {
+    int n = 1000 + ((c->seed * 7919 + run * 104729) % 200000);
+    int *x = new int[n];
+    int *result = new int[n];
+    fill_random_data(x, n, 1000);
+    exclusive_scan_host(result, x, n);
+    c->service->scan(x, n);
+    for (int i=0; i<n; i++) {
+      if (x[i] != result[i]) {
+        c->pass = false;
+        break;
+      }
+    }
+    delete[] x;
+    delete[] result;
+  }
+  return NULL;
+}
+
+void concurrent_test(int ncallers, int max_lanes, int num_iter) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  ScanService *s = new ScanService(clw, max_lanes, /*wx=*/128);
+  vector<caller> callers(ncallers);
+  vector<pthread_t> threads(ncallers);
+  for (int i=0; i<ncallers; i++) {
+    caller c = { s, i, num_iter, false };
+    callers[i] = c;
+    pthread_create(&threads[i], NULL, run_caller, &callers[i]);
+  }
+  for (int i=0; i<ncallers; i++) {
+    pthread_join(threads[i], NULL);
+    CHECK(callers[i].pass);
+  }
+  CHECK(s->num_lanes() >= 1);
+  CHECK(s->num_lanes() <= max_lanes);
+  delete s;
+}
+
+TEST(Concurrent_8Callers_4Lanes) {
+  concurrent_test(8, 4, 5);
+}
+
+TEST(Concurrent_4Callers_4Lanes) {
+  concurrent_test(4, 4, 5);
+}
+
+TEST(Concurrent_OneLane) {
+  concurrent_test(3, 1, 3);
+}
+
+TEST(SequentialCallerUsesOneLane) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  ScanService *s = new ScanService(clw, /*max_lanes=*/4, /*wx=*/128);
+  for (int i=0; i<5; i++) {
+    int n = 10000 * (i+1);
+    int *x = new int[n];
+    int *result = new int[n];
+    fill_random_data(x, n, 1000);
+    exclusive_scan_host(result, x, n);
+    int last = x[n-1];
+    int total;
+    s->scan(x, n, &total);
+    CHECK_ARRAY_EQUAL(result, x, n);
+    CHECK_EQUAL(result[n-1] + last, total);
+    delete[] x;
+    delete[] result;
+  }
+  CHECK_EQUAL(1, s->num_lanes());
+  delete s;
+}
+
+TEST(Device_OutOfPlace_100000) {
+  CLWrapper clw(/*platform=*/0,/*device=*/0,/*profiling=*/true);
+  ScanService *s = new ScanService(clw, /*max_lanes=*/2, /*wx=*/128);
+  int n = 100000;
+  int *x = new int[n];
+  int *result = new int[n];
+  fill_random_data(x, n, 1000);
+  exclusive_scan_host(result, x, n);
+  cl_mem d_in = clw.dev_malloc(sizeof(int)*n);
+  cl_mem d_out = clw.dev_malloc(sizeof(int)*n);
+  clw.memcpy_to_dev(d_in, sizeof(int)*n, x);
+  s->scan(d_in, d_out, n);
+  clw.memcpy_from_dev(d_out, sizeof(int)*n, x);
+  CHECK_ARRAY_EQUAL(result, x, n);
+  clw.dev_free(d_in);
+  clw.dev_free(d_out);
+  delete s;
+  delete[] x;
+  delete[] result;
+}
+
+int main() {
+  TemporaryKernelCache cache;
+  return UnitTest::RunAllTests();
+}